@@ -0,0 +1,86 @@
+/* Host memory for tensor storage.
+ *
+ * Tensors come and go at a high rate, and most of them have a size
+ * seen many times before. Freed blocks are kept in size classes, four
+ * per power of two, and handed out again instead of going back to the
+ * system: no allocator round trip, and no page faults on memory the
+ * process already touched. Each thread keeps a small cache of its own
+ * in front of a shared one.
+ *
+ * The allocator is a std::pmr::memory_resource, set_storage_allocator
+ * swaps it for another. Buffers remember the one they came from.
+ * TENSORLIB_ALLOC_CACHE_MB caps what is kept cached (default 1024),
+ * 0 turns caching off.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace tensorlib {
+
+struct AllocatorStats {
+    size_t hits = 0;            // served from a cache
+    size_t misses = 0;          // went to the system
+    size_t bytes_held = 0;      // free, kept cached
+    size_t bytes_in_use = 0;    // handed out, by size class
+};
+
+class CachingAllocator : public std::pmr::memory_resource {
+public:
+    static constexpr size_t alignment = 64;
+    // Size classes go up to 1 GiB, anything bigger is left to the system
+    static constexpr size_t nclasses = 92;
+    static constexpr size_t max_cached = size_t(1) << 30;
+    // Thread caches only keep blocks up to 1 MiB, 16 MiB of them at most
+    static constexpr size_t thread_max_block = size_t(1) << 20;
+    static constexpr size_t thread_max_bytes = size_t(16) << 20;
+
+    // limit - bytes kept cached at most, shared cache and threads together
+    explicit CachingAllocator(size_t limit);
+    CachingAllocator();
+    ~CachingAllocator();
+
+    AllocatorStats stats() const;
+    // Hand cached blocks of the shared cache and the calling thread's
+    // back to the system
+    void trim();
+
+    // Index of the smallest class fitting bytes, and its size
+    static size_t size_class(size_t bytes);
+    static size_t class_bytes(size_t index);
+
+    // What the caches share, outlives the allocator while threads still
+    // cache its blocks
+    struct Shared {
+        std::mutex lock;
+        std::vector<void*> free[nclasses];
+        size_t limit;
+        std::atomic<size_t> hits{0}, misses{0}, held{0}, in_use{0};
+        ~Shared();
+    };
+
+private:
+    std::shared_ptr<Shared> shared;
+
+    void* do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void* ptr, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Where new tensor storage comes from, a process wide CachingAllocator
+// unless set otherwise
+std::pmr::memory_resource* storage_allocator();
+// nullptr goes back to the default. r has to outlive everything
+// allocated from it.
+void set_storage_allocator(std::pmr::memory_resource* r);
+CachingAllocator& default_storage_allocator();
+
+} // namespace tensorlib
+
+#include "allocator.tpp"
@@ -5,12 +5,16 @@
 
 namespace tensorlib {
 
-enum class Primitive { Float, Int, Bool, None };
+// BFloat is bfloat16, a float with the exponent of f32 and the
+// mantissa cut to 7 bits
+enum class Primitive { Float, BFloat, Int, Bool, Quantized, None };
 
 static std::map<Primitive, std::string> primitive_repr = {
     {Primitive::Float, "f"},
+    {Primitive::BFloat, "bf"},
     {Primitive::Int, "i"},
     {Primitive::Bool, "b"},
+    {Primitive::Quantized, "q"},
     {Primitive::None, "n"},
 };
 
@@ -19,23 +23,49 @@ struct DType {
     size_t bytes; // in bytes (helpful)
     std::string repr;
     Primitive type;
+    // Elements stored together. Quantized types pack a block of them
+    // with its scales, size and bytes are then those of a whole block.
+    size_t block = 1;
     DType() : size(0), bytes(0), repr("empty"), type(Primitive::None) {}
     DType(Primitive type, size_t size)
         : size(size), bytes(size/8), type(type) {
         this->repr = primitive_repr[type] + std::to_string(size);
     }
+    // Blocks of block elements taking bytes each, kept packed
+    DType(const std::string& repr, size_t block, size_t bytes)
+        : size(bytes*8), bytes(bytes), repr(repr),
+          type(Primitive::Quantized), block(block) {}
+    // Memory taken by n elements, a whole number of blocks
+    size_t nbytes(size_t n) const { return n / block * bytes; }
     friend bool operator==(const DType& a, const DType& b) = default;
 };
 
 static std::map<std::string, DType> dtypes_map = {
     {"float32", DType(Primitive::Float, 32)},
     {"f32", DType(Primitive::Float, 32)},
+    {"float16", DType(Primitive::Float, 16)},
+    {"f16", DType(Primitive::Float, 16)},
+    {"bfloat16", DType(Primitive::BFloat, 16)},
+    {"bf16", DType(Primitive::BFloat, 16)},
     {"int32", DType(Primitive::Int, 32)},
     {"i32", DType(Primitive::Int, 32)},
     {"int64", DType(Primitive::Int, 64)},
     {"i64", DType(Primitive::Int, 64)},
     {"bool", DType(Primitive::Bool, 1)},
     {"b1", DType(Primitive::Bool, 1)},
+    // ggml's block quantized types, as found in GGUF files
+    {"q4_0", DType("q4_0", 32, 18)},
+    {"q4_1", DType("q4_1", 32, 20)},
+    {"q5_0", DType("q5_0", 32, 22)},
+    {"q5_1", DType("q5_1", 32, 24)},
+    {"q8_0", DType("q8_0", 32, 34)},
+    {"q8_1", DType("q8_1", 32, 36)},
+    {"q2_k", DType("q2_k", 256, 84)},
+    {"q3_k", DType("q3_k", 256, 110)},
+    {"q4_k", DType("q4_k", 256, 144)},
+    {"q5_k", DType("q5_k", 256, 176)},
+    {"q6_k", DType("q6_k", 256, 210)},
+    {"q8_k", DType("q8_k", 256, 292)},
 };
 
 } // namespace tensorlib
@@ -0,0 +1,37 @@
+/* Graph execution.
+ *
+ * Dependency counted: every node counts its inputs still being
+ * computed. Nodes without any go to the pool, and whoever finishes a
+ * node hands its users to the pool once their count drops to zero.
+ * Independent branches run side by side, nothing polls. Kernels are
+ * bound to their memory before anything runs, a node calls its own
+ * on the thread that picked it up.
+ */
+#pragma once
+
+#include <ir.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace tensorlib {
+
+// Kernels handed to devices so far, handy to see what passes save
+std::atomic<uint64_t> kernel_dispatch_count{0};
+
+// Every node lowered to its device kernel, bound to the memory its
+// tensors were assigned. Empty for nodes computing nothing.
+std::vector<std::function<void()>> bind_kernels(const Graph& graph);
+
+// Run node i's bound kernel, blocks until done
+void run_node(const Graph& graph, uint32_t i, const std::function<void()>& kernel);
+
+// Compute every node of the graph, blocks until done. Throws if a
+// kernel failed.
+void execute(const Graph& graph);
+
+} // namespace tensorlib
+
+#include "executor.tpp"
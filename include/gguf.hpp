@@ -0,0 +1,84 @@
+/* GGUF reader.
+ *
+ * GGUF files hold a table of typed metadata (architecture, hyper
+ * parameters, the tokenizer) followed by tensor infos and the aligned
+ * tensor data. The file is mapped, metadata and infos are parsed up
+ * front, tensors are views into the mapping. Block quantized tensors
+ * stay packed, as the q* dtypes.
+ */
+#pragma once
+
+#include <mapped_file.hpp>
+#include <dtype.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace tensorlib {
+
+class Tensor;
+
+// A metadata value. Integers keep their signedness, arrays hold values
+// of a single type.
+struct GGUFValue {
+    // Type ids of the format
+    enum class Type : uint32_t {
+        U8 = 0, I8 = 1, U16 = 2, I16 = 3, U32 = 4, I32 = 5, F32 = 6,
+        Bool = 7, String = 8, Array = 9, U64 = 10, I64 = 11, F64 = 12,
+    };
+    Type type;
+    std::variant<uint64_t, int64_t, double, bool, std::string,
+                 std::vector<GGUFValue>> value;
+
+    // Throw when the value isn't one, or doesn't fit
+    uint64_t as_uint() const;
+    int64_t as_int() const;
+    double as_float() const;
+    bool as_bool() const;
+    const std::string& as_string() const;
+    const std::vector<GGUFValue>& as_array() const;
+};
+
+struct GGUFTensorInfo {
+    std::string name;
+    // Outermost dimension first, GGUF lists them the other way around
+    std::vector<int> shape;
+    // ggml type id
+    uint32_t type;
+    // Key of dtypes_map, empty when not supported
+    std::string dtype;
+    // From the start of the file
+    uint64_t offset;
+    uint64_t nbytes;
+};
+
+class GGUFReader {
+public:
+    explicit GGUFReader(const std::string& path,
+                        MappedFile::Mode mode = MappedFile::Mode::ReadOnly);
+
+    uint32_t version() const { return version_; }
+    const std::map<std::string, GGUFValue>& metadata() const { return metadata_; }
+    // In file order
+    const std::vector<GGUFTensorInfo>& tensor_infos() const { return infos_; }
+    const GGUFTensorInfo& tensor_info(const std::string& name) const;
+
+    // A view into the mapping, throws for unsupported dtypes
+    Tensor tensor(const std::string& name) const;
+    // Every tensor of a supported dtype, by name
+    std::map<std::string, Tensor> tensors() const;
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    uint32_t version_ = 0;
+    std::map<std::string, GGUFValue> metadata_;
+    std::vector<GGUFTensorInfo> infos_;
+    std::map<std::string, size_t> by_name_;
+};
+
+} // namespace tensorlib
+
+#include "gguf.tpp"
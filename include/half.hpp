@@ -0,0 +1,96 @@
+/* Half precision floats.
+ *
+ * IEEE binary16 (f16) and bfloat16 (bf16, the top half of a float),
+ * both computed on as floats. Conversions here are bit exact and
+ * portable, for the places that handle one value at a time (scales of
+ * quantized blocks, printing). Bulk conversions belong in the kernels,
+ * which use the hardware instructions where there are some.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace tensorlib {
+
+inline float fp16_to_fp32(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0x1f) {
+        // Inf and NaN
+        bits = sign | 0x7f800000 | mant << 13;
+    } else if (exp != 0) {
+        bits = sign | (exp + 112) << 23 | mant << 13;
+    } else if (mant == 0) {
+        bits = sign;
+    } else {
+        // Subnormal, normalized as a float
+        exp = 113;
+        while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | exp << 23 | (mant & 0x3ff) << 13;
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Rounds to nearest even, like the hardware does
+inline uint16_t fp32_to_fp16(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
+    if (abs > 0x7f800000)
+        return sign | 0x7e00;
+    // Past the largest half once rounded, and infinities
+    if (abs >= 0x477ff000)
+        return sign | 0x7c00;
+    if (abs < 0x38800000) {
+        // Subnormal, in units of 2^-24
+        float magnitude;
+        std::memcpy(&magnitude, &abs, sizeof(magnitude));
+        return sign | uint16_t(std::nearbyint(magnitude * 0x1p24f));
+    }
+    uint32_t rounded = abs + 0xfff + ((abs >> 13) & 1);
+    return sign | uint16_t((rounded - 0x38000000) >> 13);
+}
+
+inline float bf16_to_fp32(uint16_t h) {
+    uint32_t bits = uint32_t(h) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Rounds to nearest even, NaNs stay NaNs
+inline uint16_t fp32_to_bf16(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000)
+        return (x >> 16) | 0x40;
+    return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+// Element types of f16 and bf16 tensors, just the bits. Tensors built
+// from vectors of them get their dtype.
+struct float16 {
+    uint16_t bits;
+    float16() = default;
+    explicit float16(float f) : bits(fp32_to_fp16(f)) {}
+    explicit operator float() const { return fp16_to_fp32(bits); }
+};
+
+struct bfloat16 {
+    uint16_t bits;
+    bfloat16() = default;
+    explicit bfloat16(float f) : bits(fp32_to_bf16(f)) {}
+    explicit operator float() const { return bf16_to_fp32(bits); }
+};
+
+} // namespace tensorlib
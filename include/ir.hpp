@@ -0,0 +1,98 @@
+/* Graph IR.
+ *
+ * Built once per realization from the tensors' parents. Nodes are
+ * plain records in one array, in topological order, and refer to
+ * their inputs by index. Shapes, inputs and params of all nodes share
+ * flat arrays, so passes and the executor walk contiguous memory
+ * instead of looking tensors up by tuid.
+ */
+#pragma once
+
+#include <ops.hpp>
+#include <dtype.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <span>
+#include <utility>
+
+namespace tensorlib {
+
+class Tensor;
+
+struct IRNode {
+    Op op;
+    uint8_t dtype;      // into Graph::dtypes
+    uint16_t ndim;
+    uint32_t shape;     // into Graph::dims
+    uint32_t inputs;    // into Graph::inputs
+    uint32_t ninputs;
+    uint32_t params;    // into Graph::params
+    uint32_t nparams;
+};
+
+struct Graph {
+    // Inputs always come before their users
+    std::vector<IRNode> nodes;
+    std::vector<uint32_t> inputs;
+    std::vector<int> dims;
+    std::vector<int> params;
+    // Distinct dtypes of the graph, nodes keep an index
+    std::vector<DType> dtypes;
+    // Tensor computed by each node, this is where results go
+    std::vector<Tensor*> tensors;
+    uint32_t root = 0;
+    // Ordering besides the inputs, {node, node it runs after}. Added
+    // last thing before execution, rewrite drops them.
+    std::vector<std::pair<uint32_t, uint32_t>> waits;
+
+    uint32_t add(Op op,
+            const DType& dtype,
+            std::span<const int> shape,
+            std::span<const uint32_t> inputs,
+            std::span<const int> params,
+            Tensor* tensor);
+
+    size_t size() const { return nodes.size(); }
+    std::span<const uint32_t> inputs_of(uint32_t i) const {
+        return {inputs.data() + nodes[i].inputs, nodes[i].ninputs};
+    }
+    std::span<const int> shape_of(uint32_t i) const {
+        return {dims.data() + nodes[i].shape, nodes[i].ndim};
+    }
+    std::span<const int> params_of(uint32_t i) const {
+        return {params.data() + nodes[i].params, nodes[i].nparams};
+    }
+    const DType& dtype_of(uint32_t i) const {
+        return dtypes[nodes[i].dtype];
+    }
+    size_t numel(uint32_t i) const;
+
+    // Marks a node to drop in rewrite
+    static constexpr uint32_t dropped = ~uint32_t(0);
+    // Copy of the graph without the nodes replaced by another one
+    // (replace[i] < i, its users move over to it) or dropped.
+    // replace[i] == i keeps node i.
+    Graph rewrite(std::span<const uint32_t> replace) const;
+};
+
+// Users of every node, in CSR form: users of node i are
+// list[offsets[i]] .. list[offsets[i + 1]]. A node using the same
+// input twice is listed twice.
+struct GraphUsers {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> list;
+
+    std::span<const uint32_t> of(uint32_t i) const {
+        return {list.data() + offsets[i], offsets[i + 1] - offsets[i]};
+    }
+};
+
+GraphUsers graph_users(const Graph& graph);
+
+// Everything the root still needs. Realized tensors become Load nodes.
+Graph build_graph(Tensor& root);
+
+} // namespace tensorlib
+
+#include "ir.tpp"
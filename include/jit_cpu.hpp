@@ -0,0 +1,53 @@
+/* Runtime compiled CPU kernels.
+ *
+ * Fused elementwise programs are turned into C++ with the dtype and
+ * the whole chain baked in, built into a shared object by the system
+ * compiler and dlopen'ed. Objects are cached on disk under a hash of
+ * their source, the compiler's version and the host's instruction
+ * sets, so a given kernel is compiled once per machine.
+ *
+ * TENSORLIB_JIT=0 turns it off, kernels then fall back to the
+ * interpreted versions. TENSORLIB_CXX picks the compiler (default c++)
+ * and TENSORLIB_JIT_CACHE the cache directory.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace tensorlib::cpu::jit {
+
+// Processes elements [begin, end) of every buffer
+typedef void (*fused_fn)(const void* const* inputs, void* result,
+                         size_t begin, size_t end);
+
+struct Stats {
+    size_t compiled = 0;    // built by the compiler
+    size_t loaded = 0;      // found in the disk cache
+    size_t failed = 0;      // fell back to the interpreter
+};
+
+// Longer programs are left to the interpreter, compile times grow
+// faster than what the generated code saves.
+constexpr size_t max_program = 256;
+
+bool enabled();
+void set_enabled(bool on);
+Stats stats();
+// Whether the compiler runs at all
+bool available();
+
+// Kernel running program over elements of ctype (float, int32_t, ...),
+// nullptr when it can't be had.
+fused_fn fused_kernel(const std::vector<int>& program, const std::string& ctype);
+
+// Source of that kernel, also what the disk cache is keyed by
+std::string fused_source(const std::vector<int>& program, const std::string& ctype);
+
+} // namespace tensorlib::cpu::jit
+
+#include "jit_cpu.tpp"
@@ -0,0 +1,75 @@
+/* CPU kernels.
+ *
+ * The CPU counterpart of shaders/tensor.metal. Kernels only ever see
+ * raw memory, same as the shaders, and are looked up by the same
+ * names (add_v_f32, sub_v_i64, ...).
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+#include <ops.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define TENSORLIB_X86
+    #define TL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #define TL_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,fma")))
+#endif
+
+#define TL_INLINE inline __attribute__((always_inline))
+
+namespace tensorlib::cpu {
+
+// inputs - parent buffers, in the order the parents were passed
+// result - result buffer
+// mem_size - size of the result buffer in bytes
+// params - kernel specific sizes, e.g. {M, K, N} for matmul
+typedef std::function<void(
+        const std::vector<const uint8_t*>& inputs,
+        uint8_t* result,
+        size_t mem_size,
+        const std::vector<int>& params)> kernel_fn;
+
+// Kernels with setup worth doing once per node rather than per run,
+// e.g. compiling it. Given the number of inputs and the params of a
+// node, returns the kernel running it with those params.
+typedef std::function<kernel_fn(
+        size_t ninputs,
+        const std::vector<int>& params)> kernel_binder;
+
+// Instruction sets the kernels are specialized for, widest last.
+// Generic is plain 16 byte vectors, which is SSE on x86 and NEON on arm.
+enum class ISA { Generic, AVX2, AVX512 };
+
+static std::map<ISA, std::string> isa_repr = {
+    {ISA::Generic, "generic"},
+    {ISA::AVX2, "avx2"},
+    {ISA::AVX512, "avx512"},
+};
+
+// Widest instruction set the host supports, checked once via cpuid.
+// TENSORLIB_ISA=generic|avx2|avx512 lowers it, for testing/benchmarking.
+ISA host_isa();
+
+// Fill a kernel table with every kernel the CPU knows about,
+// picking the variant matching host_isa().
+void register_kernels(std::map<std::string, kernel_fn>& compute_functions);
+
+// Fill a table with the kernels that are bound per node. Those are
+// also in register_kernels' table, binding themselves on every call.
+void register_binders(std::map<std::string, kernel_binder>& binders);
+
+} // namespace tensorlib::cpu
+
+#include <jit_cpu.hpp>
+#include "convert_cpu.tpp"
+#include "gemm_cpu.tpp"
+#include "qgemm_cpu.tpp"
+#include "reduce_cpu.tpp"
+#include "softmax_cpu.tpp"
+#include "norm_cpu.tpp"
+#include "kernels_cpu.tpp"
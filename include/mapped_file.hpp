@@ -0,0 +1,58 @@
+/* Memory mapped files.
+ *
+ * Weights are mapped rather than read: the OS pages them in on first
+ * touch, processes mapping the same file share one copy in the page
+ * cache, and nothing is loaded that is never read. Tensors over a
+ * mapping keep it alive through their storage.
+ */
+#pragma once
+
+#include <storage.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tensorlib {
+
+class MappedFile : public std::enable_shared_from_this<MappedFile> {
+public:
+    enum class Mode {
+        ReadOnly,       // shared with the page cache, writes fault
+        CopyOnWrite,    // private, written pages are copied for us
+    };
+    // Mirrors madvise
+    enum class Advice { Normal, Sequential, Random, WillNeed, DontNeed };
+
+    static std::shared_ptr<MappedFile> open(const std::string& path,
+                                            Mode mode = Mode::ReadOnly);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::string& path() const { return path_; }
+    Mode mode() const { return mode_; }
+    uint8_t* data() { return bytes_; }
+    const uint8_t* data() const { return bytes_; }
+    size_t size() const { return size_; }
+
+    // Hint at how [offset, offset + length) will be read, the whole
+    // file by default
+    void advise(Advice advice, size_t offset = 0, size_t length = ~size_t(0));
+    // bytes at offset, keeping the mapping alive. No copy, pages are
+    // loaded when first read.
+    Storage storage(size_t offset, size_t bytes);
+
+private:
+    MappedFile() = default;
+
+    std::string path_;
+    Mode mode_ = Mode::ReadOnly;
+    uint8_t* bytes_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace tensorlib
+
+#include "mapped_file.tpp"
@@ -0,0 +1,42 @@
+/* Memory planning.
+ *
+ * Intermediates of a realization, results nobody can read once it is
+ * over, don't need memory of their own. They are placed in one slab
+ * by walking the schedule: a result takes the first free range big
+ * enough, and gives it back after its last reader. Ranges are reused
+ * as soon as lifetimes allow, the slab ends up as big as the peak.
+ */
+#pragma once
+
+#include <ir.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace tensorlib {
+
+struct MemoryPlan {
+    static constexpr size_t unplanned = ~size_t(0);
+    // Slab offset of each node's result, unplanned ones own theirs
+    std::vector<size_t> offsets;
+    size_t slab_bytes = 0;
+    // One buffer per intermediate, what the slab saves on
+    size_t intermediate_bytes = 0;
+    // Results that outlive the realization
+    size_t output_bytes = 0;
+
+    size_t peak_bytes() const { return slab_bytes + output_bytes; }
+};
+
+// Plan of the latest realization
+MemoryPlan last_memory_plan;
+
+// subgraph - every tensor the realization started with, before passes
+// folded some of them away, parents first.
+// Nodes placed over memory of an earlier result get graph.waits on
+// that result's readers, so running them side by side stays safe.
+MemoryPlan plan_memory(Graph& graph, const std::vector<Tensor*>& subgraph);
+
+} // namespace tensorlib
+
+#include "memory_planner.tpp"
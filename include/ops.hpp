@@ -0,0 +1,97 @@
+#pragma once
+
+#include <dtype.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <map>
+
+namespace tensorlib {
+
+// Operations a tensor can be produced by. Load marks tensors whose
+// data is already there (user created, or realized earlier), they
+// are the inputs of a graph.
+// View aliases its input's memory (params: element offset, then
+// strides) and runs no kernel. Contiguous copies a strided view into
+// dense memory (params: the view's shape, then its strides).
+// Reductions see their input as (outer, n, inner) and reduce over n
+// (params: {outer, n, inner}). Softmax and LogSoftmax normalize rows
+// (params: {rows, n}), RMSNorm and LayerNorm too, scaled by a weight
+// and for LayerNorm shifted by a bias (params: {rows, n, eps as f32
+// bits}).
+enum class Op : uint8_t {
+    Load, Copy, Add, Sub, Mul, Div, MatMul, Fused, Cast, View, Contiguous,
+    Sum, Mean, Max, Min, ArgMax, Softmax, LogSoftmax,
+    RMSNorm, LayerNorm
+};
+
+static std::map<Op, std::string> op_repr = {
+    {Op::Load, "load"},
+    {Op::Copy, "copy"},
+    {Op::Add, "add"},
+    {Op::Sub, "sub"},
+    {Op::Mul, "mul"},
+    {Op::Div, "div"},
+    {Op::MatMul, "matmul"},
+    {Op::Fused, "fused"},
+    {Op::Cast, "cast"},
+    {Op::View, "view"},
+    {Op::Contiguous, "contiguous"},
+    {Op::Sum, "sum"},
+    {Op::Mean, "mean"},
+    {Op::Max, "max"},
+    {Op::Min, "min"},
+    {Op::ArgMax, "argmax"},
+    {Op::Softmax, "softmax"},
+    {Op::LogSoftmax, "log_softmax"},
+    {Op::RMSNorm, "rms_norm"},
+    {Op::LayerNorm, "layer_norm"},
+};
+
+constexpr bool is_reduction(Op op) {
+    return op == Op::Sum || op == Op::Mean || op == Op::Max
+        || op == Op::Min || op == Op::ArgMax;
+}
+
+// Fused elementwise chains carry their program as kernel params, in
+// postfix: k >= 0 pushes input k, fused_op(op) pops two and pushes
+// the result of op. (a + b) * c is {0, 1, fused_op(Add), 2, fused_op(Mul)}.
+constexpr int fused_op(Op op) { return -static_cast<int>(op); }
+
+// Name of the device kernel computing an op, "_v_" for vector
+// (elementwise) kernels and "_m_" for matrix kernels. Matrix kernels
+// take the dtype of their right operand, which may be quantized.
+// Casts go by both dtypes, from then to, cast_v_f16_f32. Row kernels,
+// "_r_" (reductions, softmax and norms), by the dtype they read.
+inline std::string kernel_name(Op op, const DType& dtype, const DType& from = DType()) {
+    switch (op) {
+        case Op::Copy:
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+        case Op::Div:
+        case Op::Fused:
+        case Op::Contiguous:
+            return op_repr[op] + "_v_" + dtype.repr;
+        case Op::MatMul:
+            return "mul_m_" + dtype.repr;
+        case Op::Cast:
+            return "cast_v_" + from.repr + "_" + dtype.repr;
+        case Op::Sum:
+        case Op::Mean:
+        case Op::Max:
+        case Op::Min:
+        case Op::ArgMax:
+            return op_repr[op] + "_r_" + from.repr;
+        case Op::Softmax:
+        case Op::LogSoftmax:
+        case Op::RMSNorm:
+        case Op::LayerNorm:
+            return op_repr[op] + "_r_" + dtype.repr;
+        default:
+            throw std::runtime_error("No kernel for op " + op_repr[op]);
+    }
+}
+
+} // namespace tensorlib
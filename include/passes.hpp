@@ -0,0 +1,27 @@
+/* Graph passes.
+ *
+ * Run on the IR of a realization before it is executed. Every pass
+ * rewrites the graph in place and returns how many nodes it changed.
+ */
+#pragma once
+
+#include <ir.hpp>
+
+namespace tensorlib {
+
+// Nodes running the same op with the same params on the same inputs,
+// to the same shape, dtype and device, are computed once. Duplicates
+// leave the graph, their tensors turn into lazy copies of the one
+// kept so reading them later still works.
+size_t eliminate_common_subexpressions(Graph& graph);
+
+// Elementwise ops feeding a single elementwise user of the same shape
+// and dtype are folded into it, on CPU. Every chain ends up as one
+// Fused node, one pass over memory that reads each input once and
+// writes one result. Folded tensors are not computed, a live handle
+// to one computes it when it is read.
+size_t fuse_elementwise(Graph& graph);
+
+} // namespace tensorlib
+
+#include "passes.tpp"
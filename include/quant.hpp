@@ -0,0 +1,60 @@
+/* Block quantization.
+ *
+ * Weights are stored in blocks of 32 along a row, each with its own
+ * scale (and minimum), the layouts of ggml so GGUF tensors are used
+ * as they are:
+ *   q8_0 - 32 int8, x = d * q
+ *   q4_0 - 32 4 bit, x = d * (q - 8)
+ *   q4_1 - 32 4 bit, x = d * q + m
+ * Scales are halves. 4 bit quants come two to a byte, element i in the
+ * low nibble of byte i, element i + 16 in its high nibble.
+ */
+#pragma once
+
+#include <half.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tensorlib {
+
+constexpr size_t quant_block = 32;
+
+struct block_q8_0 {
+    uint16_t d;
+    int8_t qs[quant_block];
+};
+
+struct block_q4_0 {
+    uint16_t d;
+    uint8_t qs[quant_block / 2];
+};
+
+struct block_q4_1 {
+    uint16_t d;
+    uint16_t m;
+    uint8_t qs[quant_block / 2];
+};
+
+static_assert(sizeof(block_q8_0) == 34 && sizeof(block_q4_0) == 18
+        && sizeof(block_q4_1) == 20, "blocks have to match ggml");
+
+// n floats into n / 32 blocks, n a multiple of 32
+typedef void (*quantize_row_fn)(const float* x, void* blocks, size_t n);
+typedef void (*dequantize_row_fn)(const void* blocks, float* x, size_t n);
+
+void quantize_row_q8_0(const float* x, void* blocks, size_t n);
+void quantize_row_q4_0(const float* x, void* blocks, size_t n);
+void quantize_row_q4_1(const float* x, void* blocks, size_t n);
+void dequantize_row_q8_0(const void* blocks, float* x, size_t n);
+void dequantize_row_q4_0(const void* blocks, float* x, size_t n);
+void dequantize_row_q4_1(const void* blocks, float* x, size_t n);
+
+// By dtype repr, nullptr for types without them
+quantize_row_fn quantize_row_for(const std::string& dtype);
+dequantize_row_fn dequantize_row_for(const std::string& dtype);
+
+} // namespace tensorlib
+
+#include "quant.tpp"
@@ -0,0 +1,30 @@
+/* safetensors loader.
+ *
+ * A safetensors file is an 8 byte little endian header length, a JSON
+ * header naming every tensor with its dtype, shape and byte range, and
+ * the tensor data. The file is mapped and each tensor is a view into
+ * the mapping, nothing is copied or read ahead: loading costs the
+ * header parse, the data is paged in by the kernels reading it.
+ */
+#pragma once
+
+#include <mapped_file.hpp>
+
+#include <map>
+#include <string>
+
+namespace tensorlib {
+
+class Tensor;
+
+// Tensors of the file by name. metadata, when given, receives the
+// free form "__metadata__" entries. Tensors of dtypes other than
+// F32, F16, BF16, I32 and I64 are left out.
+std::map<std::string, Tensor> load_safetensors(
+        const std::string& path,
+        std::map<std::string, std::string>* metadata = nullptr,
+        MappedFile::Mode mode = MappedFile::Mode::ReadOnly);
+
+} // namespace tensorlib
+
+#include "safetensors.tpp"
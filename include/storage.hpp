@@ -0,0 +1,72 @@
+/* Tensor storage.
+ *
+ * Bytes of a tensor, aligned to a cache line (and an AVX-512 register)
+ * and left uninitialized: op results are written over entirely by
+ * their kernel, inputs by the data they are built from, zeroing them
+ * first would only cost a pass over memory.
+ *
+ * Memory comes from the storage allocator, and goes back to the one
+ * it came from. External memory is used in place instead, see
+ * Storage::external.
+ */
+#pragma once
+
+#include <allocator.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+namespace tensorlib {
+
+class Storage {
+public:
+    static constexpr size_t alignment = 64;
+
+    Storage() = default;
+    // bytes of uninitialized memory
+    explicit Storage(size_t bytes,
+                     std::pmr::memory_resource* allocator = storage_allocator());
+    // A copy of bytes of data
+    Storage(const void* data, size_t bytes,
+            std::pmr::memory_resource* allocator = storage_allocator());
+    Storage(Storage&& other) noexcept;
+    Storage& operator=(Storage&& other) noexcept;
+    // Tensors own their memory, copies are explicit
+    Storage(const Storage&) = delete;
+    Storage& operator=(const Storage&) = delete;
+    ~Storage();
+
+    // bytes at data, owned elsewhere and never copied. The storage
+    // holds on to owner, data has to stay valid as long as owner is
+    // alive. Without an owner the caller keeps data alive for as long
+    // as the storage is around. Alignment is whatever data has.
+    static Storage external(void* data, size_t bytes,
+                            std::shared_ptr<void> owner = nullptr);
+    bool is_external() const { return bytes_ && !allocator_; }
+    // bytes of this storage from offset on, no copy. Memory of its own
+    // is handed to a shared owner first, it lives on as long as this
+    // storage or any view of it does.
+    Storage view(size_t offset, size_t bytes);
+
+    uint8_t* data() { return bytes_; }
+    const uint8_t* data() const { return bytes_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Same bytes
+    friend bool operator==(const Storage& a, const Storage& b);
+
+private:
+    uint8_t* bytes_ = nullptr;
+    size_t size_ = 0;
+    std::pmr::memory_resource* allocator_ = nullptr;
+    std::shared_ptr<void> owner_;
+
+    void reset();
+};
+
+} // namespace tensorlib
+
+#include "storage.tpp"
@@ -5,27 +5,64 @@
 #include <tensorlib.hpp>
 #include <device.hpp>
 #include <utils.hpp>
+#include <thread_pool.hpp>
+#include <half.hpp>
 
 #include <vector>
 #include <functional>
 #include <ostream>
 #include <memory>
 #include <map>
+#include <span>
 
 namespace tensorlib {
 
+struct Graph;
+struct MemoryPlan;
+
 class Tensor {
     void* get_raw_data_ptr();
     static TensorPassingContext init_context(
-            const void* data,
-            std::vector<int>const& shape,
-            const std::string& dtype,
-            size_t dtype_size_in_bytes,
-            size_t num_elements,
-            const std::string& device_name);
+            Storage data,
+            std::vector<int>const& shape);
 
     template <typename T>
     DType infer_dtype(const std::string& input_dtype);
+    // Common to the constructors, once the data is in place
+    void init(const DType& dtype, const std::string& device_name);
+    // Elements of shape, checked against what external memory holds
+    static size_t numel(const std::vector<int>& shape);
+    // Row major strides of shape
+    static std::vector<int> dense_strides(const std::vector<int>& shape);
+    // Shape a and b broadcast to, throws if they don't
+    static std::vector<int> broadcast_shapes(const std::vector<int>& a,
+                                             const std::vector<int>& b);
+    // Tensor over shape and strides of this one's elements, from offset
+    // elements into its storage on
+    Tensor view(const std::vector<int>& shape,
+                const std::vector<int>& strides,
+                size_t offset);
+    // Dim counted from the end when negative, checked
+    int axis(int dim) const;
+    // Reduction op over axes, see sum
+    Tensor reduce(Op op, std::vector<int> axes, bool keepdims);
+    // Softmax or LogSoftmax along axis
+    Tensor softmax_boilerplate(Op op, int axis);
+    // RMSNorm or LayerNorm over the last dim by weight (and bias)
+    Tensor norm_boilerplate(Op op, const std::vector<Tensor*>& affine, float eps);
+
+    // Kept alive by global_tensor_map after its handle went away
+    bool orphan = false;
+    static void release_consumer(const std::string& tuid);
+    static void drop(Tensor* tensor);
+    friend size_t eliminate_common_subexpressions(Graph& graph);
+    friend MemoryPlan plan_memory(Graph& graph, const std::vector<Tensor*>& subgraph);
+    // Memory of an op result, once it is about to be computed
+    void allocate();
+    // Lets go of the tensor, what ~Tensor does
+    void detach();
+    // Moves other's state here and points its registry entry at this
+    void take_over(Tensor& other);
 public:
     TensorPassingContext context;
 
@@ -37,7 +74,7 @@ public:
     // through operations are not, they need to be realized to have
     // value.
     bool realized = true;
-    // Helpful for GPU scheduling
+    // Kernel handed to the device, may still be running
     bool queued_realization = false;
 
     template <typename T>
@@ -47,7 +84,49 @@ public:
            const std::string& dtype = "none",
            const std::string& device_name = "cpu");
 
+    // Adopts the vector's memory, no copy. Throws unless it holds the
+    // whole shape, an empty one leaves the memory to realization.
+    template <typename T>
+    Tensor(std::vector<T>&& data,
+           std::vector<int>const& shape,
+           bool requires_grad = true,
+           const std::string& dtype = "none",
+           const std::string& device_name = "cpu");
+
+    // Takes ownership of data, deleter frees it once the tensor is gone.
+    // Throws without a deleter, or on null data of a non empty shape,
+    // and data stays the caller's.
+    template <typename T>
+    Tensor(T* data,
+           std::vector<int>const& shape,
+           std::type_identity_t<std::function<void(T*)>> deleter,
+           bool requires_grad = true,
+           const std::string& dtype = "none",
+           const std::string& device_name = "cpu");
+
+    // Borrows data, no copy and no ownership. The memory has to stay
+    // valid and unchanged as long as the tensor, or anything computed
+    // from it, may read it.
+    template <typename T>
+    Tensor(std::span<T> data,
+           std::vector<int>const& shape,
+           bool requires_grad = true,
+           const std::string& dtype = "none",
+           const std::string& device_name = "cpu");
+
+    // Over storage holding bytes of dtype, e.g. part of a MappedFile
+    Tensor(Storage data,
+           std::vector<int>const& shape,
+           const std::string& dtype,
+           bool requires_grad = true,
+           const std::string& device_name = "cpu");
+
     Tensor(Tensor& other); // Copy constructor
+    // Takes over other's registry entry and memory, other is left
+    // empty, good for destruction and assignment only.
+    Tensor(Tensor&& other) noexcept;
+    // The tensor held so far goes away as if destroyed
+    Tensor& operator=(Tensor&& other);
 
     ~Tensor();
 
@@ -57,10 +136,7 @@ public:
     /* Equality */
     /* TODO: to be used for testing only right now. Equality checks on tensor
      * would be much more complicated than this. */
-    friend bool operator==(const Tensor& a, const Tensor& b) {
-        return a.context.data == b.context.data
-            && a.shape() == b.shape();
-    }
+    friend bool operator==(const Tensor& a, const Tensor& b);
 
     /* getters */
     const std::string& tuid() const { return context.tuid; }
@@ -70,33 +146,110 @@ public:
 
     /* Tensor ops */
     // boilerplates
+    inline Tensor kernel_boilerplate(
+            Tensor& a,
+            Tensor& b,
+            const std::vector<int>& shape,
+            Op op,
+            const std::vector<int>& params = {});
     inline Tensor unaryop_boilerplate(
             Tensor& a,
             const std::string& op_name);
     inline Tensor binop_boilerplate(
             Tensor& a,
             Tensor& b,
-            const std::string& op_name);
+            Op op);
 
     Tensor operator+(Tensor& other);
     Tensor operator-(Tensor& other);
     Tensor operator*(Tensor& other);
     Tensor operator/(Tensor& other);
     Tensor operator-() const;
-    Tensor operator[](int index) const;
-    Tensor operator[](std::vector<int> index) const;
-    Tensor matmul(std::vector<int> index) const;
+
+    /* Views */
+    // Share memory with this tensor, nothing is copied. Views of
+    // unrealized tensors are computed along with them. Kernels get
+    // views laid out densely, strided ones are copied then.
+    // Negative dims count from the end.
+    // Subtensor at index along the first dim, negative from the end
+    Tensor operator[](int index);
+    // Same, one index per leading dim
+    Tensor operator[](std::vector<int> index);
+    // Elements [start, end) of dim, every step-th
+    Tensor slice(int dim, int start, int end, int step = 1);
+    Tensor transpose(int dim0, int dim1);
+    // Dim i of the result is dim dims[i] of this tensor
+    Tensor permute(const std::vector<int>& dims);
+    // Same elements in another shape, one dim may be -1. A copy when
+    // the strides can't express it, e.g. merging transposed dims.
+    Tensor reshape(const std::vector<int>& shape);
+    // Size 1 dims repeated to shape, new dims prepended, by a stride of 0
+    Tensor expand(const std::vector<int>& shape);
+    // This tensor laid out densely, a copy only if it isn't
+    Tensor contiguous();
+    bool is_contiguous() const;
+    // Quantized weights (other.dtype().block > 1) are laid out a row
+    // per output, as in GGUF: (M, K) x (N, K) -> (M, N), in f32.
+    Tensor matmul(Tensor& other);
+    // Block quantized copy of a f32 tensor, dtype q8_0, q4_0 or q4_1.
+    // Realizes this tensor, rows are split into blocks of 32.
+    Tensor quantize(const std::string& dtype);
+    // Copy converted to dtype, between f32, f16 and bf16. Lazy like
+    // any op, rounds to nearest even.
+    Tensor astype(const std::string& dtype);
+
+    /* Reductions */
+    // Over axes, all of them when none are given. Reduced dims are
+    // dropped, or kept with size 1 with keepdims. Floats are summed
+    // pairwise, halves in f32.
+    Tensor sum(const std::vector<int>& axes = {}, bool keepdims = false);
+    Tensor sum(int axis, bool keepdims = false);
+    // Floats only
+    Tensor mean(const std::vector<int>& axes = {}, bool keepdims = false);
+    Tensor mean(int axis, bool keepdims = false);
+    Tensor max(const std::vector<int>& axes = {}, bool keepdims = false);
+    Tensor max(int axis, bool keepdims = false);
+    Tensor min(const std::vector<int>& axes = {}, bool keepdims = false);
+    Tensor min(int axis, bool keepdims = false);
+    // i64 index of the first maximum along axis, or in the flattened
+    // tensor without one
+    Tensor argmax(int axis, bool keepdims = false);
+    Tensor argmax();
+
+    /* Normalization */
+    // exp(x) / sum(exp(x)) along axis, in one kernel, shifted by the
+    // max so nothing overflows. Floats only, like the rest of them.
+    Tensor softmax(int axis = -1);
+    // x - log(sum(exp(x))) along axis, same way
+    Tensor log_softmax(int axis = -1);
+    // x / sqrt(mean(x^2) + eps) * weight over the last dim, weight of
+    // its size, statistics and scaling in one pass over each row
+    Tensor rms_norm(Tensor& weight, float eps = 1e-6f);
+    // (x - mean) / sqrt(var + eps) * weight + bias over the last dim,
+    // same way
+    Tensor layer_norm(Tensor& weight, Tensor& bias, float eps = 1e-5f);
 
     /* Tensor utils */
+    // Bytes currently held, 0 until an op result is computed
     long long int get_mem_size();
+    // Bytes the tensor's elements take
+    size_t nbytes() const;
     void to(const std::string& device_name);
-    // Realize the tensor.
-    // force = true makes the thread wait
-    // until the tensor is realized.
-    void realize(bool force = false);
+    // Realize the tensor along with everything it depends on,
+    // blocks until done.
+    void realize();
     void switch_device_to(const std::string& device_name);
 };
 
 } // namespace TensorLib
 
+#include <ir.hpp>
+#include <passes.hpp>
+#include <memory_planner.hpp>
+#include <mapped_file.hpp>
+#include <safetensors.hpp>
+#include <gguf.hpp>
+#include <quant.hpp>
+#include <executor.hpp>
 #include "tensor.tpp"
+#include "utils.tpp"
@@ -1,21 +1,70 @@
+#pragma once
+
 #include <tensor_device_wrapper.hpp>
+#include <kernels_cpu.hpp>
+#include <thread_pool.hpp>
 
 #include <map>
+#include <mutex>
+#include <future>
+
+#include <utils.hpp>
 
 class TensorCPUWrapper : public TensorDeviceWrapper {
 private:
+    // Host memory is the device memory on CPU, so instead of owning
+    // buffers the wrapper only remembers where each tensor lives.
+    typedef struct {
+        uint8_t* data;
+        size_t mem_size;
+    } membuf;
+    std::map<std::string, membuf> tensor_membuf_map;
+
+    std::map<std::string, tensorlib::cpu::kernel_fn> compute_functions;
+    // Kernels doing their setup in bind_kernel, once per node
+    std::map<std::string, tensorlib::cpu::kernel_binder> kernel_binders;
+
+    // Maps tensor uid to the kernel to be executed on realization.
+    // Mirrors the metal wrapper, with a future standing in for the
+    // command buffer. An invalid future means "not yet scheduled".
+    // Scheduled kernels run on the shared thread pool.
+    typedef struct {
+        std::vector<std::string> parent_tuids;
+        std::string rtuid;
+        std::string fn_name;
+        std::vector<int> params;
+        std::shared_future<void> done;
+    } kernel_info;
+    std::map<std::string, kernel_info> tensor_cmdbuf_map;
+
+    // Realization may be driven from several threads
+    std::mutex lock;
+
+    void run_kernel(const kernel_info& kinfo);
 
 public:
     TensorCPUWrapper();
     ~TensorCPUWrapper();
 
     void enqueue_kernel(
-            const std::vector<const std::string>& tuids,
+            const std::vector<std::string>& tuids,
             const std::string& rtuid,
-            const std::string& fn_name);
+            const std::string& fn_name,
+            const std::vector<int>& params = {});
     void assign(const std::string& tuid, void* data, size_t mem_size);
     void copy_to_host(const std::string& tuid, void* data, size_t mem_size);
     void wait_for(const std::string& tuid);
     void schedule_realize(const std::string& tuid);
     int get_cmdbuf_status(const std::string& tuid);
+    void release(const std::string& tuid);
+    // Kernel and buffers resolved here, running it takes no lookups.
+    // Kernels with a binder are set up for params here as well.
+    std::function<void()> bind_kernel(
+            const std::vector<std::string>& tuids,
+            const std::string& rtuid,
+            const std::string& fn_name,
+            const std::vector<int>& params = {});
 };
+
+// Appended for the same reason as tensor_metal.tpp
+#include "tensor_cpu.tpp"
@@ -2,17 +2,40 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <stdexcept>
 
 class TensorDeviceWrapper {
 public:
+    // parent tuids, result tuid, kernel name, kernel params
     virtual void enqueue_kernel(
-        const std::vector<const std::string>&,
+        const std::vector<std::string>&,
         const std::string&,
-        const std::string&) = 0;
+        const std::string&,
+        const std::vector<int>& = {}) = 0;
     virtual void assign(const std::string&, void*, size_t) = 0;
     virtual void copy_to_host(const std::string&, void*, size_t) = 0;
     virtual void wait_for(const std::string&) = 0;
     virtual void schedule_realize(const std::string&) = 0;
     virtual int get_cmdbuf_status(const std::string&) = 0;
+    // Forget a tensor nobody reads anymore, memory and kernel included
+    virtual void release(const std::string&) = 0;
+    // Kernel computing rtuid bound to the memory assigned so far, for
+    // graph execution: looked up once, then run on the calling thread
+    // until done. This default goes through the command buffer calls
+    // above, devices that can resolve kernels up front override it.
+    virtual std::function<void()> bind_kernel(
+            const std::vector<std::string>& tuids,
+            const std::string& rtuid,
+            const std::string& fn_name,
+            const std::vector<int>& params = {}) {
+        enqueue_kernel(tuids, rtuid, fn_name, params);
+        return [this, rtuid] {
+            schedule_realize(rtuid);
+            wait_for(rtuid);
+            if (get_cmdbuf_status(rtuid) != 0)
+                throw std::runtime_error("Kernel for " + rtuid + " failed");
+        };
+    }
     virtual ~TensorDeviceWrapper() = default;
 };
@@ -24,33 +24,32 @@ private:
 
     // Maps tensor uid to its command buffer, parent tensors and function
     // to be executed on realization.
-    // NOTE: Tracking parent tensors because metal doesn't support
-    // reusing command buffers. To recreate them, we need the parent ids,
-    // the function name, all that good info.
+    // NOTE: Metal doesn't support reusing command buffers, kernels are
+    // encoded when the graph is realized and dropped with the tensor.
     typedef struct {
-        std::vector<const std::string> parent_tuids;
+        std::vector<std::string> parent_tuids;
         const std::string rtuid;
         const std::string fn_name;
+        const std::vector<int> params;
         MTL::CommandBuffer* cmd_buf;
     } kernel_info;
     std::map<const std::string, kernel_info> tensor_cmdbuf_map;
 
-    std::vector<kernel_info> to_requeue;
-    void requeue();
-
 public:
     TensorMetalWrapper(MTL::Device* device = nullptr);
     ~TensorMetalWrapper();
 
     void enqueue_kernel(
-            const std::vector<const std::string>& tuids,
+            const std::vector<std::string>& tuids,
             const std::string& rtuid,
-            const std::string& fn_name);
+            const std::string& fn_name,
+            const std::vector<int>& params = {});
     void assign(const std::string& tuid, void* data, size_t mem_size);
     void copy_to_host(const std::string& tuid, void* data, size_t mem_size);
     void wait_for(const std::string& tuid);
     void schedule_realize(const std::string& tuid);
     int get_cmdbuf_status(const std::string& tuid);
+    void release(const std::string& tuid);
 };
 
 // TODO: Unable to separately compile
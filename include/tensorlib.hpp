@@ -1,10 +1,15 @@
 #pragma once
 
 #include <map>
+#include <unordered_map>
 #include <memory>
+#include <vector>
+#include <string>
 
 #include <device.hpp>
 #include <dtype.hpp>
+#include <ops.hpp>
+#include <storage.hpp>
 
 namespace tensorlib {
 
@@ -14,26 +19,36 @@ class Tensor;
 // Minimal context for tensor passing
 struct TensorPassingContext {
     // Just bytes
-    std::vector<uint8_t> data;
+    Storage data;
     DType dtype;
     std::string tuid;
     std::vector<int> shape;
+    // In elements. Views may have any, other tensors are row major.
     std::vector<int> strides;
     std::vector<std::string> parents;
+    // How the tensor is computed from its parents
+    Op op = Op::Load;
+    std::vector<int> params;
+    // Unrealized tensors listing this one as a parent
+    int consumers = 0;
     Device* device;
 };
 
 // Device interfaces
 //
 // Exact interfaces are defined in device.hpp
-// Initialized on first use.
-std::unordered_map<std::string, Device*> device_interfaces;
+// Initialized on first use. Declared ahead of the tensor map, so
+// tensors still in it at exit release into live devices.
+std::unordered_map<std::string, std::unique_ptr<Device>> device_interfaces;
 
 // Keep track of all tensors created, and useful for unique id generation
 long long int global_tensor_count = 0;
 
 // Helpful for ownership management.
 // For passing tensors around, we use strings
+// Entries usually point at user owned tensors. A tensor destroyed
+// while unrealized tensors still depend on it is kept alive here,
+// owned by the map, until the last of them is realized.
 std::map<std::string, std::unique_ptr<Tensor>> global_tensor_map;
 
 } // namespace tensorlib
@@ -0,0 +1,79 @@
+/* Process wide worker pool.
+ *
+ * Shared by the CPU kernels and graph execution, so the threads are
+ * created once instead of on every realization. Sized at runtime from
+ * the hardware, TENSORLIB_NTHREADS overrides it.
+ */
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace tensorlib {
+
+class ThreadPool {
+    typedef std::function<void()> task;
+
+    // One work stealing deque per worker. Tasks submitted from a worker
+    // go to the back of its own deque and it pops from the back, so
+    // freshly unlocked work runs while its inputs are still in cache.
+    // Idle workers steal the oldest tasks from the front of the others.
+    struct worker_queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+
+    // Round robin target for tasks submitted from outside the pool
+    std::atomic<size_t> next_queue{0};
+    // Tasks sitting in queues, lets idle workers skip the scan
+    std::atomic<size_t> pending{0};
+
+    // Sleeping, after spinning for a while
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<int> sleeping{0};
+    std::atomic<bool> stopping{false};
+
+    bool pop(size_t start, task& t);
+    void worker_loop(size_t index);
+
+    ThreadPool(size_t nthreads);
+public:
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // The pool everyone shares
+    static ThreadPool& global();
+
+    // Number of workers, the calling thread not included
+    size_t size() const { return workers.size(); }
+
+    void submit(task t);
+
+    // Run one queued task on the calling thread, if there is one.
+    // Lets threads waiting on pool work help instead of blocking,
+    // which also keeps nested waits from deadlocking.
+    bool run_pending();
+
+    // Help out until done() returns true
+    void wait_until(const std::function<bool()>& done);
+
+    // Run fn over [0, n) in chunks of at least grain elements,
+    // fn(begin, end). Blocks until every chunk ran, the calling
+    // thread takes chunks as well.
+    void parallel_for(size_t n, size_t grain,
+                      const std::function<void(size_t, size_t)>& fn);
+};
+
+} // namespace tensorlib
+
+#include "thread_pool.tpp"
@@ -14,11 +14,6 @@
     #define VOUT 0 && std::cout
 #endif
 
-// CPU parallelization
-#ifndef NTHREADS
-    #define NTHREADS 1
-#endif
-
 #include <iostream>
 #include <map>
 
@@ -26,13 +21,12 @@ namespace tensorlib {
     class Tensor;
 }
 
+// Elements of dims shape_idx on, from offset elements into the storage
 void __print_util(std::ostream& os,
         const tensorlib::Tensor& tensor,
         int shape_idx,
-        int offset,
-        int par_size);
+        size_t offset);
 
 std::ostream& operator<<(std::ostream& os, tensorlib::Tensor& tensor);
 
-// Template file
-/* #include <utils.tpp> */
+// Defined in utils.tpp, included by tensor.hpp once Tensor is complete
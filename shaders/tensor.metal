@@ -76,57 +76,115 @@ kernel void sub_v_i64 (device const long* inA,
     result[index] = inA[index] - inB[index];
 }
 
+// Integer division as on the CPU: x / 0 is 0 and the minimum over -1
+// wraps around to itself, negated in unsigned U
+template <typename T, typename U>
+T divide(T a, T b)
+{
+    if (b == 0) return 0;
+    if (b == -1) return T(U(0) - U(a));
+    return a / b;
+}
+
+// Parallel vector divisions
+kernel void div_v_f32 (device const float* inA,
+                       device const float* inB,
+                       device float* result,
+                       uint index [[thread_position_in_grid]])
+{
+    result[index] = inA[index] / inB[index];
+}
+
+kernel void div_v_i32 (device const int* inA,
+                       device const int* inB,
+                       device int* result,
+                       uint index [[thread_position_in_grid]])
+{
+    result[index] = divide<int, uint>(inA[index], inB[index]);
+}
+
+kernel void div_v_i64 (device const long* inA,
+                       device const long* inB,
+                       device long* result,
+                       uint index [[thread_position_in_grid]])
+{
+    result[index] = divide<long, ulong>(inA[index], inB[index]);
+}
+
+// Parallel vector copies
+kernel void copy_v_f32 (device const float* inA,
+                        device float* result,
+                        uint index [[thread_position_in_grid]])
+{
+    result[index] = inA[index];
+}
+
+kernel void copy_v_i32 (device const int* inA,
+                        device int* result,
+                        uint index [[thread_position_in_grid]])
+{
+    result[index] = inA[index];
+}
+
+kernel void copy_v_i64 (device const long* inA,
+                        device long* result,
+                        uint index [[thread_position_in_grid]])
+{
+    result[index] = inA[index];
+}
+
 // Matrix multiplication
+// dims - {M, K, N}, one thread per element of the M x N result
 kernel void mul_m_f32 (device const float* inA,
                        device const float* inB,
                        device float* result,
-                       uint2 index [[thread_position_in_grid]],
-                       uint2 size [[threads_per_grid]])
+                       constant int* dims [[buffer(3)]],
+                       uint2 index [[thread_position_in_grid]])
 {
-    uint row = index.x;
-    uint col = index.y;
-    uint width = size.x;
-    uint height = size.y;
+    uint row = index.y;
+    uint col = index.x;
+    int K = dims[1];
+    int N = dims[2];
 
     float sum = 0.0f;
-    for (uint i = 0; i < width; i++) {
-        sum += inA[row * width + i] * inB[i * height + col];
+    for (int i = 0; i < K; i++) {
+        sum += inA[row * K + i] * inB[i * N + col];
     }
-    result[row * height + col] = sum;
+    result[row * N + col] = sum;
 }
 
 kernel void mul_m_i32 (device const int* inA,
                        device const int* inB,
                        device int* result,
-                       uint2 index [[thread_position_in_grid]],
-                       uint2 size [[threads_per_grid]])
+                       constant int* dims [[buffer(3)]],
+                       uint2 index [[thread_position_in_grid]])
 {
-    uint row = index.x;
-    uint col = index.y;
-    uint width = size.x;
-    uint height = size.y;
+    uint row = index.y;
+    uint col = index.x;
+    int K = dims[1];
+    int N = dims[2];
 
     int sum = 0;
-    for (uint i = 0; i < width; i++) {
-        sum += inA[row * width + i] * inB[i * height + col];
+    for (int i = 0; i < K; i++) {
+        sum += inA[row * K + i] * inB[i * N + col];
     }
-    result[row * height + col] = sum;
+    result[row * N + col] = sum;
 }
 
 kernel void mul_m_i64 (device const long* inA,
                        device const long* inB,
                        device long* result,
-                       uint2 index [[thread_position_in_grid]],
-                       uint2 size [[threads_per_grid]])
+                       constant int* dims [[buffer(3)]],
+                       uint2 index [[thread_position_in_grid]])
 {
-    uint row = index.x;
-    uint col = index.y;
-    uint width = size.x;
-    uint height = size.y;
+    uint row = index.y;
+    uint col = index.x;
+    int K = dims[1];
+    int N = dims[2];
 
     long sum = 0;
-    for (uint i = 0; i < width; i++) {
-        sum += inA[row * width + i] * inB[i * height + col];
+    for (int i = 0; i < K; i++) {
+        sum += inA[row * K + i] * inB[i * N + col];
     }
-    result[row * height + col] = sum;
+    result[row * N + col] = sum;
 }
@@ -0,0 +1,219 @@
+#include <bit>
+#include <cstdlib>
+#include <new>
+
+#include <utils.hpp>
+
+namespace tensorlib {
+
+// Blocks a thread freed for an allocator, reused by that thread first
+struct ThreadCache {
+    std::shared_ptr<CachingAllocator::Shared> shared;
+    std::vector<void*> free[CachingAllocator::nclasses];
+    size_t bytes = 0;
+};
+
+// Every allocator the thread used, flushed into the shared caches when
+// the thread exits
+struct ThreadCaches {
+    std::vector<ThreadCache> caches;
+    ~ThreadCaches();
+};
+
+// Set once this thread's caches are gone. Tensors freed later, during
+// static destruction, go straight to the shared cache.
+inline thread_local bool thread_caches_gone = false;
+
+inline ThreadCache* thread_cache(const std::shared_ptr<CachingAllocator::Shared>& shared) {
+    if (thread_caches_gone) return nullptr;
+    thread_local ThreadCaches all;
+    for (auto& cache : all.caches)
+        if (cache.shared == shared) return &cache;
+    all.caches.emplace_back();
+    all.caches.back().shared = shared;
+    return &all.caches.back();
+}
+
+inline ThreadCaches::~ThreadCaches() {
+    for (auto& cache : caches) {
+        auto& shared = *cache.shared;
+        std::lock_guard<std::mutex> guard(shared.lock);
+        for (size_t c = 0; c < CachingAllocator::nclasses; ++c)
+            for (void* ptr : cache.free[c])
+                shared.free[c].push_back(ptr);
+    }
+    thread_caches_gone = true;
+}
+
+inline CachingAllocator::Shared::~Shared() {
+    for (auto& blocks : free)
+        for (void* ptr : blocks)
+            std::free(ptr);
+}
+
+inline CachingAllocator::CachingAllocator(size_t limit)
+    :   shared(std::make_shared<Shared>()) {
+    shared->limit = limit;
+}
+
+inline CachingAllocator::CachingAllocator()
+    :   CachingAllocator([] {
+            size_t mb = 1024;
+            if (const char* env = std::getenv("TENSORLIB_ALLOC_CACHE_MB"))
+                mb = std::strtoull(env, nullptr, 10);
+            return mb << 20;
+        }()) {}
+
+inline CachingAllocator::~CachingAllocator() {
+    trim();
+}
+
+inline size_t CachingAllocator::size_class(size_t bytes) {
+    // Multiples of 64 up to 256, then four classes per power of two,
+    // never more than a fifth of a block wasted
+    if (bytes <= 256) return bytes ? (bytes - 1) / 64 : 0;
+    size_t octave = std::bit_width(bytes - 1) - 1;
+    size_t sub = ((bytes - 1) >> (octave - 2)) & 3;
+    return 4 + (octave - 8) * 4 + sub;
+}
+
+inline size_t CachingAllocator::class_bytes(size_t index) {
+    if (index < 4) return (index + 1) * 64;
+    size_t octave = 8 + (index - 4) / 4;
+    size_t sub = (index - 4) % 4;
+    return (size_t(1) << octave) + ((sub + 1) << (octave - 2));
+}
+
+inline AllocatorStats CachingAllocator::stats() const {
+    AllocatorStats s;
+    s.hits = shared->hits.load(std::memory_order_relaxed);
+    s.misses = shared->misses.load(std::memory_order_relaxed);
+    s.bytes_held = shared->held.load(std::memory_order_relaxed);
+    s.bytes_in_use = shared->in_use.load(std::memory_order_relaxed);
+    return s;
+}
+
+inline void CachingAllocator::trim() {
+    auto release = [&](std::vector<void*>* free) {
+        for (size_t c = 0; c < nclasses; ++c) {
+            for (void* ptr : free[c]) std::free(ptr);
+            shared->held -= free[c].size() * class_bytes(c);
+            free[c].clear();
+        }
+    };
+    if (ThreadCache* cache = thread_cache(shared)) {
+        release(cache->free);
+        cache->bytes = 0;
+    }
+    std::lock_guard<std::mutex> guard(shared->lock);
+    release(shared->free);
+}
+
+inline void* CachingAllocator::do_allocate(size_t bytes, size_t align) {
+    if (align > alignment)
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    if (bytes > max_cached) {
+        size_t size = (bytes + alignment - 1) / alignment * alignment;
+        void* ptr = std::aligned_alloc(alignment, size);
+        if (!ptr) throw std::bad_alloc();
+        shared->misses++;
+        shared->in_use += size;
+        return ptr;
+    }
+    size_t c = size_class(bytes);
+    size_t size = class_bytes(c);
+    auto hit = [&](void* ptr) {
+        shared->hits++;
+        shared->held -= size;
+        shared->in_use += size;
+        return ptr;
+    };
+    if (size <= thread_max_block) {
+        ThreadCache* cache = thread_cache(shared);
+        if (cache && !cache->free[c].empty()) {
+            void* ptr = cache->free[c].back();
+            cache->free[c].pop_back();
+            cache->bytes -= size;
+            return hit(ptr);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> guard(shared->lock);
+        if (!shared->free[c].empty()) {
+            void* ptr = shared->free[c].back();
+            shared->free[c].pop_back();
+            return hit(ptr);
+        }
+    }
+    void* ptr = std::aligned_alloc(alignment, size);
+    if (!ptr) {
+        // What is cached may be just what the system is missing
+        trim();
+        ptr = std::aligned_alloc(alignment, size);
+        if (!ptr) throw std::bad_alloc();
+    }
+    shared->misses++;
+    shared->in_use += size;
+    return ptr;
+}
+
+inline void CachingAllocator::do_deallocate(void* ptr, size_t bytes, size_t align) {
+    if (align > alignment) {
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, align);
+        return;
+    }
+    if (bytes > max_cached) {
+        shared->in_use -= (bytes + alignment - 1) / alignment * alignment;
+        std::free(ptr);
+        return;
+    }
+    size_t c = size_class(bytes);
+    size_t size = class_bytes(c);
+    shared->in_use -= size;
+    // Over the limit, the block goes back to the system. Threads check
+    // it side by side, it may be overshot by a few blocks.
+    if (shared->held + size > shared->limit) {
+        std::free(ptr);
+        return;
+    }
+    if (size <= thread_max_block) {
+        ThreadCache* cache = thread_cache(shared);
+        if (cache && cache->bytes + size <= thread_max_bytes) {
+            cache->free[c].push_back(ptr);
+            cache->bytes += size;
+            shared->held += size;
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> guard(shared->lock);
+    shared->free[c].push_back(ptr);
+    shared->held += size;
+}
+
+inline bool CachingAllocator::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+inline std::atomic<std::pmr::memory_resource*>& selected_storage_allocator() {
+    static std::atomic<std::pmr::memory_resource*> selected{nullptr};
+    return selected;
+}
+
+inline CachingAllocator& default_storage_allocator() {
+    // Never destroyed, tensors outliving main still free into it
+    static CachingAllocator* allocator = new CachingAllocator();
+    return *allocator;
+}
+
+inline std::pmr::memory_resource* storage_allocator() {
+    std::pmr::memory_resource* r = selected_storage_allocator().load();
+    return r ? r : &default_storage_allocator();
+}
+
+inline void set_storage_allocator(std::pmr::memory_resource* r) {
+    selected_storage_allocator() = r;
+    VOUT << "Storage allocator set to "
+         << (r ? "a custom one" : "the default") << std::endl;
+}
+
+} // namespace tensorlib
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include <half.hpp>
+#include <thread_pool.hpp>
+
+#ifdef TENSORLIB_X86
+    #include <immintrin.h>
+#endif
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *  Half precision
+ * ---------------------- */
+//
+// f16 and bf16 tensors are stored in 16 bits and computed on in f32:
+// kernels widen what they read a tile at a time, accumulate in f32,
+// and narrow only what they write. Memory traffic is halved, results
+// are those of f32 rounded once at the end.
+
+// n elements of S converted to D
+template <typename S, typename D>
+using convert_fn = void (*)(const S* src, D* dst, size_t n);
+
+template <typename S, typename D>
+void convert_generic(const S* src, D* dst, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if constexpr (std::is_same_v<D, float>)
+            dst[i] = float(src[i]);
+        else
+            dst[i] = D(float(src[i]));
+    }
+}
+
+#ifdef TENSORLIB_X86
+#define TL_TARGET_CVT_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define TL_TARGET_CVT_AVX512 __attribute__((target("avx512f,avx512dq,fma,f16c")))
+#define TL_TARGET_CVT_BF16 __attribute__((target("avx512f,avx512dq,avx512bf16,fma,f16c")))
+
+// bf16 is the top half of a float, widening is a shift
+TL_TARGET_CVT_AVX2 void widen_bf16_avx2(const bfloat16* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256i x = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(x));
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+// Rounds to nearest even like fp32_to_bf16, quieting NaNs
+TL_TARGET_CVT_AVX2 void narrow_bf16_avx2(const float* src, bfloat16* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(src + i);
+        __m256i x = _mm256_castps_si256(v);
+        __m256i top = _mm256_srli_epi32(x, 16);
+        __m256i odd = _mm256_and_si256(top, _mm256_set1_epi32(1));
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(x,
+                _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff))), 16);
+        __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        r = _mm256_blendv_epi8(r, _mm256_or_si256(top, _mm256_set1_epi32(0x40)), nan);
+        __m128i h = _mm_packus_epi32(_mm256_castsi256_si128(r),
+                                     _mm256_extracti128_si256(r, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+TL_TARGET_CVT_AVX2 void widen_f16_avx2(const float16* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+TL_TARGET_CVT_AVX2 void narrow_f16_avx2(const float* src, float16* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+// GCC 12 takes the undefined vectors its own AVX-512 intrinsics start
+// from for uninitialized ones (GCC bug 105593)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TL_TARGET_CVT_AVX512 void widen_bf16_avx512(const bfloat16* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m512i x = _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16);
+        _mm512_storeu_ps(dst + i, _mm512_castsi512_ps(x));
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+TL_TARGET_CVT_AVX512 void widen_f16_avx512(const float16* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+TL_TARGET_CVT_AVX512 void narrow_f16_avx512(const float* src, float16* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+// vcvtneps2bf16 rounds to nearest even too, but flushes subnormals
+// to zero, the one place it differs from fp32_to_bf16. Blocks holding
+// any are converted one by one instead, so every ISA gives the same
+// bits.
+TL_TARGET_CVT_BF16 void narrow_bf16_avx512(const float* src, bfloat16* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_loadu_ps(src + i);
+        __m512i x = _mm512_castps_si512(v);
+        __mmask16 subnormal = _mm512_testn_epi32_mask(x, _mm512_set1_epi32(0x7f800000))
+                            & _mm512_test_epi32_mask(x, _mm512_set1_epi32(0x007fffff));
+        if (subnormal) {
+            convert_generic(src + i, dst + i, 16);
+            continue;
+        }
+        __m256bh h = _mm512_cvtneps_pbh(v);
+        std::memcpy(dst + i, &h, sizeof(h));
+    }
+    convert_generic(src + i, dst + i, n - i);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+// Conversions to and from f32, the widest one the host has
+template <typename S, typename D>
+convert_fn<S, D> convert_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    __builtin_cpu_init();
+    bool f16c = __builtin_cpu_supports("f16c");
+    if (isa == ISA::AVX512 && f16c) {
+        if constexpr (std::is_same_v<S, float16>) return widen_f16_avx512;
+        if constexpr (std::is_same_v<D, float16>) return narrow_f16_avx512;
+        if constexpr (std::is_same_v<S, bfloat16>) return widen_bf16_avx512;
+        if constexpr (std::is_same_v<D, bfloat16>) {
+            if (__builtin_cpu_supports("avx512bf16")) return narrow_bf16_avx512;
+            return narrow_bf16_avx2;
+        }
+    }
+    if (isa >= ISA::AVX2 && f16c) {
+        if constexpr (std::is_same_v<S, float16>) return widen_f16_avx2;
+        if constexpr (std::is_same_v<D, float16>) return narrow_f16_avx2;
+        if constexpr (std::is_same_v<S, bfloat16>) return widen_bf16_avx2;
+        if constexpr (std::is_same_v<D, bfloat16>) return narrow_bf16_avx2;
+    }
+#endif
+    return convert_generic<S, D>;
+}
+
+// dtype conversions, the "cast_v_" kernels, cast_v_f16_f32 from f16
+// to f32. Between two half types they go through f32, a tile at a time.
+template <typename S, typename D>
+kernel_fn cast_v(ISA isa) {
+    convert_fn<S, float> widen = nullptr;
+    convert_fn<float, D> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, float>) widen = convert_for<S, float>(isa);
+    if constexpr (!std::is_same_v<D, float>) narrow = convert_for<float, D>(isa);
+    return [widen, narrow](const std::vector<const uint8_t*>& inputs,
+                           uint8_t* result,
+                           size_t mem_size,
+                           const std::vector<int>&) {
+        const S* a = reinterpret_cast<const S*>(inputs[0]);
+        D* r = reinterpret_cast<D*>(result);
+        ThreadPool::global().parallel_for(mem_size / sizeof(D), 1 << 15,
+                [&](size_t begin, size_t end) {
+            if constexpr (std::is_same_v<S, float>) {
+                narrow(a + begin, r + begin, end - begin);
+            } else if constexpr (std::is_same_v<D, float>) {
+                widen(a + begin, r + begin, end - begin);
+            } else {
+                constexpr size_t tile = 1024;
+                float wide[tile];
+                for (size_t t = begin; t < end; t += tile) {
+                    size_t len = std::min(tile, end - t);
+                    widen(a + t, wide, len);
+                    narrow(wide, r + t, len);
+                }
+            }
+        });
+    };
+}
+
+} // namespace tensorlib::cpu
@@ -6,7 +6,7 @@ tensorlib::Device::Device(const std::string& name) : _name(name) {
 
 void tensorlib::Device::set_interface(const std::string& device) {
     if (device == "cpu") {
-        /* device_interface = new TensorCPUWrapper(); */
+        device_interface.reset(new TensorCPUWrapper());
     } else if (device == "gpu") {
         auto gpu_wrapper = std::unique_ptr<TensorDeviceWrapper>();
 #ifdef RUN_METAL
@@ -0,0 +1,123 @@
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace tensorlib {
+
+std::vector<std::function<void()>> bind_kernels(const Graph& graph) {
+    std::vector<std::function<void()>> kernels(graph.size());
+    std::vector<std::string> parents;
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        Op op = graph.nodes[i].op;
+        // Views alias their input's memory, nothing to compute
+        if (op == Op::Load || op == Op::View) continue;
+        Tensor& t = *graph.tensors[i];
+        parents.clear();
+        for (uint32_t in : graph.inputs_of(i))
+            parents.push_back(graph.tensors[in]->tuid());
+        auto params = graph.params_of(i);
+        // Matrix kernels go by their right operand, weights may be quantized
+        const DType& dtype = graph.dtype_of(op == Op::MatMul ? graph.inputs_of(i)[1] : i);
+        bool by_input = op == Op::Cast || is_reduction(op);
+        const DType& from = graph.dtype_of(by_input ? graph.inputs_of(i)[0] : i);
+        kernels[i] = t.context.device->get()->bind_kernel(parents, t.tuid(),
+                kernel_name(op, dtype, from), std::vector<int>(params.begin(), params.end()));
+    }
+    return kernels;
+}
+
+void run_node(const Graph& graph, uint32_t i, const std::function<void()>& kernel) {
+    if (kernel) {
+        kernel();
+        kernel_dispatch_count++;
+    }
+    graph.tensors[i]->realized = true;
+}
+
+void execute(const Graph& graph) {
+    struct state {
+        std::unique_ptr<std::atomic<uint32_t>[]> pending;
+        std::atomic<size_t> remaining{0};
+        std::atomic<bool> failed{false};
+        std::string error;
+        std::mutex error_lock;
+    } s;
+    std::vector<std::function<void()>> kernels;
+    try {
+        kernels = bind_kernels(graph);
+    } catch (std::exception& e) {
+        throw std::runtime_error("Realizing "
+                + graph.tensors[graph.root]->tuid() + " failed: " + e.what());
+    }
+    GraphUsers users = graph_users(graph);
+    s.pending.reset(new std::atomic<uint32_t>[graph.size()]);
+    // Nodes each node unlocks besides its users
+    std::vector<std::vector<uint32_t>> unlocks(graph.waits.empty() ? 0 : graph.size());
+    for (auto [node, after] : graph.waits)
+        unlocks[after].push_back(node);
+
+    // Loads are there already, only count the inputs still to compute
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        uint32_t count = 0;
+        if (graph.nodes[i].op != Op::Load)
+            for (uint32_t in : graph.inputs_of(i))
+                if (graph.nodes[in].op != Op::Load) ++count;
+        s.pending[i] = count;
+    }
+    for (auto [node, after] : graph.waits)
+        s.pending[node]++;
+    // Picked before submitting any, a submitted node may already
+    // have released its users by the time we look again.
+    std::vector<uint32_t> sources;
+    size_t work = 0;
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        if (graph.nodes[i].op == Op::Load) continue;
+        if (s.pending[i] == 0) sources.push_back(i);
+        ++work;
+    }
+    if (work == 0) return;
+    s.remaining = work;
+
+    auto& pool = ThreadPool::global();
+    std::function<void(uint32_t)> run = [&](uint32_t i) {
+        // The first user unlocked runs right here, it reads what was
+        // just written and chains don't pile up tasks (or stack frames
+        // when the pool runs them inline).
+        constexpr uint32_t none = ~uint32_t(0);
+        while (i != none) {
+            // Once something failed, only count down so the waiter wakes up
+            if (!s.failed) {
+                try {
+                    run_node(graph, i, kernels[i]);
+                } catch (std::exception& e) {
+                    std::lock_guard<std::mutex> guard(s.error_lock);
+                    s.error = e.what();
+                    s.failed = true;
+                }
+            }
+            uint32_t next = none;
+            auto unlock = [&](uint32_t user) {
+                if (s.pending[user].fetch_sub(1) != 1) return;
+                if (next == none) next = user;
+                else pool.submit([&run, user] { run(user); });
+            };
+            for (uint32_t user : users.of(i)) unlock(user);
+            if (!unlocks.empty())
+                for (uint32_t node : unlocks[i]) unlock(node);
+            s.remaining.fetch_sub(1);
+            i = next;
+        }
+    };
+    for (uint32_t i : sources)
+        pool.submit([&run, i] { run(i); });
+    // Everything above lives on this stack, wait for every last task
+    pool.wait_until([&s] { return s.remaining.load() == 0; });
+    if (s.failed)
+        throw std::runtime_error("Realizing "
+                + graph.tensors[graph.root]->tuid() + " failed: " + s.error);
+}
+
+} // namespace tensorlib
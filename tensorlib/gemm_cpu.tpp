@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include <thread_pool.hpp>
+
+#ifdef TENSORLIB_X86
+    #include <immintrin.h>
+#endif
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *   Matrix multiplication
+ * ---------------------- */
+//
+// C[M, N] = A[M, K] * B[K, N], all row major.
+//
+// Goto style: B is packed into KC x NC blocks of NR wide column panels
+// (sized for L2/L3), A into MC x KC blocks of MR tall row panels
+// (sized for L2), and the micro kernel keeps an MR x NR tile of C in
+// registers while streaming both panels from L1.
+
+template <typename T, size_t width>
+struct gemm_blocking {
+    static constexpr int lanes = width / sizeof(T);
+    // Two vectors per row of the C tile. MR rows of accumulators plus
+    // the B vectors and the broadcast A value have to fit the register
+    // file: 16 vector registers below AVX-512, 32 with it.
+    static constexpr int MR = width == 64 ? 12 : 6;
+    static constexpr int NR = 2 * lanes;
+    static constexpr int KC = 256;
+    static constexpr int MC = MR * (width == 64 ? 8 : 16);
+    static constexpr int NC = NR * 128;
+};
+
+// Copy an mc x kc block of A into MR tall panels, k major within a
+// panel. Rows past the edge are zero padded.
+template <typename T, int MR>
+void pack_a(const T* A, int lda, int mc, int kc, T* packed) {
+    for (int i0 = 0; i0 < mc; i0 += MR) {
+        int rows = std::min(MR, mc - i0);
+        for (int k = 0; k < kc; ++k) {
+            for (int i = 0; i < rows; ++i)
+                packed[i] = A[(i0 + i) * lda + k];
+            for (int i = rows; i < MR; ++i)
+                packed[i] = T(0);
+            packed += MR;
+        }
+    }
+}
+
+// Copy a kc x nc block of B into NR wide panels, k major within a
+// panel. Columns past the edge are zero padded.
+template <typename T, int NR>
+void pack_b(const T* B, int ldb, int kc, int nc, T* packed) {
+    for (int j0 = 0; j0 < nc; j0 += NR) {
+        int cols = std::min(NR, nc - j0);
+        for (int k = 0; k < kc; ++k) {
+            const T* row = B + k * ldb + j0;
+            for (int j = 0; j < cols; ++j)
+                packed[j] = row[j];
+            for (int j = cols; j < NR; ++j)
+                packed[j] = T(0);
+            packed += NR;
+        }
+    }
+}
+
+// Add an MR x NR register tile into C.
+// Only the top left m x n of the tile is written back.
+template <typename T, size_t width, int MR, typename V>
+TL_INLINE void gemm_store_tile(V (&acc)[MR][2], T* C, int ldc, int m, int n) {
+    constexpr int lanes = width / sizeof(T);
+    if (m == MR && n == 2 * lanes) {
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; ++i) {
+            V c0, c1;
+            std::memcpy(&c0, C + i * ldc, width);
+            std::memcpy(&c1, C + i * ldc + lanes, width);
+            c0 += acc[i][0];
+            c1 += acc[i][1];
+            std::memcpy(C + i * ldc, &c0, width);
+            std::memcpy(C + i * ldc + lanes, &c1, width);
+        }
+    } else {
+        // Edge tile, spill and copy what's in bounds.
+        // Spilled row by row, so the accumulators can stay in registers.
+        T tile[MR][2 * lanes];
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; ++i) {
+            std::memcpy(&tile[i][0], &acc[i][0], width);
+            std::memcpy(&tile[i][lanes], &acc[i][1], width);
+        }
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < n; ++j)
+                C[i * ldc + j] += tile[i][j];
+    }
+}
+
+// C tile += packed A panel * packed B panel.
+template <typename T, size_t width, int MR>
+TL_INLINE void gemm_micro_kernel(int kc, const T* a, const T* b,
+                                 T* C, int ldc, int m, int n) {
+    typedef T vec __attribute__((vector_size(width)));
+    constexpr int lanes = width / sizeof(T);
+    vec acc[MR][2];
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; ++i) {
+        acc[i][0] = vec{};
+        acc[i][1] = vec{};
+    }
+    for (int k = 0; k < kc; ++k) {
+        vec b0, b1;
+        std::memcpy(&b0, b, width);
+        std::memcpy(&b1, b + lanes, width);
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; ++i) {
+            acc[i][0] += a[i] * b0;
+            acc[i][1] += a[i] * b1;
+        }
+        a += MR;
+        b += 2 * lanes;
+    }
+    gemm_store_tile<T, width, MR>(acc, C, ldc, m, n);
+}
+
+#ifdef TENSORLIB_X86
+// GCC only contracts a multiply and add into an fma from -O2 on,
+// so the float micro kernels spell the fused instructions out.
+template <int MR>
+TL_TARGET_AVX2 void gemm_micro_kernel_f32_avx2(int kc, const float* a, const float* b,
+                                               float* C, int ldc, int m, int n) {
+    __m256 acc[MR][2];
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; ++i) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+    for (int k = 0; k < kc; ++k) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; ++i) {
+            __m256 ai = _mm256_set1_ps(a[i]);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += MR;
+        b += 16;
+    }
+    gemm_store_tile<float, 32, MR>(acc, C, ldc, m, n);
+}
+
+template <int MR>
+TL_TARGET_AVX512 void gemm_micro_kernel_f32_avx512(int kc, const float* a, const float* b,
+                                                   float* C, int ldc, int m, int n) {
+    __m512 acc[MR][2];
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; ++i) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+    for (int k = 0; k < kc; ++k) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+#pragma GCC unroll 16
+        for (int i = 0; i < MR; ++i) {
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += MR;
+        b += 32;
+    }
+    gemm_store_tile<float, 64, MR>(acc, C, ldc, m, n);
+}
+#endif
+
+// One unit of parallel work: C[mc x nc] += A[mc x kc] * packed B,
+// restricted to the B panels in [panel_begin, panel_end).
+// A is packed here, into the caller's per thread buffer.
+template <typename T, size_t width>
+TL_INLINE void gemm_block(const T* A, int lda, const T* packed_b,
+                          T* C, int ldc, int mc, int kc, int nc,
+                          int panel_begin, int panel_end, T* packed_a) {
+    typedef gemm_blocking<T, width> blk;
+    constexpr int MR = blk::MR, NR = blk::NR;
+    pack_a<T, MR>(A, lda, mc, kc, packed_a);
+    for (int jr = panel_begin * NR; jr < nc && jr < panel_end * NR; jr += NR) {
+        for (int ir = 0; ir < mc; ir += MR) {
+            const T* a = packed_a + ir * kc;
+            const T* b = packed_b + jr * kc;
+            T* c = C + (size_t)ir * ldc + jr;
+            int m = std::min(MR, mc - ir), n = std::min(NR, nc - jr);
+#ifdef TENSORLIB_X86
+            if constexpr (std::is_same_v<T, float> && width == 64) {
+                gemm_micro_kernel_f32_avx512<MR>(kc, a, b, c, ldc, m, n);
+                continue;
+            } else if constexpr (std::is_same_v<T, float> && width == 32) {
+                gemm_micro_kernel_f32_avx2<MR>(kc, a, b, c, ldc, m, n);
+                continue;
+            }
+#endif
+            gemm_micro_kernel<T, width, MR>(kc, a, b, c, ldc, m, n);
+        }
+    }
+}
+
+template <typename T>
+using gemm_block_fn = void (*)(const T*, int, const T*, T*, int,
+                               int, int, int, int, int, T*);
+
+template <typename T>
+void gemm_block_generic(const T* A, int lda, const T* packed_b, T* C, int ldc,
+                        int mc, int kc, int nc, int pb, int pe, T* packed_a) {
+    gemm_block<T, 16>(A, lda, packed_b, C, ldc, mc, kc, nc, pb, pe, packed_a);
+}
+
+#ifdef TENSORLIB_X86
+template <typename T>
+TL_TARGET_AVX2 void gemm_block_avx2(const T* A, int lda, const T* packed_b, T* C, int ldc,
+                                    int mc, int kc, int nc, int pb, int pe, T* packed_a) {
+    gemm_block<T, 32>(A, lda, packed_b, C, ldc, mc, kc, nc, pb, pe, packed_a);
+}
+
+template <typename T>
+TL_TARGET_AVX512 void gemm_block_avx512(const T* A, int lda, const T* packed_b, T* C, int ldc,
+                                        int mc, int kc, int nc, int pb, int pe, T* packed_a) {
+    gemm_block<T, 64>(A, lda, packed_b, C, ldc, mc, kc, nc, pb, pe, packed_a);
+}
+#endif
+
+// Loops over the cache blocks and hands (A block, B panels) pairs to
+// the pool. The blocks of one KC step write disjoint parts of C, the
+// KC steps themselves run one after the other.
+// Halves (S) are widened to T along with packing, block by block.
+template <typename T, size_t width, typename S = T>
+void gemm_driver(gemm_block_fn<T> block,
+                 const S* A, const S* B, T* C, int M, int K, int N,
+                 convert_fn<S, T> widen = nullptr) {
+    typedef gemm_blocking<T, width> blk;
+    constexpr int NR = blk::NR;
+    constexpr int KC = blk::KC, MC = blk::MC, NC = blk::NC;
+    auto& pool = ThreadPool::global();
+
+    pool.parallel_for(M, 64, [&](size_t begin, size_t end) {
+        std::fill(C + begin * N, C + end * N, T(0));
+    });
+    if (K == 0) return;
+
+    std::unique_ptr<T[]> packed_b(new T[(size_t)KC * NC]);
+    int m_blocks = (M + MC - 1) / MC;
+
+    for (int jc = 0; jc < N; jc += NC) {
+        int nc = std::min(NC, N - jc);
+        int panels = (nc + NR - 1) / NR;
+        // Split along N as well when A alone doesn't give every
+        // thread a block, e.g. for a handful of rows.
+        int groups = std::clamp<int>((2 * (pool.size() + 1) + m_blocks - 1) / m_blocks,
+                                     1, panels);
+        int panels_per_group = (panels + groups - 1) / groups;
+        for (int pc = 0; pc < K; pc += KC) {
+            int kc = std::min(KC, K - pc);
+            pool.parallel_for(panels, 4, [&](size_t begin, size_t end) {
+                int j0 = begin * NR, j1 = std::min<int>(end * NR, nc);
+                const S* b = B + (size_t)pc * N + jc + j0;
+                if constexpr (std::is_same_v<S, T>) {
+                    pack_b<T, NR>(b, N, kc, j1 - j0, packed_b.get() + (size_t)j0 * kc);
+                } else {
+                    thread_local std::vector<T> wide_b;
+                    wide_b.resize((size_t)kc * (j1 - j0));
+                    for (int k = 0; k < kc; ++k)
+                        widen(b + (size_t)k * N, wide_b.data() + (size_t)k * (j1 - j0), j1 - j0);
+                    pack_b<T, NR>(wide_b.data(), j1 - j0, kc, j1 - j0,
+                                  packed_b.get() + (size_t)j0 * kc);
+                }
+            });
+            pool.parallel_for(m_blocks * groups, 1, [&](size_t begin, size_t end) {
+                thread_local std::vector<T> packed_a;
+                packed_a.resize(MC * KC);
+                for (size_t task = begin; task < end; ++task) {
+                    int ic = (task / groups) * MC;
+                    int group = task % groups;
+                    int mc = std::min(MC, M - ic);
+                    const S* a = A + (size_t)ic * K + pc;
+                    const T* wide = nullptr;
+                    int lda = K;
+                    if constexpr (std::is_same_v<S, T>) {
+                        wide = a;
+                    } else {
+                        thread_local std::vector<T> wide_a;
+                        wide_a.resize((size_t)mc * kc);
+                        for (int i = 0; i < mc; ++i)
+                            widen(a + (size_t)i * K, wide_a.data() + (size_t)i * kc, kc);
+                        wide = wide_a.data();
+                        lda = kc;
+                    }
+                    block(wide, lda, packed_b.get(),
+                          C + (size_t)ic * N + jc, N,
+                          mc, kc, nc,
+                          group * panels_per_group,
+                          (group + 1) * panels_per_group,
+                          packed_a.data());
+                }
+            });
+        }
+    }
+}
+
+template <typename T, typename S = T>
+void gemm_generic(const S* A, const S* B, T* C, int M, int K, int N,
+                  convert_fn<S, T> widen) {
+    gemm_driver<T, 16, S>(gemm_block_generic<T>, A, B, C, M, K, N, widen);
+}
+
+#ifdef TENSORLIB_X86
+template <typename T, typename S = T>
+void gemm_avx2(const S* A, const S* B, T* C, int M, int K, int N,
+               convert_fn<S, T> widen) {
+    gemm_driver<T, 32, S>(gemm_block_avx2<T>, A, B, C, M, K, N, widen);
+}
+
+template <typename T, typename S = T>
+void gemm_avx512(const S* A, const S* B, T* C, int M, int K, int N,
+                 convert_fn<S, T> widen) {
+    gemm_driver<T, 64, S>(gemm_block_avx512<T>, A, B, C, M, K, N, widen);
+}
+#endif
+
+// Matrix kernels, the "_m_" family. Halves (S) are multiplied in T,
+// the f32 result rounded to S once at the end.
+// params - {M, K, N}
+template <typename T, typename S = T>
+kernel_fn matmul_m(ISA isa) {
+    void (*loop)(const S*, const S*, T*, int, int, int, convert_fn<S, T>)
+        = gemm_generic<T, S>;
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512)
+        loop = gemm_avx512<T, S>;
+    else if (isa == ISA::AVX2)
+        loop = gemm_avx2<T, S>;
+#endif
+    convert_fn<S, T> widen = nullptr;
+    convert_fn<T, S> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, T>) {
+        widen = convert_for<S, T>(isa);
+        narrow = convert_for<T, S>(isa);
+    }
+    return [loop, widen, narrow](const std::vector<const uint8_t*>& inputs,
+                                 uint8_t* result,
+                                 size_t mem_size,
+                                 const std::vector<int>& params) {
+        int M = params.at(0), K = params.at(1), N = params.at(2);
+        const S* A = reinterpret_cast<const S*>(inputs[0]);
+        const S* B = reinterpret_cast<const S*>(inputs[1]);
+        if constexpr (std::is_same_v<S, T>) {
+            loop(A, B, reinterpret_cast<T*>(result), M, K, N, nullptr);
+        } else {
+            std::vector<T> C((size_t)M * N);
+            loop(A, B, C.data(), M, K, N, widen);
+            S* r = reinterpret_cast<S*>(result);
+            ThreadPool::global().parallel_for(C.size(), 1 << 15,
+                    [&](size_t begin, size_t end) {
+                narrow(C.data() + begin, r + begin, end - begin);
+            });
+        }
+    };
+}
+
+} // namespace tensorlib::cpu
@@ -0,0 +1,250 @@
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+#include <utils.hpp>
+
+namespace tensorlib {
+
+struct ggml_type_info {
+    std::string dtype;  // empty if tensorlib has no such dtype
+    size_t block;
+    size_t bytes;
+};
+
+// ggml type ids, with the layout of their blocks
+static std::map<uint32_t, ggml_type_info> ggml_types = {
+    {0, {"f32", 1, 4}},
+    {1, {"f16", 1, 2}},
+    {2, {"q4_0", 32, 18}},
+    {3, {"q4_1", 32, 20}},
+    {6, {"q5_0", 32, 22}},
+    {7, {"q5_1", 32, 24}},
+    {8, {"q8_0", 32, 34}},
+    {9, {"q8_1", 32, 36}},
+    {10, {"q2_k", 256, 84}},
+    {11, {"q3_k", 256, 110}},
+    {12, {"q4_k", 256, 144}},
+    {13, {"q5_k", 256, 176}},
+    {14, {"q6_k", 256, 210}},
+    {15, {"q8_k", 256, 292}},
+    {24, {"", 1, 1}},       // i8
+    {25, {"", 1, 2}},       // i16
+    {26, {"i32", 1, 4}},
+    {27, {"i64", 1, 8}},
+    {28, {"", 1, 8}},       // f64
+    {30, {"bf16", 1, 2}},
+};
+
+inline uint64_t GGUFValue::as_uint() const {
+    if (auto* u = std::get_if<uint64_t>(&value)) return *u;
+    if (auto* i = std::get_if<int64_t>(&value); i && *i >= 0) return *i;
+    throw std::runtime_error("GGUF value is not an unsigned integer");
+}
+
+inline int64_t GGUFValue::as_int() const {
+    if (auto* i = std::get_if<int64_t>(&value)) return *i;
+    if (auto* u = std::get_if<uint64_t>(&value);
+            u && *u <= uint64_t(std::numeric_limits<int64_t>::max()))
+        return *u;
+    throw std::runtime_error("GGUF value is not an integer");
+}
+
+inline double GGUFValue::as_float() const {
+    if (auto* f = std::get_if<double>(&value)) return *f;
+    throw std::runtime_error("GGUF value is not a float");
+}
+
+inline bool GGUFValue::as_bool() const {
+    if (auto* b = std::get_if<bool>(&value)) return *b;
+    throw std::runtime_error("GGUF value is not a bool");
+}
+
+inline const std::string& GGUFValue::as_string() const {
+    if (auto* s = std::get_if<std::string>(&value)) return *s;
+    throw std::runtime_error("GGUF value is not a string");
+}
+
+inline const std::vector<GGUFValue>& GGUFValue::as_array() const {
+    if (auto* a = std::get_if<std::vector<GGUFValue>>(&value)) return *a;
+    throw std::runtime_error("GGUF value is not an array");
+}
+
+// Little endian fields, bounds checked
+struct GGUFCursor {
+    const uint8_t* at;
+    const uint8_t* end;
+    const std::string& path;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Malformed GGUF file " + path + ": " + what);
+    }
+
+    template <typename T>
+    T read() {
+        if (size_t(end - at) < sizeof(T)) fail("truncated");
+        T v;
+        std::memcpy(&v, at, sizeof(T));
+        at += sizeof(T);
+        return v;
+    }
+
+    std::string string() {
+        uint64_t n = read<uint64_t>();
+        if (n > uint64_t(end - at)) fail("truncated string");
+        std::string s(reinterpret_cast<const char*>(at), n);
+        at += n;
+        return s;
+    }
+
+    // Arrays of arrays deeper than this are refused, rather than
+    // recursing as deep as a file says
+    static constexpr int max_nesting = 16;
+
+    GGUFValue value(GGUFValue::Type type, int depth = 0) {
+        using Type = GGUFValue::Type;
+        GGUFValue v{type, {}};
+        switch (type) {
+            case Type::U8: v.value = uint64_t(read<uint8_t>()); break;
+            case Type::I8: v.value = int64_t(read<int8_t>()); break;
+            case Type::U16: v.value = uint64_t(read<uint16_t>()); break;
+            case Type::I16: v.value = int64_t(read<int16_t>()); break;
+            case Type::U32: v.value = uint64_t(read<uint32_t>()); break;
+            case Type::I32: v.value = int64_t(read<int32_t>()); break;
+            case Type::U64: v.value = read<uint64_t>(); break;
+            case Type::I64: v.value = read<int64_t>(); break;
+            case Type::F32: v.value = double(read<float>()); break;
+            case Type::F64: v.value = read<double>(); break;
+            case Type::Bool: v.value = read<uint8_t>() != 0; break;
+            case Type::String: v.value = string(); break;
+            case Type::Array: {
+                if (depth >= max_nesting) fail("arrays nested too deep");
+                auto element = static_cast<Type>(read<uint32_t>());
+                uint64_t n = read<uint64_t>();
+                // Every element takes a byte at least
+                if (n > uint64_t(end - at)) fail("truncated array");
+                std::vector<GGUFValue> items;
+                items.reserve(n);
+                for (uint64_t i = 0; i < n; ++i)
+                    items.push_back(value(element, depth + 1));
+                v.value = std::move(items);
+                break;
+            }
+            default:
+                fail("unknown value type " + std::to_string(uint32_t(type)));
+        }
+        return v;
+    }
+};
+
+inline GGUFReader::GGUFReader(const std::string& path, MappedFile::Mode mode)
+    :   file_(MappedFile::open(path, mode)) {
+    GGUFCursor in{file_->data(), file_->data() + file_->size(), path};
+    if (in.read<uint32_t>() != 0x46554747)
+        in.fail("not a GGUF file");
+    version_ = in.read<uint32_t>();
+    // Version 1 had 32 bit counts, big endian files read as huge versions
+    if (version_ < 2 || version_ > 3)
+        in.fail("unsupported version " + std::to_string(version_));
+    uint64_t ntensors = in.read<uint64_t>();
+    uint64_t nkv = in.read<uint64_t>();
+
+    for (uint64_t i = 0; i < nkv; ++i) {
+        std::string key = in.string();
+        auto type = static_cast<GGUFValue::Type>(in.read<uint32_t>());
+        if (!metadata_.emplace(key, in.value(type)).second)
+            in.fail("metadata " + key + " twice");
+    }
+
+    uint64_t alignment = 32;
+    auto align = metadata_.find("general.alignment");
+    if (align != metadata_.end())
+        alignment = align->second.as_uint();
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        in.fail("alignment " + std::to_string(alignment) + " is not a power of two");
+
+    for (uint64_t i = 0; i < ntensors; ++i) {
+        GGUFTensorInfo info;
+        info.name = in.string();
+        uint32_t ndim = in.read<uint32_t>();
+        if (ndim > 8) in.fail("too many dimensions for " + info.name);
+        info.shape.resize(ndim);
+        uint64_t numel = 1;
+        for (uint32_t d = 0; d < ndim; ++d) {
+            uint64_t n = in.read<uint64_t>();
+            if (n > uint64_t(std::numeric_limits<int>::max()))
+                in.fail("dimension too large in " + info.name);
+            info.shape[ndim - 1 - d] = n;
+            if (__builtin_mul_overflow(numel, n, &numel))
+                in.fail("too many elements in " + info.name);
+        }
+        info.type = in.read<uint32_t>();
+        info.offset = in.read<uint64_t>();
+        info.nbytes = 0;
+        auto type = ggml_types.find(info.type);
+        if (type != ggml_types.end()) {
+            info.dtype = type->second.dtype;
+            // Blocks run along the first ggml dim, rows are whole blocks
+            uint64_t row = ndim ? info.shape.back() : 1;
+            if (row % type->second.block)
+                in.fail("rows of " + info.name + " are not whole blocks");
+            if (__builtin_mul_overflow(numel / type->second.block, type->second.bytes,
+                                       &info.nbytes))
+                in.fail("too many elements in " + info.name);
+        }
+        if (!by_name_.emplace(info.name, infos_.size()).second)
+            in.fail("tensor " + info.name + " twice");
+        infos_.push_back(std::move(info));
+    }
+
+    // Data follows the infos, aligned, offsets are relative to it
+    uint64_t data_start = in.at - file_->data();
+    data_start = (data_start + alignment - 1) / alignment * alignment;
+    if (!infos_.empty() && data_start > file_->size())
+        in.fail("data past the end");
+    for (auto& info : infos_) {
+        uint64_t data_bytes = file_->size() - data_start;
+        if (info.offset > data_bytes || info.nbytes > data_bytes - info.offset)
+            in.fail("data of " + info.name + " out of bounds");
+        info.offset += data_start;
+    }
+    VOUT << "GGUF v" << version_ << " " << path << ": " << metadata_.size()
+         << " metadata entries, " << infos_.size() << " tensors" << std::endl;
+}
+
+inline const GGUFTensorInfo& GGUFReader::tensor_info(const std::string& name) const {
+    auto found = by_name_.find(name);
+    if (found == by_name_.end())
+        throw std::runtime_error("No tensor " + name + " in " + file_->path());
+    return infos_[found->second];
+}
+
+inline Tensor GGUFReader::tensor(const std::string& name) const {
+    const GGUFTensorInfo& info = tensor_info(name);
+    if (info.dtype.empty())
+        throw std::runtime_error("Unsupported ggml type " + std::to_string(info.type)
+                + " for " + name + " in " + file_->path());
+    // Packed blocks are read as they are, never dequantized here.
+    // Files aligning data to less than an element get a copy.
+    Storage data = file_->storage(info.offset, info.nbytes);
+    const DType& dtype = dtypes_map[info.dtype];
+    if (dtype.block == 1 && reinterpret_cast<uintptr_t>(data.data()) % dtype.bytes)
+        data = Storage(data.data(), data.size());
+    return Tensor(std::move(data), info.shape, info.dtype);
+}
+
+inline std::map<std::string, Tensor> GGUFReader::tensors() const {
+    std::map<std::string, Tensor> all;
+    for (auto& info : infos_) {
+        if (info.dtype.empty()) {
+            VOUT << "Skipping " << info.name << " of unsupported ggml type "
+                 << info.type << " in " << file_->path() << std::endl;
+            continue;
+        }
+        all.emplace(info.name, tensor(info.name));
+    }
+    return all;
+}
+
+} // namespace tensorlib
@@ -0,0 +1,123 @@
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace tensorlib {
+
+uint32_t Graph::add(Op op,
+        const DType& dtype,
+        std::span<const int> shape,
+        std::span<const uint32_t> node_inputs,
+        std::span<const int> node_params,
+        Tensor* tensor) {
+    IRNode node;
+    node.op = op;
+    size_t d = 0;
+    while (d < dtypes.size() && !(dtypes[d] == dtype)) ++d;
+    if (d == dtypes.size()) dtypes.push_back(dtype);
+    node.dtype = static_cast<uint8_t>(d);
+    node.ndim = static_cast<uint16_t>(shape.size());
+    node.shape = static_cast<uint32_t>(dims.size());
+    dims.insert(dims.end(), shape.begin(), shape.end());
+    node.inputs = static_cast<uint32_t>(inputs.size());
+    node.ninputs = static_cast<uint32_t>(node_inputs.size());
+    inputs.insert(inputs.end(), node_inputs.begin(), node_inputs.end());
+    node.params = static_cast<uint32_t>(params.size());
+    node.nparams = static_cast<uint32_t>(node_params.size());
+    params.insert(params.end(), node_params.begin(), node_params.end());
+    nodes.push_back(node);
+    tensors.push_back(tensor);
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+size_t Graph::numel(uint32_t i) const {
+    size_t n = 1;
+    for (int d : shape_of(i)) n *= d;
+    return n;
+}
+
+Graph Graph::rewrite(std::span<const uint32_t> replace) const {
+    Graph graph;
+    // Where every node of this graph ends up
+    std::vector<uint32_t> moved(size(), dropped);
+    std::vector<uint32_t> node_inputs;
+    for (uint32_t i = 0; i < size(); ++i) {
+        if (replace[i] == dropped) continue;
+        if (replace[i] != i) {
+            moved[i] = moved[replace[i]];
+            continue;
+        }
+        node_inputs.clear();
+        for (uint32_t in : inputs_of(i)) {
+            if (moved[in] == dropped)
+                throw std::runtime_error("Rewrite dropped an input of "
+                        + op_repr[nodes[i].op] + " node " + std::to_string(i));
+            node_inputs.push_back(moved[in]);
+        }
+        moved[i] = graph.add(nodes[i].op, dtype_of(i), shape_of(i),
+                node_inputs, params_of(i), tensors[i]);
+    }
+    graph.root = moved[root];
+    return graph;
+}
+
+GraphUsers graph_users(const Graph& graph) {
+    GraphUsers users;
+    users.offsets.assign(graph.size() + 1, 0);
+    for (uint32_t in : graph.inputs)
+        users.offsets[in + 1]++;
+    for (size_t i = 0; i < graph.size(); ++i)
+        users.offsets[i + 1] += users.offsets[i];
+    users.list.resize(graph.inputs.size());
+    std::vector<uint32_t> fill(users.offsets.begin(), users.offsets.end() - 1);
+    for (uint32_t i = 0; i < graph.size(); ++i)
+        for (uint32_t in : graph.inputs_of(i))
+            users.list[fill[in]++] = i;
+    return users;
+}
+
+Graph build_graph(Tensor& root) {
+    Graph graph;
+    std::unordered_map<const Tensor*, uint32_t> index;
+
+    auto parent_of = [](const Tensor* t, const std::string& tuid) -> Tensor* {
+        auto found = global_tensor_map.find(tuid);
+        if (found == global_tensor_map.end() || !found->second)
+            throw std::runtime_error("Parent " + tuid + " of " + t->tuid()
+                    + " no longer exists");
+        return found->second.get();
+    };
+
+    // Post order without recursion, long chains would blow the stack.
+    // A tensor is pushed once to expand its parents and once more to
+    // add it after them.
+    std::vector<std::pair<Tensor*, bool>> stack = {{&root, false}};
+    std::vector<uint32_t> node_inputs;
+    while (!stack.empty()) {
+        auto [t, expanded] = stack.back();
+        stack.pop_back();
+        if (index.count(t)) continue;
+        if (t->realized) {
+            index[t] = graph.add(Op::Load, t->dtype(), t->shape(), {}, {}, t);
+            continue;
+        }
+        if (!expanded) {
+            stack.push_back({t, true});
+            auto& parents = t->context.parents;
+            for (auto p = parents.rbegin(); p != parents.rend(); ++p) {
+                Tensor* pt = parent_of(t, *p);
+                if (!index.count(pt)) stack.push_back({pt, false});
+            }
+            continue;
+        }
+        node_inputs.clear();
+        for (auto& parent : t->context.parents)
+            node_inputs.push_back(index.at(parent_of(t, parent)));
+        index[t] = graph.add(t->context.op, t->dtype(), t->shape(),
+                node_inputs, t->context.params, t);
+    }
+    graph.root = index.at(&root);
+    return graph;
+}
+
+} // namespace tensorlib
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <future>
+#include <unordered_map>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include <ops.hpp>
+#include <utils.hpp>
+
+namespace tensorlib::cpu::jit {
+
+// FNV-1a, stable across runs and builds unlike std::hash
+inline uint64_t fnv1a(const void* data, size_t n, uint64_t h = 0xcbf29ce484222325ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+inline uint64_t fnv1a(const std::string& text) {
+    return fnv1a(text.data(), text.size());
+}
+
+// What a fused kernel is looked up by, its source follows from it
+struct KernelKey {
+    std::vector<int> program;
+    std::string ctype;
+    friend bool operator==(const KernelKey& a, const KernelKey& b) = default;
+};
+
+struct KernelKeyHash {
+    size_t operator()(const KernelKey& key) const {
+        uint64_t h = fnv1a(key.ctype);
+        return fnv1a(key.program.data(), key.program.size() * sizeof(int), h);
+    }
+};
+
+// Everything the JIT keeps around, shared by every translation unit
+struct State {
+    std::mutex lock;
+    int enabled = -1;   // unset, read from the environment
+    Stats stats;
+    // Failures are remembered as nullptr. Set once built, whoever
+    // asks meanwhile waits on the one build.
+    std::unordered_map<KernelKey, std::shared_future<fused_fn>, KernelKeyHash> kernels;
+    // host_signature() of each compiler asked for
+    std::map<std::string, std::string> signatures;
+};
+
+inline State& state() {
+    static State s;
+    return s;
+}
+
+inline bool enabled() {
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    if (s.enabled < 0) {
+        const char* env = std::getenv("TENSORLIB_JIT");
+        s.enabled = !(env && std::string(env) == "0");
+    }
+    return s.enabled;
+}
+
+inline void set_enabled(bool on) {
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.enabled = on;
+}
+
+inline Stats stats() {
+    State& s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.stats;
+}
+
+inline std::string compiler() {
+    const char* env = std::getenv("TENSORLIB_CXX");
+    return env ? env : "c++";
+}
+
+// Host specific code, the cache is per machine anyway. No
+// contraction, results match the interpreted kernels bit for bit.
+inline std::string compiler_flags() {
+    return "-O3 -march=native -ffp-contract=off -std=c++17 -shared -fPIC";
+}
+
+// Output of a shell command, empty when it fails
+inline std::string command_output(const std::string& cmd) {
+    std::string out;
+    FILE* pipe = popen((cmd + " 2>/dev/null").c_str(), "r");
+    if (!pipe) return out;
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), pipe)) > 0)
+        out.append(buf, n);
+    if (pclose(pipe) != 0) out.clear();
+    return out;
+}
+
+// What a built object depends on besides its source and flags: the
+// compiler's version, and what -march=native enables on this CPU, as
+// the macros it predefines. A cache in a home directory shared by
+// several machines never hands one code built for another. Empty
+// without a working compiler.
+inline std::string host_signature() {
+    State& s = state();
+    std::string cxx = compiler();
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto found = s.signatures.find(cxx);
+        if (found != s.signatures.end())
+            return found->second;
+    }
+    std::string version = command_output(cxx + " --version");
+    std::string target = command_output(cxx + " -march=native -dM -E -x c++ /dev/null");
+    std::string signature = version.empty() || target.empty() ? "" : version + target;
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.signatures[cxx] = signature;
+    return signature;
+}
+
+inline bool available() {
+    return !host_signature().empty();
+}
+
+inline std::filesystem::path cache_dir() {
+    if (const char* env = std::getenv("TENSORLIB_JIT_CACHE"))
+        return env;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"))
+        return std::filesystem::path(xdg) / "tensorlib";
+    if (const char* home = std::getenv("HOME"))
+        return std::filesystem::path(home) / ".cache" / "tensorlib";
+    return std::filesystem::temp_directory_path() / "tensorlib";
+}
+
+// Stack slots become locals: pushing input k at depth d loads it into
+// s<d>, an op at depth d folds s<d-1> into s<d-2>. The compiler keeps
+// them in registers and vectorizes the loop. Division goes through
+// tl_div, which answers integer division by 0 and of the minimum by
+// -1 the way the interpreted kernels do instead of trapping.
+inline std::string fused_source(const std::vector<int>& program,
+                                const std::string& ctype) {
+    static const std::map<int, std::string> ops = {
+        {fused_op(Op::Add), "+"},
+        {fused_op(Op::Sub), "-"},
+        {fused_op(Op::Mul), "*"},
+        {fused_op(Op::Div), "tl_div"},
+    };
+    size_t ninputs = 0, depth = 0, max_depth = 0;
+    std::ostringstream body;
+    for (int code : program) {
+        if (code >= 0) {
+            ninputs = std::max(ninputs, static_cast<size_t>(code) + 1);
+            body << "        s" << depth << " = in" << code << "[i];\n";
+            max_depth = std::max(max_depth, ++depth);
+            continue;
+        }
+        auto op = ops.find(code);
+        if (op == ops.end() || depth < 2)
+            throw std::runtime_error("Malformed fused kernel");
+        --depth;
+        if (code == fused_op(Op::Div))
+            body << "        s" << depth - 1 << " = tl_div(s" << depth - 1
+                 << ", s" << depth << ");\n";
+        else
+            body << "        s" << depth - 1 << " = s" << depth - 1 << " "
+                 << op->second << " s" << depth << ";\n";
+    }
+    if (depth != 1)
+        throw std::runtime_error("Malformed fused kernel");
+
+    std::ostringstream src;
+    src << "// Generated by tensorlib, program";
+    for (int code : program) src << " " << code;
+    src << "\n#include <cstddef>\n#include <cstdint>\n#include <type_traits>\n\n"
+        << "typedef " << ctype << " T;\n\n"
+        << "static inline T tl_div(T a, T b) {\n";
+    if (ctype != "float")
+        src << "    typedef std::make_unsigned<T>::type U;\n"
+            << "    if (b == 0) return 0;\n"
+            << "    if (b == -1) return T(U(0) - U(a));\n";
+    src << "    return a / b;\n"
+        << "}\n\n"
+        << "extern \"C\" void tl_fused(const void* const* inputs, void* result,\n"
+        << "                           size_t begin, size_t end) {\n";
+    for (size_t k = 0; k < ninputs; ++k)
+        src << "    const T* __restrict in" << k
+            << " = static_cast<const T*>(inputs[" << k << "]);\n";
+    src << "    T* __restrict r = static_cast<T*>(result);\n"
+        << "    for (size_t i = begin; i < end; ++i) {\n"
+        << "        T";
+    for (size_t d = 0; d < max_depth; ++d)
+        src << (d ? ", s" : " s") << d;
+    src << ";\n" << body.str()
+        << "        r[i] = s0;\n"
+        << "    }\n"
+        << "}\n";
+    return src.str();
+}
+
+// Loads lib from the disk cache, compiling src into it first if needed
+inline fused_fn build(const std::string& src, Stats& stats) {
+    std::string signature = host_signature();
+    if (signature.empty()) {
+        VOUT << "JIT has no compiler, " << compiler() << " doesn't run" << std::endl;
+        return nullptr;
+    }
+    std::string key = src + compiler() + compiler_flags() + signature;
+    char name[32];
+    std::snprintf(name, sizeof(name), "fused_%016llx",
+            static_cast<unsigned long long>(fnv1a(key)));
+    std::filesystem::path dir = cache_dir();
+    std::filesystem::path lib = dir / (std::string(name) + ".so");
+
+    std::error_code ec;
+    if (std::filesystem::exists(lib, ec)) {
+        stats.loaded++;
+    } else {
+        std::filesystem::create_directories(dir, ec);
+        // Unique names until the rename, other processes may be
+        // building the same kernel.
+        std::string tmp = std::string(name) + "." + std::to_string(getpid());
+        std::filesystem::path cpp = dir / (tmp + ".cpp");
+        std::filesystem::path so = dir / (tmp + ".so");
+        // Kept when the build fails, to see why
+        std::filesystem::path log = dir / (std::string(name) + ".log");
+        std::ofstream(cpp) << src;
+        std::string cmd = compiler() + " " + compiler_flags()
+            + " \"" + cpp.string() + "\" -o \"" + so.string() + "\""
+            + " > \"" + log.string() + "\" 2>&1";
+        auto start = std::chrono::steady_clock::now();
+        int status = std::system(cmd.c_str());
+        std::filesystem::remove(cpp, ec);
+        if (status != 0) {
+            VOUT << "JIT compile failed: " << cmd << std::endl;
+            std::filesystem::remove(so, ec);
+            return nullptr;
+        }
+        std::filesystem::remove(log, ec);
+        std::filesystem::rename(so, lib, ec);
+        if (ec) return nullptr;
+        VOUT << "JIT compiled " << name << " in "
+             << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start).count()
+             << " ms" << std::endl;
+        stats.compiled++;
+    }
+    // Never closed, kernels stay valid for the life of the process
+    void* handle = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        VOUT << "JIT dlopen failed: " << dlerror() << std::endl;
+        return nullptr;
+    }
+    return reinterpret_cast<fused_fn>(dlsym(handle, "tl_fused"));
+}
+
+inline fused_fn fused_kernel(const std::vector<int>& program,
+                             const std::string& ctype) {
+    if (program.size() > max_program || !enabled())
+        return nullptr;
+    State& s = state();
+    std::promise<fused_fn> built;
+    {
+        std::unique_lock<std::mutex> guard(s.lock);
+        KernelKey key{program, ctype};
+        auto found = s.kernels.find(key);
+        if (found != s.kernels.end()) {
+            // Built, or being built by someone else
+            std::shared_future<fused_fn> fn = found->second;
+            guard.unlock();
+            return fn.get();
+        }
+        s.kernels.emplace(std::move(key), built.get_future().share());
+    }
+    // Outside the lock, kernels already built and other builds don't
+    // wait on the compiler
+    Stats counted;
+    fused_fn fn = nullptr;
+    try {
+        fn = build(fused_source(program, ctype), counted);
+    } catch (std::exception& e) {
+        VOUT << "JIT build failed: " << e.what() << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.stats.compiled += counted.compiled;
+        s.stats.loaded += counted.loaded;
+        s.stats.failed += !fn;
+    }
+    built.set_value(fn);
+    return fn;
+}
+
+} // namespace tensorlib::cpu::jit
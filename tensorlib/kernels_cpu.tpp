@@ -0,0 +1,555 @@
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#include <utils.hpp>
+#include <thread_pool.hpp>
+
+namespace tensorlib::cpu {
+
+ISA host_isa() {
+    static const ISA isa = [] {
+        ISA detected = ISA::Generic;
+#ifdef TENSORLIB_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+            detected = ISA::AVX512;
+        else if (__builtin_cpu_supports("avx2"))
+            detected = ISA::AVX2;
+#endif
+        if (const char* requested = std::getenv("TENSORLIB_ISA")) {
+            for (auto& [candidate, repr] : isa_repr)
+                if (repr == requested && candidate < detected)
+                    detected = candidate;
+        }
+        DBOUT << "CPU kernels using " << isa_repr[detected] << std::endl;
+        return detected;
+    }();
+    return isa;
+}
+
+/* ----------------------
+ *  Strided iteration
+ * ---------------------- */
+
+// Shape of a result and the strides its inputs are read with, laid out
+// in params as the shape, then the strides of every input in turn. The
+// result is dense. Dims every input walks in order are merged, size 1
+// dims dropped, so the last dim is as long a run as the layout allows
+// and the loops around it are as few.
+struct strided_layout {
+    std::vector<size_t> shape;
+    std::vector<std::vector<size_t>> strides;
+
+    strided_layout(const std::vector<int>& params, size_t ninputs)
+        :   strides(ninputs) {
+        size_t ndim = params.size() / (ninputs + 1);
+        for (size_t d = 0; d < ndim; ++d) {
+            size_t size = params[d];
+            if (size == 1) continue;
+            bool merge = !shape.empty();
+            for (size_t k = 0; k < ninputs && merge; ++k)
+                merge = strides[k].back() == params[(k + 1) * ndim + d] * size;
+            if (merge)
+                shape.back() *= size;
+            else
+                shape.push_back(size);
+            for (size_t k = 0; k < ninputs; ++k) {
+                size_t stride = params[(k + 1) * ndim + d];
+                if (merge)
+                    strides[k].back() = stride;
+                else
+                    strides[k].push_back(stride);
+            }
+        }
+        if (shape.empty()) {
+            shape.push_back(1);
+            for (auto& s : strides) s.push_back(1);
+        }
+    }
+
+    size_t ndim() const { return shape.size(); }
+    size_t cols() const { return shape.back(); }
+
+    // Offset of the first element of row r (dims but the last) in input k
+    size_t row_offset(size_t k, size_t r) const {
+        size_t offset = 0;
+        for (size_t d = ndim() - 1; d-- > 0;) {
+            offset += (r % shape[d]) * strides[k][d];
+            r /= shape[d];
+        }
+        return offset;
+    }
+};
+
+/* ----------------------
+ *  Elementwise kernels
+ * ---------------------- */
+
+enum class BinOp { Add, Sub, Mul, Div };
+
+// Integer division where the hardware would trap, answered as NumPy
+// does: x / 0 is 0, and the minimum over -1 wraps around to itself.
+template <typename T>
+TL_INLINE T divide(T a, T b) {
+    if constexpr (std::is_integral_v<T>) {
+        if (b == 0) return 0;
+        if (b == -1) return T(std::make_unsigned_t<T>(0) - std::make_unsigned_t<T>(a));
+    }
+    return a / b;
+}
+
+// Works on scalars and on compiler vector types alike.
+// Arguments by reference, vectors by value would change the ABI
+// depending on the instruction set of the caller.
+template <BinOp op, typename V>
+TL_INLINE void apply(V& r, const V& a, const V& b) {
+    if constexpr (op == BinOp::Add) r = a + b;
+    else if constexpr (op == BinOp::Sub) r = a - b;
+    else if constexpr (op == BinOp::Mul) r = a * b;
+    else if constexpr (std::is_arithmetic_v<V>) r = divide(a, b);
+    else r = a / b;
+}
+
+// Vector width is in bytes, the instruction set comes from whichever
+// target the caller is compiled for.
+template <typename T, size_t width, BinOp op>
+TL_INLINE void binop_loop(const T* a, const T* b, T* r, size_t n) {
+    typedef T vec __attribute__((vector_size(width)));
+    constexpr size_t lanes = width / sizeof(T);
+    size_t i = 0;
+    // No vector integer division to speak of, one element at a time
+    // lets divide() check the divisor
+    if constexpr (op == BinOp::Div && std::is_integral_v<T>) {
+        for (; i < n; ++i) r[i] = divide(a[i], b[i]);
+        return;
+    }
+    // Two vectors per iteration to keep both load ports busy
+    for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        vec va0, vb0, va1, vb1, vr0, vr1;
+        std::memcpy(&va0, a + i, width);
+        std::memcpy(&vb0, b + i, width);
+        std::memcpy(&va1, a + i + lanes, width);
+        std::memcpy(&vb1, b + i + lanes, width);
+        apply<op>(vr0, va0, vb0);
+        apply<op>(vr1, va1, vb1);
+        std::memcpy(r + i, &vr0, width);
+        std::memcpy(r + i + lanes, &vr1, width);
+    }
+    for (; i < n; ++i)
+        apply<op>(r[i], a[i], b[i]);
+}
+
+template <typename T, BinOp op>
+void binop_generic(const T* a, const T* b, T* r, size_t n) {
+    binop_loop<T, 16, op>(a, b, r, n);
+}
+
+#ifdef TENSORLIB_X86
+template <typename T, BinOp op>
+TL_TARGET_AVX2 void binop_avx2(const T* a, const T* b, T* r, size_t n) {
+    binop_loop<T, 32, op>(a, b, r, n);
+}
+
+template <typename T, BinOp op>
+TL_TARGET_AVX512 void binop_avx512(const T* a, const T* b, T* r, size_t n) {
+    binop_loop<T, 64, op>(a, b, r, n);
+}
+#endif
+
+template <typename T>
+using binop_fn = void (*)(const T*, const T*, T*, size_t);
+
+template <typename T, BinOp op>
+binop_fn<T> binop_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512)
+        return binop_avx512<T, op>;
+    if (isa == ISA::AVX2)
+        return binop_avx2<T, op>;
+#endif
+    return binop_generic<T, op>;
+}
+
+// len elements of a row read with stride, as T. Dense rows of T are
+// used in place, anything else lands in tile: stride 0 is one element
+// repeated, a broadcast scalar or row.
+template <typename T, typename S>
+const T* load_row(const S* src, size_t stride, T* tile, size_t len,
+                  convert_fn<S, T> widen) {
+    if (stride == 1) {
+        if constexpr (std::is_same_v<S, T>) return src;
+        else widen(src, tile, len);
+    } else if (stride == 0) {
+        std::fill(tile, tile + len, T(src[0]));
+    } else {
+        for (size_t i = 0; i < len; ++i) tile[i] = T(src[i * stride]);
+    }
+    return tile;
+}
+
+// Elementwise vector kernels, the "_v_" family. Elements are stored
+// as S and computed on as T, halves are widened to floats a tile at a
+// time.
+// params - none when both inputs are dense and of the result's shape,
+// else a strided_layout of two inputs, broadcast dims have stride 0
+template <typename T, BinOp op, typename S = T>
+kernel_fn binop_v(ISA isa) {
+    binop_fn<T> loop = binop_for<T, op>(isa);
+    convert_fn<S, T> widen = nullptr;
+    convert_fn<T, S> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, T>) {
+        widen = convert_for<S, T>(isa);
+        narrow = convert_for<T, S>(isa);
+    }
+    return [loop, widen, narrow](const std::vector<const uint8_t*>& inputs,
+                                 uint8_t* result,
+                                 size_t mem_size,
+                                 const std::vector<int>& params) {
+        const S* a = reinterpret_cast<const S*>(inputs[0]);
+        const S* b = reinterpret_cast<const S*>(inputs[1]);
+        S* r = reinterpret_cast<S*>(result);
+        size_t n = mem_size / sizeof(S);
+        constexpr size_t tile = 1024;
+        if (!params.empty()) {
+            if (n == 0) return;
+            // Rows a tile at a time, every tile a vectorized loop. Chunks
+            // are split by elements, a single long row is spread too.
+            strided_layout layout(params, 2);
+            size_t cols = layout.cols();
+            size_t sa = layout.strides[0].back(), sb = layout.strides[1].back();
+            ThreadPool::global().parallel_for(n, 1 << 15,
+                    [&](size_t begin, size_t end) {
+                T ta[tile], tb[tile];
+                for (size_t t = begin; t < end;) {
+                    size_t row = t / cols, j = t % cols;
+                    size_t len = std::min({tile, cols - j, end - t});
+                    const S* pa = a + layout.row_offset(0, row) + j * sa;
+                    const S* pb = b + layout.row_offset(1, row) + j * sb;
+                    const T* wa = load_row(pa, sa, ta, len, widen);
+                    const T* wb = load_row(pb, sb, tb, len, widen);
+                    if constexpr (std::is_same_v<S, T>) {
+                        loop(wa, wb, r + t, len);
+                    } else {
+                        loop(wa, wb, ta, len);
+                        narrow(ta, r + t, len);
+                    }
+                    t += len;
+                }
+            });
+            return;
+        }
+        // Chunks big enough to amortize handing them out,
+        // small enough to spread a few MB over every core.
+        ThreadPool::global().parallel_for(n, 1 << 15,
+                [&](size_t begin, size_t end) {
+            if constexpr (std::is_same_v<S, T>) {
+                loop(a + begin, b + begin, r + begin, end - begin);
+            } else {
+                T wa[tile], wb[tile];
+                for (size_t t = begin; t < end; t += tile) {
+                    size_t len = std::min(tile, end - t);
+                    widen(a + t, wa, len);
+                    widen(b + t, wb, len);
+                    loop(wa, wb, wa, len);
+                    narrow(wa, r + t, len);
+                }
+            }
+        });
+    };
+}
+
+template <typename T> const char* ctype();
+template <> inline const char* ctype<float>() { return "float"; }
+template <> inline const char* ctype<int32_t>() { return "int32_t"; }
+template <> inline const char* ctype<int64_t>() { return "int64_t"; }
+
+// Chains of elementwise ops in one pass, see fused_op in ops.hpp for
+// the params. Bound once per node: the program is checked and the
+// chain compiled for it if the JIT can have it, else the kernel
+// interprets it over tiles small enough for L1 so the intermediates
+// of a tile never leave it. Either way inputs are read straight from
+// memory once and only the final op writes the result. Halves (S)
+// are interpreted, widened to T as their tiles are read.
+template <typename T, typename S = T>
+kernel_binder fused_v(ISA isa) {
+    convert_fn<S, T> widen = nullptr;
+    convert_fn<T, S> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, T>) {
+        widen = convert_for<S, T>(isa);
+        narrow = convert_for<T, S>(isa);
+    }
+    std::map<int, binop_fn<T>> loops = {
+        {fused_op(Op::Add), binop_for<T, BinOp::Add>(isa)},
+        {fused_op(Op::Sub), binop_for<T, BinOp::Sub>(isa)},
+        {fused_op(Op::Mul), binop_for<T, BinOp::Mul>(isa)},
+        {fused_op(Op::Div), binop_for<T, BinOp::Div>(isa)},
+    };
+    return [loops, widen, narrow](size_t ninputs,
+                                  const std::vector<int>& program) -> kernel_fn {
+        // Each step is an input or a loop
+        std::vector<binop_fn<T>> steps;
+        size_t depth = 0, max_depth = 0;
+        for (int code : program) {
+            if (code >= 0) {
+                if (static_cast<size_t>(code) >= ninputs)
+                    throw std::runtime_error("Fused kernel reads a missing input");
+                steps.push_back(nullptr);
+                max_depth = std::max(max_depth, ++depth);
+                continue;
+            }
+            auto loop = loops.find(code);
+            if (loop == loops.end() || depth < 2)
+                throw std::runtime_error("Malformed fused kernel");
+            steps.push_back(loop->second);
+            --depth;
+        }
+        if (depth != 1)
+            throw std::runtime_error("Malformed fused kernel");
+
+        if constexpr (std::is_same_v<S, T>) {
+            if (jit::fused_fn compiled = jit::fused_kernel(program, ctype<T>())) {
+                return [compiled](const std::vector<const uint8_t*>& inputs,
+                                  uint8_t* result,
+                                  size_t mem_size,
+                                  const std::vector<int>&) {
+                    std::vector<const void*> in(inputs.begin(), inputs.end());
+                    ThreadPool::global().parallel_for(mem_size / sizeof(T), 1 << 15,
+                            [&](size_t begin, size_t end) {
+                        compiled(in.data(), result, begin, end);
+                    });
+                };
+            }
+        }
+
+        return [program, steps, max_depth, widen, narrow](
+                const std::vector<const uint8_t*>& inputs,
+                uint8_t* result,
+                size_t mem_size,
+                const std::vector<int>&) {
+            S* r = reinterpret_cast<S*>(result);
+            constexpr size_t tile = 4096 / sizeof(T);
+            ThreadPool::global().parallel_for(mem_size / sizeof(S), 1 << 15,
+                    [&](size_t begin, size_t end) {
+                // Stack slot k holds the op result sitting at depth k
+                thread_local std::vector<T> scratch;
+                scratch.resize(max_depth * tile);
+                std::vector<const T*> stack(max_depth);
+                for (size_t t = begin; t < end; t += tile) {
+                    size_t len = std::min(tile, end - t);
+                    size_t top = 0;
+                    for (size_t s = 0; s < steps.size(); ++s) {
+                        if (!steps[s]) {
+                            const S* in = reinterpret_cast<const S*>(
+                                    inputs[program[s]]) + t;
+                            if constexpr (std::is_same_v<S, T>) {
+                                stack[top++] = in;
+                            } else {
+                                // Into the slot of the depth it lands at,
+                                // whatever was there has been consumed
+                                T* wide = scratch.data() + top * tile;
+                                widen(in, wide, len);
+                                stack[top++] = wide;
+                            }
+                            continue;
+                        }
+                        top -= 2;
+                        T* out = scratch.data() + top * tile;
+                        if constexpr (std::is_same_v<S, T>)
+                            if (s + 1 == steps.size()) out = r + t;
+                        steps[s](stack[top], stack[top + 1], out, len);
+                        stack[top++] = out;
+                    }
+                    if constexpr (!std::is_same_v<S, T>)
+                        narrow(stack[0], r + t, len);
+                }
+            });
+        };
+    };
+}
+
+// Same for every dtype, bytes are bytes
+kernel_fn copy_v() {
+    return [](const std::vector<const uint8_t*>& inputs,
+              uint8_t* result,
+              size_t mem_size,
+              const std::vector<int>&) {
+        const uint8_t* a = inputs[0];
+        ThreadPool::global().parallel_for(mem_size, 1 << 17,
+                [&](size_t begin, size_t end) {
+            std::memcpy(result + begin, a + begin, end - begin);
+        });
+    };
+}
+
+// Dense copy of a strided view, the "contiguous_v_" kernels. Elements
+// are moved as they are, E is an unsigned integer of their size.
+// params - the view's shape, then its strides
+template <typename E>
+kernel_fn contiguous_v() {
+    return [](const std::vector<const uint8_t*>& inputs,
+              uint8_t* result,
+              size_t mem_size,
+              const std::vector<int>& params) {
+        size_t n = mem_size / sizeof(E);
+        if (n == 0) return;
+        strided_layout layout(params, 1);
+        const E* in = reinterpret_cast<const E*>(inputs[0]);
+        E* out = reinterpret_cast<E*>(result);
+        const auto& shape = layout.shape;
+        const auto& strides = layout.strides[0];
+        size_t d = layout.ndim();
+        size_t cols = layout.cols(), col_stride = strides[d - 1];
+        auto row_offset = [&](size_t r) { return layout.row_offset(0, r); };
+        auto& pool = ThreadPool::global();
+        if (col_stride == 1 || d == 1) {
+            // Rows are runs, or there is just one
+            pool.parallel_for(n / cols, std::max<size_t>(1, (1 << 15) / cols),
+                    [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; ++r) {
+                    const E* src = in + row_offset(r);
+                    E* dst = out + r * cols;
+                    if (col_stride == 1) {
+                        std::memcpy(dst, src, cols * sizeof(E));
+                        continue;
+                    }
+                    for (size_t j = 0; j < cols; ++j)
+                        dst[j] = src[j * col_stride];
+                }
+            });
+            return;
+        }
+        // Columns strided, a transpose of the last two dims or alike.
+        // Tiles of both are copied at once, so the lines read across
+        // one and written across the other stay in L1 while in use.
+        constexpr size_t tile = 32;
+        size_t rows = shape[d - 2], row_stride = strides[d - 2];
+        size_t row_tiles = (rows + tile - 1) / tile;
+        pool.parallel_for(n / cols / rows * row_tiles, 1,
+                [&](size_t begin, size_t end) {
+            for (size_t task = begin; task < end; ++task) {
+                size_t plane = task / row_tiles;
+                size_t i0 = task % row_tiles * tile, i1 = std::min(rows, i0 + tile);
+                const E* src = in + row_offset(plane * rows);
+                E* dst = out + plane * rows * cols;
+                for (size_t j0 = 0; j0 < cols; j0 += tile) {
+                    size_t j1 = std::min(cols, j0 + tile);
+                    for (size_t i = i0; i < i1; ++i)
+                        for (size_t j = j0; j < j1; ++j)
+                            dst[i * cols + j] = src[i * row_stride + j * col_stride];
+                }
+            }
+        });
+    };
+}
+
+// A kernel binding itself on every call
+kernel_fn bound_per_call(kernel_binder binder) {
+    return [binder](const std::vector<const uint8_t*>& inputs,
+                    uint8_t* result,
+                    size_t mem_size,
+                    const std::vector<int>& params) {
+        binder(inputs.size(), params)(inputs, result, mem_size, params);
+    };
+}
+
+void register_binders(std::map<std::string, kernel_binder>& binders) {
+    ISA isa = host_isa();
+    binders["fused_v_f32"] = fused_v<float>(isa);
+    binders["fused_v_i32"] = fused_v<int32_t>(isa);
+    binders["fused_v_i64"] = fused_v<int64_t>(isa);
+    binders["fused_v_f16"] = fused_v<float, float16>(isa);
+    binders["fused_v_bf16"] = fused_v<float, bfloat16>(isa);
+}
+
+void register_kernels(std::map<std::string, kernel_fn>& compute_functions) {
+    ISA isa = host_isa();
+    // Kept in sync with the shader functions of the metal wrapper
+    compute_functions["mul_v_f32"] = binop_v<float, BinOp::Mul>(isa);
+    compute_functions["mul_v_i32"] = binop_v<int32_t, BinOp::Mul>(isa);
+    compute_functions["mul_v_i64"] = binop_v<int64_t, BinOp::Mul>(isa);
+    compute_functions["add_v_f32"] = binop_v<float, BinOp::Add>(isa);
+    compute_functions["add_v_i32"] = binop_v<int32_t, BinOp::Add>(isa);
+    compute_functions["add_v_i64"] = binop_v<int64_t, BinOp::Add>(isa);
+    compute_functions["sub_v_f32"] = binop_v<float, BinOp::Sub>(isa);
+    compute_functions["sub_v_i32"] = binop_v<int32_t, BinOp::Sub>(isa);
+    compute_functions["sub_v_i64"] = binop_v<int64_t, BinOp::Sub>(isa);
+    compute_functions["div_v_f32"] = binop_v<float, BinOp::Div>(isa);
+    compute_functions["div_v_i32"] = binop_v<int32_t, BinOp::Div>(isa);
+    compute_functions["div_v_i64"] = binop_v<int64_t, BinOp::Div>(isa);
+    compute_functions["mul_v_f16"] = binop_v<float, BinOp::Mul, float16>(isa);
+    compute_functions["mul_v_bf16"] = binop_v<float, BinOp::Mul, bfloat16>(isa);
+    compute_functions["add_v_f16"] = binop_v<float, BinOp::Add, float16>(isa);
+    compute_functions["add_v_bf16"] = binop_v<float, BinOp::Add, bfloat16>(isa);
+    compute_functions["sub_v_f16"] = binop_v<float, BinOp::Sub, float16>(isa);
+    compute_functions["sub_v_bf16"] = binop_v<float, BinOp::Sub, bfloat16>(isa);
+    compute_functions["div_v_f16"] = binop_v<float, BinOp::Div, float16>(isa);
+    compute_functions["div_v_bf16"] = binop_v<float, BinOp::Div, bfloat16>(isa);
+    compute_functions["copy_v_f32"] = copy_v();
+    compute_functions["copy_v_i32"] = copy_v();
+    compute_functions["copy_v_i64"] = copy_v();
+    compute_functions["copy_v_f16"] = copy_v();
+    compute_functions["copy_v_bf16"] = copy_v();
+    compute_functions["contiguous_v_f32"] = contiguous_v<uint32_t>();
+    compute_functions["contiguous_v_i32"] = contiguous_v<uint32_t>();
+    compute_functions["contiguous_v_i64"] = contiguous_v<uint64_t>();
+    compute_functions["contiguous_v_f16"] = contiguous_v<uint16_t>();
+    compute_functions["contiguous_v_bf16"] = contiguous_v<uint16_t>();
+    compute_functions["mul_m_f32"] = matmul_m<float>(isa);
+    compute_functions["mul_m_i32"] = matmul_m<int32_t>(isa);
+    compute_functions["mul_m_i64"] = matmul_m<int64_t>(isa);
+    compute_functions["mul_m_f16"] = matmul_m<float, float16>(isa);
+    compute_functions["mul_m_bf16"] = matmul_m<float, bfloat16>(isa);
+    compute_functions["mul_m_q8_0"] = matmul_q<block_q8_0>(isa);
+    compute_functions["mul_m_q4_0"] = matmul_q<block_q4_0>(isa);
+    compute_functions["mul_m_q4_1"] = matmul_q<block_q4_1>(isa);
+    compute_functions["cast_v_f32_f16"] = cast_v<float, float16>(isa);
+    compute_functions["cast_v_f32_bf16"] = cast_v<float, bfloat16>(isa);
+    compute_functions["cast_v_f16_f32"] = cast_v<float16, float>(isa);
+    compute_functions["cast_v_f16_bf16"] = cast_v<float16, bfloat16>(isa);
+    compute_functions["cast_v_bf16_f32"] = cast_v<bfloat16, float>(isa);
+    compute_functions["cast_v_bf16_f16"] = cast_v<bfloat16, float16>(isa);
+    compute_functions["sum_r_f32"] = reduce_r<float, Op::Sum>(isa);
+    compute_functions["sum_r_i32"] = reduce_r<int32_t, Op::Sum>(isa);
+    compute_functions["sum_r_i64"] = reduce_r<int64_t, Op::Sum>(isa);
+    compute_functions["sum_r_f16"] = reduce_r<float, Op::Sum, float16>(isa);
+    compute_functions["sum_r_bf16"] = reduce_r<float, Op::Sum, bfloat16>(isa);
+    compute_functions["mean_r_f32"] = reduce_r<float, Op::Mean>(isa);
+    compute_functions["mean_r_f16"] = reduce_r<float, Op::Mean, float16>(isa);
+    compute_functions["mean_r_bf16"] = reduce_r<float, Op::Mean, bfloat16>(isa);
+    compute_functions["max_r_f32"] = reduce_r<float, Op::Max>(isa);
+    compute_functions["max_r_i32"] = reduce_r<int32_t, Op::Max>(isa);
+    compute_functions["max_r_i64"] = reduce_r<int64_t, Op::Max>(isa);
+    compute_functions["max_r_f16"] = reduce_r<float, Op::Max, float16>(isa);
+    compute_functions["max_r_bf16"] = reduce_r<float, Op::Max, bfloat16>(isa);
+    compute_functions["min_r_f32"] = reduce_r<float, Op::Min>(isa);
+    compute_functions["min_r_i32"] = reduce_r<int32_t, Op::Min>(isa);
+    compute_functions["min_r_i64"] = reduce_r<int64_t, Op::Min>(isa);
+    compute_functions["min_r_f16"] = reduce_r<float, Op::Min, float16>(isa);
+    compute_functions["min_r_bf16"] = reduce_r<float, Op::Min, bfloat16>(isa);
+    compute_functions["argmax_r_f32"] = reduce_r<float, Op::ArgMax>(isa);
+    compute_functions["argmax_r_i32"] = reduce_r<int32_t, Op::ArgMax>(isa);
+    compute_functions["argmax_r_i64"] = reduce_r<int64_t, Op::ArgMax>(isa);
+    compute_functions["argmax_r_f16"] = reduce_r<float, Op::ArgMax, float16>(isa);
+    compute_functions["argmax_r_bf16"] = reduce_r<float, Op::ArgMax, bfloat16>(isa);
+    compute_functions["softmax_r_f32"] = softmax_r(isa, false);
+    compute_functions["softmax_r_f16"] = softmax_r<float16>(isa, false);
+    compute_functions["softmax_r_bf16"] = softmax_r<bfloat16>(isa, false);
+    compute_functions["log_softmax_r_f32"] = softmax_r(isa, true);
+    compute_functions["log_softmax_r_f16"] = softmax_r<float16>(isa, true);
+    compute_functions["log_softmax_r_bf16"] = softmax_r<bfloat16>(isa, true);
+    compute_functions["rms_norm_r_f32"] = norm_r<false>(isa);
+    compute_functions["rms_norm_r_f16"] = norm_r<false, float16>(isa);
+    compute_functions["rms_norm_r_bf16"] = norm_r<false, bfloat16>(isa);
+    compute_functions["layer_norm_r_f32"] = norm_r<true>(isa);
+    compute_functions["layer_norm_r_f16"] = norm_r<true, float16>(isa);
+    compute_functions["layer_norm_r_bf16"] = norm_r<true, bfloat16>(isa);
+    // Outside a graph nodes run once, bound as they go
+    std::map<std::string, kernel_binder> binders;
+    register_binders(binders);
+    for (auto& [name, binder] : binders)
+        compute_functions[name] = bound_per_call(binder);
+}
+
+} // namespace tensorlib::cpu
@@ -0,0 +1,80 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utils.hpp>
+
+namespace tensorlib {
+
+inline std::shared_ptr<MappedFile> MappedFile::open(const std::string& path,
+                                                    Mode mode) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open " + path + ": "
+                + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + path + ": "
+                + std::strerror(error));
+    }
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->path_ = path;
+    file->mode_ = mode;
+    file->size_ = st.st_size;
+    // Nothing to map, an empty file stays without memory
+    if (file->size_) {
+        int prot = mode == Mode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+        int flags = mode == Mode::ReadOnly ? MAP_SHARED : MAP_PRIVATE;
+        void* bytes = mmap(nullptr, file->size_, prot, flags, fd, 0);
+        if (bytes == MAP_FAILED) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Could not map " + path + ": "
+                    + std::strerror(error));
+        }
+        file->bytes_ = static_cast<uint8_t*>(bytes);
+    }
+    // The mapping holds on to the file by itself
+    ::close(fd);
+    VOUT << "Mapped " << file->size_ << " bytes of " << path << std::endl;
+    return file;
+}
+
+inline MappedFile::~MappedFile() {
+    if (bytes_) munmap(bytes_, size_);
+}
+
+inline void MappedFile::advise(Advice advice, size_t offset, size_t length) {
+    if (offset >= size_) return;
+    length = std::min(length, size_ - offset);
+    // madvise wants page aligned addresses
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page * page;
+    int hint = MADV_NORMAL;
+    switch (advice) {
+        case Advice::Normal: hint = MADV_NORMAL; break;
+        case Advice::Sequential: hint = MADV_SEQUENTIAL; break;
+        case Advice::Random: hint = MADV_RANDOM; break;
+        case Advice::WillNeed: hint = MADV_WILLNEED; break;
+        case Advice::DontNeed: hint = MADV_DONTNEED; break;
+    }
+    // Only a hint, failing to give it changes nothing
+    if (madvise(bytes_ + begin, offset + length - begin, hint) != 0)
+        VOUT << "madvise on " << path_ << " failed: "
+             << std::strerror(errno) << std::endl;
+}
+
+inline Storage MappedFile::storage(size_t offset, size_t bytes) {
+    if (offset > size_ || bytes > size_ - offset)
+        throw std::runtime_error("Range " + std::to_string(offset) + "+"
+                + std::to_string(bytes) + " past the end of " + path_);
+    return Storage::external(bytes_ + offset, bytes, shared_from_this());
+}
+
+} // namespace tensorlib
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tensorlib {
+
+MemoryPlan plan_memory(Graph& graph, const std::vector<Tensor*>& subgraph) {
+    constexpr size_t alignment = 64;
+    MemoryPlan plan;
+    plan.offsets.assign(graph.size(), MemoryPlan::unplanned);
+
+    // Tensors gone once the realization is over. Computed tensors
+    // release their parents, orphans left without consumers are
+    // dropped and release theirs. Users first, so every claim on a
+    // tensor is settled by the time it is looked at.
+    std::unordered_set<const Tensor*> computed;
+    for (uint32_t i = 0; i < graph.size(); ++i)
+        if (graph.nodes[i].op != Op::Load)
+            computed.insert(graph.tensors[i]);
+    std::unordered_map<const Tensor*, int> released;
+    std::unordered_set<const Tensor*> gone;
+    for (auto it = subgraph.rbegin(); it != subgraph.rend(); ++it) {
+        Tensor* t = *it;
+        bool dropped = t->orphan && t->context.consumers == released[t];
+        if (dropped) gone.insert(t);
+        if (!dropped && !computed.count(t)) continue;
+        for (auto& parent : t->context.parents) {
+            auto entry = global_tensor_map.find(parent);
+            if (entry != global_tensor_map.end() && entry->second)
+                released[entry->second.get()]++;
+        }
+    }
+
+    // Views read their input's memory, their readers are its readers.
+    // Memory viewed by a tensor that outlives the realization has to
+    // outlive it too, it can't be in the slab.
+    GraphUsers users = graph_users(graph);
+    std::vector<std::vector<uint32_t>> readers(graph.size());
+    std::vector<bool> pinned(graph.size(), false);
+    for (uint32_t i = graph.size(); i-- > 0;) {
+        for (uint32_t user : users.of(i)) {
+            readers[i].push_back(user);
+            if (graph.nodes[user].op != Op::View) continue;
+            readers[i].insert(readers[i].end(), readers[user].begin(), readers[user].end());
+            if (pinned[user] || user == graph.root || !gone.count(graph.tensors[user]))
+                pinned[i] = true;
+        }
+    }
+
+    // Intermediates live from their node to their last reader
+    std::vector<std::vector<uint32_t>> expiring(graph.size());
+    std::vector<size_t> sizes(graph.size(), 0);
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        if (graph.nodes[i].op == Op::Load || graph.nodes[i].op == Op::View) continue;
+        Tensor* t = graph.tensors[i];
+        if (i == graph.root || !gone.count(t) || pinned[i] || t->get_mem_size() != 0
+                || t->context.device->name() != "cpu") {
+            plan.output_bytes += t->nbytes();
+            continue;
+        }
+        plan.intermediate_bytes += t->nbytes();
+        sizes[i] = (t->nbytes() + alignment - 1) / alignment * alignment;
+        uint32_t last = i;
+        for (uint32_t reader : readers[i]) last = std::max(last, reader);
+        expiring[last].push_back(i);
+    }
+
+    // Free ranges by offset, with the nodes whose readers must be done
+    // before someone else writes there
+    struct range {
+        size_t size;
+        std::vector<uint32_t> readers;
+    };
+    std::map<size_t, range> free;
+    size_t top = 0;
+    auto take = [&](uint32_t i) {
+        size_t size = sizes[i];
+        auto claim = [&](std::map<size_t, range>::iterator it) {
+            for (uint32_t reader : it->second.readers)
+                graph.waits.push_back({i, reader});
+            size_t offset = it->first;
+            if (it->second.size > size)
+                free[offset + size] = range{it->second.size - size,
+                                            it->second.readers};
+            free.erase(it);
+            return offset;
+        };
+        for (auto it = free.begin(); it != free.end(); ++it)
+            if (it->second.size >= size)
+                return claim(it);
+        // Grow the slab, through the range at its end if there is one
+        if (!free.empty()) {
+            auto last = std::prev(free.end());
+            if (last->first + last->second.size == top) {
+                top = last->first + size;
+                last->second.size = size;
+                return claim(last);
+            }
+        }
+        top += size;
+        return top - size;
+    };
+    auto give_back = [&](uint32_t i) {
+        range r{sizes[i], {i}};
+        r.readers.insert(r.readers.end(), readers[i].begin(), readers[i].end());
+        size_t offset = plan.offsets[i];
+        auto next = free.lower_bound(offset);
+        if (next != free.end() && offset + r.size == next->first) {
+            r.size += next->second.size;
+            r.readers.insert(r.readers.end(), next->second.readers.begin(),
+                    next->second.readers.end());
+            next = free.erase(next);
+        }
+        if (next != free.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second.size == offset) {
+                offset = prev->first;
+                r.size += prev->second.size;
+                r.readers.insert(r.readers.end(), prev->second.readers.begin(),
+                        prev->second.readers.end());
+                free.erase(prev);
+            }
+        }
+        std::sort(r.readers.begin(), r.readers.end());
+        r.readers.erase(std::unique(r.readers.begin(), r.readers.end()),
+                r.readers.end());
+        free[offset] = std::move(r);
+    };
+    // Schedule order, a result is placed before the ranges its own
+    // inputs free up come back, kernels never write over what they read
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        if (sizes[i]) plan.offsets[i] = take(i);
+        for (uint32_t expired : expiring[i]) give_back(expired);
+    }
+    plan.slab_bytes = top;
+
+    std::sort(graph.waits.begin(), graph.waits.end());
+    graph.waits.erase(std::unique(graph.waits.begin(), graph.waits.end()),
+            graph.waits.end());
+    VOUT << "Memory plan: " << plan.intermediate_bytes
+         << " bytes of intermediates in a " << plan.slab_bytes
+         << " byte slab, " << plan.output_bytes << " bytes of results"
+         << std::endl;
+    return plan;
+}
+
+} // namespace tensorlib
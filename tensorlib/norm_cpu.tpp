@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <thread_pool.hpp>
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *    Normalization
+ * ---------------------- */
+//
+// RMSNorm and LayerNorm over rows of n, a row at a time: one pass for
+// its statistics, one scaling it into the result, the row still in
+// L1/L2 from the first. LayerNorm's variance comes from the same pass
+// as its mean, both taken of x - x[0] so a large mean doesn't cancel
+// the variance away.
+
+// One row of n > 0 floats, centered for LayerNorm. F is float, vector
+// types of a dependent one only.
+template <typename F, size_t width, bool centered>
+TL_INLINE void norm_loop(const F* x, const F* w, const F* b, F* out, size_t n, F eps) {
+    typedef F vec __attribute__((vector_size(width)));
+    constexpr size_t lanes = width / sizeof(F);
+    F shift = centered ? x[0] : 0;
+    vec sum[2] = {}, squares[2] = {};
+    size_t i = 0;
+    for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        vec v[2];
+        std::memcpy(v, x + i, sizeof(v));
+        for (int k = 0; k < 2; ++k) {
+            v[k] = v[k] - shift;
+            if constexpr (centered) sum[k] += v[k];
+            squares[k] += v[k] * v[k];
+        }
+    }
+    sum[0] += sum[1];
+    squares[0] += squares[1];
+    F s = 0, sq = 0;
+    for (size_t l = 0; l < lanes; ++l) {
+        s += sum[0][l];
+        sq += squares[0][l];
+    }
+    for (; i < n; ++i) {
+        F d = x[i] - shift;
+        s += d;
+        sq += d * d;
+    }
+    F mean = s / n;
+    // Variance of x, or mean of its squares for RMSNorm
+    F var = centered ? std::max(F(0), sq / n - mean * mean) : sq / n;
+    F scale = 1 / std::sqrt(var + eps);
+    // Shifted again before scaling, x * scale alone would lose the
+    // spread of a row far off zero
+    for (i = 0; i + lanes <= n; i += lanes) {
+        vec v, vw, r;
+        std::memcpy(&v, x + i, width);
+        std::memcpy(&vw, w + i, width);
+        if constexpr (centered) {
+            vec vb;
+            std::memcpy(&vb, b + i, width);
+            r = (v - shift - mean) * scale * vw + vb;
+        } else {
+            r = v * scale * vw;
+        }
+        std::memcpy(out + i, &r, width);
+    }
+    for (; i < n; ++i) {
+        if constexpr (centered)
+            out[i] = (x[i] - shift - mean) * scale * w[i] + b[i];
+        else
+            out[i] = x[i] * scale * w[i];
+    }
+}
+
+using norm_fn = void (*)(const float*, const float*, const float*, float*, size_t, float);
+
+template <bool centered>
+void norm_generic(const float* x, const float* w, const float* b, float* out,
+                  size_t n, float eps) {
+    norm_loop<float, 16, centered>(x, w, b, out, n, eps);
+}
+
+#ifdef TENSORLIB_X86
+template <bool centered>
+TL_TARGET_AVX2 void norm_avx2(const float* x, const float* w, const float* b, float* out,
+                              size_t n, float eps) {
+    norm_loop<float, 32, centered>(x, w, b, out, n, eps);
+}
+
+template <bool centered>
+TL_TARGET_AVX512 void norm_avx512(const float* x, const float* w, const float* b, float* out,
+                                  size_t n, float eps) {
+    norm_loop<float, 64, centered>(x, w, b, out, n, eps);
+}
+#endif
+
+template <bool centered>
+norm_fn norm_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512) return norm_avx512<centered>;
+    if (isa == ISA::AVX2) return norm_avx2<centered>;
+#endif
+    return norm_generic<centered>;
+}
+
+// RMSNorm and LayerNorm of the rows of a dense input, the "rms_norm_r_"
+// and "layer_norm_r_" kernels. Inputs are x, the weight, and for
+// LayerNorm the bias, both of n. Halves are widened a row at a time,
+// weight and bias once.
+// params - {rows, n, bits of the f32 eps}
+template <bool centered, typename S = float>
+kernel_fn norm_r(ISA isa) {
+    norm_fn loop = norm_for<centered>(isa);
+    convert_fn<S, float> widen = nullptr;
+    convert_fn<float, S> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, float>) {
+        widen = convert_for<S, float>(isa);
+        narrow = convert_for<float, S>(isa);
+    }
+    return [loop, widen, narrow](const std::vector<const uint8_t*>& inputs,
+                                 uint8_t* result,
+                                 size_t,
+                                 const std::vector<int>& params) {
+        size_t rows = params.at(0), n = params.at(1);
+        float eps;
+        std::memcpy(&eps, &params.at(2), sizeof(eps));
+        if (rows == 0 || n == 0) return;
+        const S* x = reinterpret_cast<const S*>(inputs[0]);
+        const S* w = reinterpret_cast<const S*>(inputs[1]);
+        const S* b = centered ? reinterpret_cast<const S*>(inputs[2]) : nullptr;
+        S* r = reinterpret_cast<S*>(result);
+        std::vector<float> wide_w, wide_b;
+        if constexpr (!std::is_same_v<S, float>) {
+            wide_w.resize(n);
+            widen(w, wide_w.data(), n);
+            if (centered) {
+                wide_b.resize(n);
+                widen(b, wide_b.data(), n);
+            }
+        }
+        ThreadPool::global().parallel_for(rows, std::max<size_t>(1, (1 << 14) / n),
+                [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                if constexpr (std::is_same_v<S, float>) {
+                    loop(x + row * n, w, b, r + row * n, n, eps);
+                } else {
+                    thread_local std::vector<float> wide;
+                    wide.resize(n);
+                    widen(x + row * n, wide.data(), n);
+                    loop(wide.data(), wide_w.data(), wide_b.data(), wide.data(), n, eps);
+                    narrow(wide.data(), r + row * n, n);
+                }
+            }
+        });
+    };
+}
+
+} // namespace tensorlib::cpu
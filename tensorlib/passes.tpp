@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+namespace tensorlib {
+
+size_t eliminate_common_subexpressions(Graph& graph) {
+    auto mix = [](size_t seed, size_t v) {
+        return seed ^ (v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    };
+    auto node_hash = [&](uint32_t i) {
+        size_t h = static_cast<size_t>(graph.nodes[i].op);
+        h = mix(h, graph.nodes[i].dtype);
+        h = mix(h, std::hash<const void*>()(graph.tensors[i]->context.device));
+        for (uint32_t in : graph.inputs_of(i)) h = mix(h, in);
+        for (int d : graph.shape_of(i)) h = mix(h, d);
+        for (int p : graph.params_of(i)) h = mix(h, p);
+        return h;
+    };
+    auto same = [&](uint32_t i, uint32_t j) {
+        auto eq = [](auto a, auto b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end());
+        };
+        return graph.nodes[i].op == graph.nodes[j].op
+            && graph.nodes[i].dtype == graph.nodes[j].dtype
+            && graph.tensors[i]->context.device == graph.tensors[j]->context.device
+            && eq(graph.inputs_of(i), graph.inputs_of(j))
+            && eq(graph.shape_of(i), graph.shape_of(j))
+            && eq(graph.params_of(i), graph.params_of(j));
+    };
+
+    std::vector<uint32_t> replace(graph.size());
+    std::unordered_multimap<size_t, uint32_t> seen;
+    size_t merged = 0;
+    // Topological order, so inputs are settled before their users are
+    // hashed and merges cascade: two (a + b) * c collapse fully.
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        replace[i] = i;
+        IRNode& node = graph.nodes[i];
+        if (node.op == Op::Load) continue;
+        uint32_t* in = graph.inputs.data() + node.inputs;
+        for (uint32_t k = 0; k < node.ninputs; ++k)
+            in[k] = replace[in[k]];
+        // b + a is a + b
+        if ((node.op == Op::Add || node.op == Op::Mul) && in[1] < in[0])
+            std::swap(in[0], in[1]);
+        // The root has to be computed in any case. Views cost nothing,
+        // a merged one would be copied as if it were dense.
+        if (i == graph.root || node.op == Op::View) continue;
+
+        size_t h = node_hash(i);
+        auto [first, last] = seen.equal_range(h);
+        for (auto it = first; it != last; ++it) {
+            if (!same(it->second, i)) continue;
+            replace[i] = it->second;
+            break;
+        }
+        if (replace[i] == i) {
+            seen.emplace(h, i);
+            continue;
+        }
+        Tensor& dup = *graph.tensors[i];
+        Tensor& kept = *graph.tensors[replace[i]];
+        kept.context.consumers++;
+        std::vector<std::string> parents = {kept.tuid()};
+        std::swap(parents, dup.context.parents);
+        // Can only drop other merged duplicates, whatever is kept
+        // still has a user in the graph.
+        for (auto& parent : parents)
+            Tensor::release_consumer(parent);
+        dup.context.op = Op::Copy;
+        dup.context.params.clear();
+        ++merged;
+    }
+    if (merged == 0) return 0;
+    VOUT << "CSE merged " << merged << " of " << graph.size()
+         << " nodes" << std::endl;
+    graph = graph.rewrite(replace);
+    return merged;
+}
+
+size_t fuse_elementwise(Graph& graph) {
+    auto fusable = [&](uint32_t i) {
+        Op op = graph.nodes[i].op;
+        // Binops with params read strided or broadcast inputs, fused
+        // programs read every input densely
+        bool dense = op == Op::Fused || graph.params_of(i).empty();
+        return (op == Op::Add || op == Op::Sub || op == Op::Mul
+                || op == Op::Div || op == Op::Fused)
+            && dense && graph.tensors[i]->context.device->name() == "cpu";
+    };
+    GraphUsers users = graph_users(graph);
+    // Folded into its only user
+    std::vector<bool> folded(graph.size(), false);
+    size_t count = 0;
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        auto user = users.of(i);
+        if (i == graph.root || !fusable(i) || user.size() != 1
+                || !fusable(user[0])) continue;
+        auto a = graph.shape_of(i), b = graph.shape_of(user[0]);
+        if (graph.nodes[i].dtype != graph.nodes[user[0]].dtype
+                || !std::equal(a.begin(), a.end(), b.begin(), b.end()))
+            continue;
+        folded[i] = true;
+        ++count;
+    }
+    if (count == 0) return 0;
+
+    // Postfix program of node i, folded inputs are spliced in
+    std::vector<uint32_t> inputs;
+    std::vector<int> program;
+    auto emit_input = [&](uint32_t in) {
+        auto found = std::find(inputs.begin(), inputs.end(), in);
+        program.push_back(static_cast<int>(found - inputs.begin()));
+        if (found == inputs.end()) inputs.push_back(in);
+    };
+    // Without recursion, a folded chain can be as long as the graph
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    auto emit = [&](uint32_t root) {
+        stack.assign(1, {root, 0});
+        while (!stack.empty()) {
+            auto [i, k] = stack.back();
+            auto node_inputs = graph.inputs_of(i);
+            if (graph.nodes[i].op == Op::Fused) {
+                // Already a program, over its own inputs
+                for (int code : graph.params_of(i)) {
+                    if (code < 0) program.push_back(code);
+                    else emit_input(node_inputs[code]);
+                }
+                stack.pop_back();
+                continue;
+            }
+            if (k == node_inputs.size()) {
+                program.push_back(fused_op(graph.nodes[i].op));
+                stack.pop_back();
+                continue;
+            }
+            stack.back().second++;
+            if (folded[node_inputs[k]]) stack.push_back({node_inputs[k], 0});
+            else emit_input(node_inputs[k]);
+        }
+    };
+
+    std::vector<uint32_t> replace(graph.size());
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        replace[i] = folded[i] ? Graph::dropped : i;
+        if (folded[i] || !fusable(i)) continue;
+        bool chain = false;
+        for (uint32_t in : graph.inputs_of(i)) chain |= folded[in];
+        if (!chain) continue;
+        inputs.clear();
+        program.clear();
+        emit(i);
+        IRNode& node = graph.nodes[i];
+        node.op = Op::Fused;
+        node.inputs = static_cast<uint32_t>(graph.inputs.size());
+        node.ninputs = static_cast<uint32_t>(inputs.size());
+        graph.inputs.insert(graph.inputs.end(), inputs.begin(), inputs.end());
+        node.params = static_cast<uint32_t>(graph.params.size());
+        node.nparams = static_cast<uint32_t>(program.size());
+        graph.params.insert(graph.params.end(), program.begin(), program.end());
+    }
+    VOUT << "Fused " << count << " elementwise nodes into their users"
+         << std::endl;
+    graph = graph.rewrite(replace);
+    return count;
+}
+
+} // namespace tensorlib
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <quant.hpp>
+#include <thread_pool.hpp>
+
+#ifdef TENSORLIB_X86
+    #include <immintrin.h>
+#endif
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *  Quantized matmul
+ * ---------------------- */
+//
+// C[M, N] = A[M, K] * W[N, K]^T, A in f32 and W block quantized, a row
+// per output as in GGUF. A is quantized to int8 blocks of its own on
+// the way in, so every pair of blocks is an integer dot product,
+// scaled by both block scales as it is added up. Weights never exist
+// as floats, they are streamed in their packed form.
+
+// Activations of one row, quantized like q8_0 with float scales.
+// sums are the quant sums (for q4_0's offset), fsums the float sums
+// (for q4_1's minimum).
+struct quantized_rows {
+    std::vector<int8_t> q;
+    std::vector<float> d;
+    std::vector<int32_t> sums;
+    std::vector<float> fsums;
+};
+
+inline void quantize_activations(const float* A, int M, int K, quantized_rows& rows) {
+    size_t nblocks = (size_t)M * K / quant_block;
+    rows.q.resize((size_t)M * K);
+    rows.d.resize(nblocks);
+    rows.sums.resize(nblocks);
+    rows.fsums.resize(nblocks);
+    ThreadPool::global().parallel_for(nblocks, 256, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            const float* x = A + b * quant_block;
+            int8_t* q = rows.q.data() + b * quant_block;
+            float amax = 0, fsum = 0;
+            for (size_t i = 0; i < quant_block; ++i) {
+                amax = std::max(amax, std::fabs(x[i]));
+                fsum += x[i];
+            }
+            float d = amax / 127;
+            float inv = d ? 1 / d : 0;
+            int32_t sum = 0;
+            for (size_t i = 0; i < quant_block; ++i) {
+                q[i] = int8_t(std::nearbyint(x[i] * inv));
+                sum += q[i];
+            }
+            rows.d[b] = d;
+            rows.sums[b] = sum;
+            rows.fsums[b] = fsum;
+        }
+    });
+}
+
+// Dot product of a weight row with an activation row, nblocks blocks
+template <typename Block>
+using qdot_fn = float (*)(const Block* w, const int8_t* q, const float* d,
+                          const int32_t* sums, const float* fsums, int nblocks);
+
+template <typename Block>
+float qdot_generic(const Block* w, const int8_t* q, const float* d,
+                   const int32_t* sums, const float* fsums, int nblocks) {
+    constexpr int half = quant_block / 2;
+    float total = 0;
+    for (int b = 0; b < nblocks; ++b, q += quant_block) {
+        int32_t dot = 0;
+        float scale = fp16_to_fp32(w[b].d) * d[b];
+        if constexpr (std::is_same_v<Block, block_q8_0>) {
+            for (size_t i = 0; i < quant_block; ++i)
+                dot += w[b].qs[i] * q[i];
+            total += scale * dot;
+        } else {
+            for (int i = 0; i < half; ++i)
+                dot += (w[b].qs[i] & 0xf) * q[i] + (w[b].qs[i] >> 4) * q[i + half];
+            if constexpr (std::is_same_v<Block, block_q4_0>)
+                total += scale * (dot - 8 * sums[b]);
+            else
+                total += scale * dot + fp16_to_fp32(w[b].m) * fsums[b];
+        }
+    }
+    return total;
+}
+
+#ifdef TENSORLIB_X86
+#define TL_TARGET_QDOT_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define TL_TARGET_QDOT_VNNI \
+    __attribute__((target("avx2,fma,f16c,avx512f,avx512vl,avx512bw,avx512vnni")))
+
+// 32 quants of a block as unsigned bytes, in element order
+template <typename Block>
+TL_TARGET_QDOT_AVX2 TL_INLINE __m256i unpack_q4(const Block& w) {
+    __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w.qs));
+    __m128i mask = _mm_set1_epi8(0xf);
+    __m128i lo = _mm_and_si128(packed, mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+    return _mm256_set_m128i(hi, lo);
+}
+
+TL_TARGET_QDOT_AVX2 TL_INLINE float hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+// Unsigned and signed operands of a block's dot product with the
+// activations a. Signed by signed for q8_0: the weight's sign moves
+// over to the activation, |w| is unsigned (|-128| stays 128 as a u8).
+template <typename Block>
+TL_TARGET_QDOT_AVX2 TL_INLINE void block_operands(const Block& w, __m256i a,
+                                                  __m256i& u, __m256i& s) {
+    if constexpr (std::is_same_v<Block, block_q8_0>) {
+        __m256i wq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w.qs));
+        u = _mm256_sign_epi8(wq, wq);
+        s = _mm256_sign_epi8(a, wq);
+    } else {
+        u = unpack_q4(w);
+        s = a;
+    }
+}
+
+// What a block adds besides its products
+template <typename Block>
+TL_TARGET_QDOT_AVX2 TL_INLINE float block_offset(const Block& w, float scale,
+                                                 int32_t sum, float fsum) {
+    if constexpr (std::is_same_v<Block, block_q4_0>)
+        return -scale * 8 * sum;
+    else if constexpr (std::is_same_v<Block, block_q4_1>)
+        return _cvtsh_ss(w.m) * fsum;
+    else
+        return 0;
+}
+
+// Integer dots go through pmaddubsw and pmaddwd here, pairs of
+// products add up in int16. The operands are small enough for them
+// not to saturate.
+template <typename Block>
+TL_TARGET_QDOT_AVX2 float qdot_avx2(const Block* w, const int8_t* q, const float* d,
+                                    const int32_t* sums, const float* fsums, int nblocks) {
+    __m256 acc = _mm256_setzero_ps();
+    float offset = 0;
+    for (int b = 0; b < nblocks; ++b, q += quant_block) {
+        __m256i u, s;
+        block_operands(w[b], _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q)), u, s);
+        __m256i dot = _mm256_madd_epi16(_mm256_maddubs_epi16(u, s), _mm256_set1_epi16(1));
+        float scale = _cvtsh_ss(w[b].d) * d[b];
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(scale), _mm256_cvtepi32_ps(dot), acc);
+        offset += block_offset(w[b], scale, sums[b], fsums[b]);
+    }
+    return hsum(acc) + offset;
+}
+
+// Same with vpdpbusd, one instruction per block
+template <typename Block>
+TL_TARGET_QDOT_VNNI float qdot_vnni(const Block* w, const int8_t* q, const float* d,
+                                    const int32_t* sums, const float* fsums, int nblocks) {
+    __m256 acc = _mm256_setzero_ps();
+    float offset = 0;
+    for (int b = 0; b < nblocks; ++b, q += quant_block) {
+        __m256i u, s;
+        block_operands(w[b], _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q)), u, s);
+        __m256i dot = _mm256_dpbusd_epi32(_mm256_setzero_si256(), u, s);
+        float scale = _cvtsh_ss(w[b].d) * d[b];
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(scale), _mm256_cvtepi32_ps(dot), acc);
+        offset += block_offset(w[b], scale, sums[b], fsums[b]);
+    }
+    return hsum(acc) + offset;
+}
+#endif
+
+// VNNI comes with AVX-512 here, TENSORLIB_ISA below avx512 turns it off
+inline bool host_vnni() {
+    static const bool vnni = [] {
+#ifdef TENSORLIB_X86
+        __builtin_cpu_init();
+        return host_isa() == ISA::AVX512
+            && __builtin_cpu_supports("avx512vnni")
+            && __builtin_cpu_supports("avx512vl")
+            && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("f16c");
+#else
+        return false;
+#endif
+    }();
+    return vnni;
+}
+
+template <typename Block>
+qdot_fn<Block> qdot_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512 && host_vnni())
+        return qdot_vnni<Block>;
+    if (isa >= ISA::AVX2 && __builtin_cpu_supports("f16c"))
+        return qdot_avx2<Block>;
+#endif
+    return qdot_generic<Block>;
+}
+
+// Quantized weights, the "_m_" kernels named after them.
+// params - {M, K, N}
+template <typename Block>
+kernel_fn matmul_q(ISA isa) {
+    qdot_fn<Block> dot = qdot_for<Block>(isa);
+    return [dot](const std::vector<const uint8_t*>& inputs,
+                 uint8_t* result,
+                 size_t mem_size,
+                 const std::vector<int>& params) {
+        int M = params.at(0), K = params.at(1), N = params.at(2);
+        const float* A = reinterpret_cast<const float*>(inputs[0]);
+        const Block* W = reinterpret_cast<const Block*>(inputs[1]);
+        float* C = reinterpret_cast<float*>(result);
+        int nblocks = K / quant_block;
+        // Per call: a thread waiting on the workers below may run
+        // another node meanwhile, which must not touch these rows
+        quantized_rows rows;
+        quantize_activations(A, M, K, rows);
+        // Weight rows split among threads, each chunk stays in cache
+        // while every activation row goes over it. With a single row,
+        // as when generating tokens, the weights are read exactly once.
+        ThreadPool::global().parallel_for(N, 16, [&](size_t begin, size_t end) {
+            for (int m = 0; m < M; ++m) {
+                size_t a = (size_t)m * nblocks;
+                for (size_t n = begin; n < end; ++n)
+                    C[(size_t)m * N + n] = dot(W + n * nblocks,
+                            rows.q.data() + a * quant_block, rows.d.data() + a,
+                            rows.sums.data() + a, rows.fsums.data() + a, nblocks);
+            }
+        });
+    };
+}
+
+} // namespace tensorlib::cpu
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cmath>
+
+namespace tensorlib {
+
+inline void quantize_row_q8_0(const float* x, void* blocks, size_t n) {
+    block_q8_0* out = static_cast<block_q8_0*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        float amax = 0;
+        for (size_t i = 0; i < quant_block; ++i)
+            amax = std::max(amax, std::fabs(x[i]));
+        float d = amax / 127;
+        float inv = d ? 1 / d : 0;
+        out[b].d = fp32_to_fp16(d);
+        for (size_t i = 0; i < quant_block; ++i)
+            out[b].qs[i] = int8_t(std::nearbyint(x[i] * inv));
+    }
+}
+
+inline void quantize_row_q4_0(const float* x, void* blocks, size_t n) {
+    block_q4_0* out = static_cast<block_q4_0*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        // The value furthest from 0 maps to -8, keeping its sign
+        float extreme = 0;
+        for (size_t i = 0; i < quant_block; ++i)
+            if (std::fabs(x[i]) > std::fabs(extreme)) extreme = x[i];
+        float d = extreme / -8;
+        float inv = d ? 1 / d : 0;
+        out[b].d = fp32_to_fp16(d);
+        auto q = [&](float v) {
+            return uint8_t(std::clamp<int>(std::nearbyint(v * inv) + 8, 0, 15));
+        };
+        for (size_t i = 0; i < quant_block / 2; ++i)
+            out[b].qs[i] = q(x[i]) | q(x[i + quant_block / 2]) << 4;
+    }
+}
+
+inline void quantize_row_q4_1(const float* x, void* blocks, size_t n) {
+    block_q4_1* out = static_cast<block_q4_1*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        float lo = x[0], hi = x[0];
+        for (size_t i = 1; i < quant_block; ++i) {
+            lo = std::min(lo, x[i]);
+            hi = std::max(hi, x[i]);
+        }
+        float d = (hi - lo) / 15;
+        float inv = d ? 1 / d : 0;
+        out[b].d = fp32_to_fp16(d);
+        out[b].m = fp32_to_fp16(lo);
+        auto q = [&](float v) {
+            return uint8_t(std::clamp<int>(std::nearbyint((v - lo) * inv), 0, 15));
+        };
+        for (size_t i = 0; i < quant_block / 2; ++i)
+            out[b].qs[i] = q(x[i]) | q(x[i + quant_block / 2]) << 4;
+    }
+}
+
+inline void dequantize_row_q8_0(const void* blocks, float* x, size_t n) {
+    const block_q8_0* in = static_cast<const block_q8_0*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        float d = fp16_to_fp32(in[b].d);
+        for (size_t i = 0; i < quant_block; ++i)
+            x[i] = d * in[b].qs[i];
+    }
+}
+
+inline void dequantize_row_q4_0(const void* blocks, float* x, size_t n) {
+    const block_q4_0* in = static_cast<const block_q4_0*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        float d = fp16_to_fp32(in[b].d);
+        for (size_t i = 0; i < quant_block / 2; ++i) {
+            x[i] = d * ((in[b].qs[i] & 0xf) - 8);
+            x[i + quant_block / 2] = d * ((in[b].qs[i] >> 4) - 8);
+        }
+    }
+}
+
+inline void dequantize_row_q4_1(const void* blocks, float* x, size_t n) {
+    const block_q4_1* in = static_cast<const block_q4_1*>(blocks);
+    for (size_t b = 0; b < n / quant_block; ++b, x += quant_block) {
+        float d = fp16_to_fp32(in[b].d);
+        float m = fp16_to_fp32(in[b].m);
+        for (size_t i = 0; i < quant_block / 2; ++i) {
+            x[i] = d * (in[b].qs[i] & 0xf) + m;
+            x[i + quant_block / 2] = d * (in[b].qs[i] >> 4) + m;
+        }
+    }
+}
+
+inline quantize_row_fn quantize_row_for(const std::string& dtype) {
+    if (dtype == "q8_0") return quantize_row_q8_0;
+    if (dtype == "q4_0") return quantize_row_q4_0;
+    if (dtype == "q4_1") return quantize_row_q4_1;
+    return nullptr;
+}
+
+inline dequantize_row_fn dequantize_row_for(const std::string& dtype) {
+    if (dtype == "q8_0") return dequantize_row_q8_0;
+    if (dtype == "q4_0") return dequantize_row_q4_0;
+    if (dtype == "q4_1") return dequantize_row_q4_1;
+    return nullptr;
+}
+
+} // namespace tensorlib
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <thread_pool.hpp>
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *      Reductions
+ * ---------------------- */
+//
+// A dense input seen as (outer, n, inner), reduced over n. With
+// inner == 1 every output is a run of n elements: vector accumulators
+// go down the run and are folded horizontally at its end. Otherwise
+// every output is a column, and a tile of columns is accumulated a row
+// at a time: rows are read in order and every lane does useful work.
+// When the outputs alone can't keep every thread busy, the reduced dim
+// is split as well and the partials combined as a tree.
+
+enum class ReduceOp { Sum, Max, Min };
+
+// a = a op b, on scalars and vectors alike. By reference like apply.
+// A NaN on either side wins for max and min, whatever the lane, ISA
+// or split it was met in. Masks are or'ed, vectors have no ||.
+template <ReduceOp op, typename V>
+TL_INLINE void combine(V& a, const V& b) {
+    if constexpr (op == ReduceOp::Sum) a = a + b;
+    else if constexpr (op == ReduceOp::Max) a = (b > a) | (b != b) ? b : a;
+    else a = (b < a) | (b != b) ? b : a;
+}
+
+// Whether v takes over from the maximum so far for argmax: larger, or
+// the first NaN
+template <typename T>
+TL_INLINE bool takes_max(T v, T max) {
+    return v > max || (v != v && max == max);
+}
+
+// Where v is in [first, last), NaN matching NaN
+template <typename T>
+TL_INLINE const T* find_value(const T* first, const T* last, T v) {
+    if (v != v)
+        return std::find_if(first, last, [](T u) { return u != u; });
+    return std::find(first, last, v);
+}
+
+// Sums added as leaves of a binary tree as they come, pairwise
+// summation without recursion: partial[d] sums 2^k leaves, k falling
+// with d. Errors grow with log(n) rather than n.
+template <typename T>
+struct pairwise_sum {
+    T partial[64];
+    size_t depth = 0, count = 0;
+
+    void add(T s) {
+        for (size_t c = count++; c & 1; c >>= 1) s = partial[--depth] + s;
+        partial[depth++] = s;
+    }
+    T total() const {
+        if (depth == 0) return T(0);
+        T s = partial[depth - 1];
+        for (size_t d = depth - 1; d-- > 0;) s = partial[d] + s;
+        return s;
+    }
+};
+
+// Reduction of n > 0 elements, four vectors at a time
+template <typename T, size_t width, ReduceOp op>
+TL_INLINE T reduce_block(const T* x, size_t n) {
+    typedef T vec __attribute__((vector_size(width)));
+    constexpr size_t lanes = width / sizeof(T);
+    size_t i = 1;
+    T r = x[0];
+    if (n >= 4 * lanes) {
+        vec acc[4], v[4];
+        std::memcpy(acc, x, sizeof(acc));
+        for (i = 4 * lanes; i + 4 * lanes <= n; i += 4 * lanes) {
+            std::memcpy(v, x + i, sizeof(v));
+            for (int k = 0; k < 4; ++k) combine<op>(acc[k], v[k]);
+        }
+        combine<op>(acc[0], acc[1]);
+        combine<op>(acc[2], acc[3]);
+        combine<op>(acc[0], acc[2]);
+        r = acc[0][0];
+        for (size_t l = 1; l < lanes; ++l) combine<op>(r, T(acc[0][l]));
+    }
+    for (; i < n; ++i) combine<op>(r, x[i]);
+    return r;
+}
+
+// A run of n > 0 elements, sums block by block in a pairwise tree
+template <typename T, size_t width, ReduceOp op>
+TL_INLINE T reduce_loop(const T* x, size_t n) {
+    if constexpr (op != ReduceOp::Sum) {
+        return reduce_block<T, width, op>(x, n);
+    } else {
+        constexpr size_t block = 16 * width / sizeof(T);
+        pairwise_sum<T> sum;
+        for (size_t i = 0; i < n; i += block)
+            sum.add(reduce_block<T, width, op>(x + i, std::min(block, n - i)));
+        return sum.total();
+    }
+}
+
+// acc[j] = acc[j] op row[j] over n columns. Float sums carry a Kahan
+// compensation in comp, what the additions into acc rounded away.
+template <typename T, size_t width, ReduceOp op>
+TL_INLINE void accumulate_loop(T* acc, T* comp, const T* row, size_t n) {
+    typedef T vec __attribute__((vector_size(width)));
+    constexpr size_t lanes = width / sizeof(T);
+    constexpr bool kahan = op == ReduceOp::Sum && std::is_floating_point_v<T>;
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        vec a, r;
+        std::memcpy(&a, acc + i, width);
+        std::memcpy(&r, row + i, width);
+        if constexpr (kahan) {
+            vec c;
+            std::memcpy(&c, comp + i, width);
+            vec y = r - c;
+            vec t = a + y;
+            c = (t - a) - y;
+            a = t;
+            std::memcpy(comp + i, &c, width);
+        } else {
+            combine<op>(a, r);
+        }
+        std::memcpy(acc + i, &a, width);
+    }
+    for (; i < n; ++i) {
+        if constexpr (kahan) {
+            T y = row[i] - comp[i];
+            T t = acc[i] + y;
+            comp[i] = (t - acc[i]) - y;
+            acc[i] = t;
+        } else {
+            combine<op>(acc[i], row[i]);
+        }
+    }
+}
+
+template <typename T>
+using reduce_fn = T (*)(const T*, size_t);
+template <typename T>
+using accumulate_fn = void (*)(T*, T*, const T*, size_t);
+
+template <typename T, ReduceOp op>
+T reduce_generic(const T* x, size_t n) { return reduce_loop<T, 16, op>(x, n); }
+template <typename T, ReduceOp op>
+void accumulate_generic(T* acc, T* comp, const T* row, size_t n) {
+    accumulate_loop<T, 16, op>(acc, comp, row, n);
+}
+
+#ifdef TENSORLIB_X86
+template <typename T, ReduceOp op>
+TL_TARGET_AVX2 T reduce_avx2(const T* x, size_t n) { return reduce_loop<T, 32, op>(x, n); }
+template <typename T, ReduceOp op>
+TL_TARGET_AVX2 void accumulate_avx2(T* acc, T* comp, const T* row, size_t n) {
+    accumulate_loop<T, 32, op>(acc, comp, row, n);
+}
+
+template <typename T, ReduceOp op>
+TL_TARGET_AVX512 T reduce_avx512(const T* x, size_t n) { return reduce_loop<T, 64, op>(x, n); }
+template <typename T, ReduceOp op>
+TL_TARGET_AVX512 void accumulate_avx512(T* acc, T* comp, const T* row, size_t n) {
+    accumulate_loop<T, 64, op>(acc, comp, row, n);
+}
+#endif
+
+template <typename T, ReduceOp op>
+reduce_fn<T> reduce_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512) return reduce_avx512<T, op>;
+    if (isa == ISA::AVX2) return reduce_avx2<T, op>;
+#endif
+    return reduce_generic<T, op>;
+}
+
+template <typename T, ReduceOp op>
+accumulate_fn<T> accumulate_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512) return accumulate_avx512<T, op>;
+    if (isa == ISA::AVX2) return accumulate_avx2<T, op>;
+#endif
+    return accumulate_generic<T, op>;
+}
+
+// Reduction kernels, the "_r_" family, named after the dtype they
+// read: sum_r_f32, argmax_r_bf16. Halves are widened a tile at a time
+// and reduced in T. Mean is the sum over n, argmax the i64 index of
+// the first maximum.
+// params - {outer, n, inner}
+template <typename T, Op kind, typename S = T>
+kernel_fn reduce_r(ISA isa) {
+    constexpr ReduceOp op = kind == Op::Sum || kind == Op::Mean ? ReduceOp::Sum
+                          : kind == Op::Min ? ReduceOp::Min : ReduceOp::Max;
+    reduce_fn<T> run = reduce_for<T, op>(isa);
+    accumulate_fn<T> accumulate = accumulate_for<T, op>(isa);
+    convert_fn<S, T> widen = nullptr;
+    if constexpr (!std::is_same_v<S, T>) widen = convert_for<S, T>(isa);
+    return [run, accumulate, widen](const std::vector<const uint8_t*>& inputs,
+                                    uint8_t* result,
+                                    size_t,
+                                    const std::vector<int>& params) {
+        size_t outer = params.at(0), n = params.at(1), inner = params.at(2);
+        const S* x = reinterpret_cast<const S*>(inputs[0]);
+        auto write = [&](size_t i, T value, int64_t index) {
+            if constexpr (kind == Op::ArgMax) {
+                reinterpret_cast<int64_t*>(result)[i] = index;
+            } else {
+                if constexpr (kind == Op::Mean) value = value / T(n);
+                reinterpret_cast<S*>(result)[i] = S(value);
+            }
+        };
+        if (outer * inner == 0) return;
+        if (n == 0) {
+            // Only sums have an empty case
+            for (size_t i = 0; i < outer * inner; ++i) write(i, T(0), 0);
+            return;
+        }
+        auto& pool = ThreadPool::global();
+        size_t threads = pool.size() + 1;
+        // Parts of the reduced dim for groups of outputs, enough for
+        // every thread to have two when there are few groups
+        auto split = [&](size_t groups, size_t min_part) {
+            if (groups >= threads) return size_t(1);
+            size_t wanted = (2 * threads + groups - 1) / groups;
+            return std::max<size_t>(1, std::min(wanted, n / min_part));
+        };
+        // Partials of a group's parts, combined in order: a tree for
+        // sums, the first of equal maxima (or NaNs) for argmax
+        auto merge = [&](const T* values, const int64_t* indices, size_t parts,
+                         size_t stride, T& value, int64_t& index) {
+            pairwise_sum<T> sum;
+            value = values[0];
+            index = indices ? indices[0] : 0;
+            for (size_t s = 0; s < parts; ++s) {
+                T v = values[s * stride];
+                if constexpr (op == ReduceOp::Sum) {
+                    sum.add(v);
+                } else if constexpr (kind == Op::ArgMax) {
+                    if (takes_max(v, value)) {
+                        value = v;
+                        index = indices[s * stride];
+                    }
+                } else {
+                    combine<op>(value, v);
+                }
+            }
+            if constexpr (op == ReduceOp::Sum) value = sum.total();
+        };
+        constexpr size_t tile = 1024;
+
+        if (inner == 1) {
+            // Runs, a part of one in a task
+            size_t parts = split(outer, 1 << 14);
+            std::vector<T> values(outer * parts);
+            std::vector<int64_t> indices(kind == Op::ArgMax ? outer * parts : 0);
+            size_t part_len = n / parts;
+            pool.parallel_for(outer * parts, std::max<size_t>(1, (1 << 15) / part_len),
+                    [&](size_t begin, size_t end) {
+                T wide[tile];
+                for (size_t task = begin; task < end; ++task) {
+                    size_t row = task / parts, s = task % parts;
+                    size_t k0 = n * s / parts, k1 = n * (s + 1) / parts;
+                    const S* p = x + row * n + k0;
+                    T value = T(0);
+                    int64_t index = 0;
+                    if constexpr (std::is_same_v<S, T> && kind != Op::ArgMax) {
+                        value = run(p, k1 - k0);
+                    } else {
+                        // Tile by tile, each one still in L1 when
+                        // argmax looks for where its maximum is
+                        pairwise_sum<T> sum;
+                        for (size_t t = 0; t < k1 - k0; t += tile) {
+                            size_t len = std::min(tile, k1 - k0 - t);
+                            const T* w;
+                            if constexpr (std::is_same_v<S, T>) {
+                                w = p + t;
+                            } else {
+                                widen(p + t, wide, len);
+                                w = wide;
+                            }
+                            T v = run(w, len);
+                            if constexpr (op == ReduceOp::Sum) {
+                                sum.add(v);
+                            } else if constexpr (kind == Op::ArgMax) {
+                                if (t == 0 || takes_max(v, value)) {
+                                    value = v;
+                                    index = k0 + t + (find_value(w, w + len, v) - w);
+                                }
+                            } else {
+                                if (t == 0) value = v;
+                                else combine<op>(value, v);
+                            }
+                        }
+                        if constexpr (op == ReduceOp::Sum) value = sum.total();
+                    }
+                    if (parts == 1) {
+                        write(row, value, index);
+                        continue;
+                    }
+                    values[task] = value;
+                    if constexpr (kind == Op::ArgMax) indices[task] = index;
+                }
+            });
+            if (parts == 1) return;
+            for (size_t row = 0; row < outer; ++row) {
+                T value;
+                int64_t index;
+                merge(values.data() + row * parts,
+                      indices.empty() ? nullptr : indices.data() + row * parts,
+                      parts, 1, value, index);
+                write(row, value, index);
+            }
+            return;
+        }
+
+        // Columns, a tile of them over a part of the rows in a task
+        constexpr size_t cols = 256;
+        size_t tiles = (inner + cols - 1) / cols, groups = outer * tiles;
+        size_t parts = split(groups, 64);
+        std::vector<T> values(parts > 1 ? groups * parts * cols : 0);
+        std::vector<int64_t> indices(kind == Op::ArgMax ? values.size() : 0);
+        pool.parallel_for(groups * parts, 1, [&](size_t begin, size_t end) {
+            T acc[cols], comp[cols], wide[cols];
+            int64_t index[cols];
+            for (size_t task = begin; task < end; ++task) {
+                size_t g = task / parts, s = task % parts;
+                size_t o = g / tiles, j0 = g % tiles * cols;
+                size_t len = std::min(cols, inner - j0);
+                size_t k0 = n * s / parts, k1 = n * (s + 1) / parts;
+                auto row = [&](size_t k) -> const T* {
+                    const S* p = x + (o * n + k) * inner + j0;
+                    if constexpr (std::is_same_v<S, T>) {
+                        return p;
+                    } else {
+                        widen(p, wide, len);
+                        return wide;
+                    }
+                };
+                std::memcpy(acc, row(k0), len * sizeof(T));
+                std::fill(comp, comp + len, T(0));
+                std::fill(index, index + len, int64_t(k0));
+                for (size_t k = k0 + 1; k < k1; ++k) {
+                    const T* r = row(k);
+                    if constexpr (kind == Op::ArgMax) {
+                        for (size_t j = 0; j < len; ++j) {
+                            if (takes_max(r[j], acc[j])) {
+                                acc[j] = r[j];
+                                index[j] = k;
+                            }
+                        }
+                    } else {
+                        accumulate(acc, comp, r, len);
+                    }
+                }
+                for (size_t j = 0; j < len; ++j) {
+                    T value = acc[j];
+                    if constexpr (op == ReduceOp::Sum) value -= comp[j];
+                    if (parts == 1) {
+                        write(o * inner + j0 + j, value, index[j]);
+                        continue;
+                    }
+                    values[(g * parts + s) * cols + j] = value;
+                    if constexpr (kind == Op::ArgMax) indices[(g * parts + s) * cols + j] = index[j];
+                }
+            }
+        });
+        if (parts == 1) return;
+        for (size_t g = 0; g < groups; ++g) {
+            size_t o = g / tiles, j0 = g % tiles * cols;
+            for (size_t j = 0; j < std::min(cols, inner - j0); ++j) {
+                size_t first = g * parts * cols + j;
+                T value;
+                int64_t index;
+                merge(values.data() + first,
+                      indices.empty() ? nullptr : indices.data() + first,
+                      parts, cols, value, index);
+                write(o * inner + j0 + j, value, index);
+            }
+        }
+    };
+}
+
+} // namespace tensorlib::cpu
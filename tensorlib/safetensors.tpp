@@ -0,0 +1,263 @@
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include <utils.hpp>
+
+namespace tensorlib {
+
+// safetensors dtype names onto dtypes_map
+static std::map<std::string, std::string> safetensors_dtypes = {
+    {"F32", "f32"},
+    {"F16", "f16"},
+    {"BF16", "bf16"},
+    {"I32", "i32"},
+    {"I64", "i64"},
+};
+
+// Just enough JSON for a safetensors header: objects, arrays, strings
+// and non negative integers are read, anything else is skipped.
+struct JsonReader {
+    const char* at;
+    const char* end;
+    const std::string& path;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Malformed safetensors header in " + path
+                + ": " + what);
+    }
+
+    char peek() {
+        while (at < end && (*at == ' ' || *at == '\n' || *at == '\r' || *at == '\t'))
+            ++at;
+        if (at == end) fail("unexpected end");
+        return *at;
+    }
+
+    void expect(char c) {
+        if (peek() != c) fail(std::string("expected '") + c + "'");
+        ++at;
+    }
+
+    // Consumes c if it is next
+    bool accept(char c) {
+        if (peek() != c) return false;
+        ++at;
+        return true;
+    }
+
+    // UTF-8 of one code point
+    static void append_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += char(cp);
+        } else if (cp < 0x800) {
+            out += char(0xc0 | cp >> 6);
+            out += char(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += char(0xe0 | cp >> 12);
+            out += char(0x80 | (cp >> 6 & 0x3f));
+            out += char(0x80 | (cp & 0x3f));
+        } else {
+            out += char(0xf0 | cp >> 18);
+            out += char(0x80 | (cp >> 12 & 0x3f));
+            out += char(0x80 | (cp >> 6 & 0x3f));
+            out += char(0x80 | (cp & 0x3f));
+        }
+    }
+
+    uint32_t hex4() {
+        if (end - at < 4) fail("short \\u escape");
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *at++;
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+        return v;
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        while (true) {
+            if (at == end) fail("unterminated string");
+            char c = *at++;
+            if (c == '"') return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (at == end) fail("unterminated string");
+            switch (char e = *at++) {
+                case '"': case '\\': case '/': out += e; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = hex4();
+                    // Surrogate pair
+                    if (cp >= 0xd800 && cp < 0xdc00 && end - at >= 6
+                            && at[0] == '\\' && at[1] == 'u') {
+                        at += 2;
+                        uint32_t low = hex4();
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default: fail("bad escape");
+            }
+        }
+    }
+
+    uint64_t integer() {
+        peek();
+        if (at == end || *at < '0' || *at > '9') fail("expected an integer");
+        uint64_t v = 0;
+        while (at < end && *at >= '0' && *at <= '9') {
+            uint64_t next = v * 10 + (*at++ - '0');
+            if (next / 10 != v) fail("integer overflow");
+            v = next;
+        }
+        return v;
+    }
+
+    std::vector<uint64_t> integers() {
+        std::vector<uint64_t> out;
+        expect('[');
+        if (accept(']')) return out;
+        do out.push_back(integer()); while (accept(','));
+        expect(']');
+        return out;
+    }
+
+    // Calls member(key) on every entry, which reads the value
+    template <typename F>
+    void object(F member) {
+        expect('{');
+        if (accept('}')) return;
+        do {
+            std::string key = string();
+            expect(':');
+            member(key);
+        } while (accept(','));
+        expect('}');
+    }
+
+    void skip() {
+        char c = peek();
+        if (c == '"') {
+            string();
+        } else if (c == '{') {
+            object([&](const std::string&) { skip(); });
+        } else if (c == '[') {
+            ++at;
+            if (accept(']')) return;
+            do skip(); while (accept(','));
+            expect(']');
+        } else {
+            // Numbers and literals, up to the next delimiter
+            const char* start = at;
+            while (at < end && !std::strchr(",}] \n\r\t", *at)) ++at;
+            if (at == start) fail("unexpected character");
+        }
+    }
+};
+
+std::map<std::string, Tensor> load_safetensors(
+        const std::string& path,
+        std::map<std::string, std::string>* metadata,
+        MappedFile::Mode mode) {
+    auto file = MappedFile::open(path, mode);
+    if (file->size() < 8)
+        throw std::runtime_error(path + " is too short for safetensors");
+    uint64_t header = 0;
+    for (int i = 7; i >= 0; --i)
+        header = header << 8 | file->data()[i];
+    if (header > file->size() - 8)
+        throw std::runtime_error(path + " has a header past its end");
+    const char* text = reinterpret_cast<const char*>(file->data() + 8);
+    size_t data_start = 8 + header;
+    size_t data_bytes = file->size() - data_start;
+
+    struct entry {
+        std::string dtype;
+        std::vector<int> shape;
+        uint64_t begin, end;
+    };
+    std::vector<std::pair<std::string, entry>> entries;
+    JsonReader json{text, text + header, path};
+    json.object([&](const std::string& name) {
+        if (name == "__metadata__") {
+            json.object([&](const std::string& key) {
+                std::string value = json.string();
+                if (metadata) (*metadata)[key] = value;
+            });
+            return;
+        }
+        entry e;
+        bool has_dtype = false, has_shape = false, has_offsets = false;
+        json.object([&](const std::string& key) {
+            if (key == "dtype") {
+                e.dtype = json.string();
+                has_dtype = true;
+            } else if (key == "shape") {
+                for (uint64_t d : json.integers()) {
+                    if (d > uint64_t(std::numeric_limits<int>::max()))
+                        json.fail("dimension too large in " + name);
+                    e.shape.push_back(d);
+                }
+                has_shape = true;
+            } else if (key == "data_offsets") {
+                auto offsets = json.integers();
+                if (offsets.size() != 2) json.fail("bad data_offsets in " + name);
+                e.begin = offsets[0];
+                e.end = offsets[1];
+                has_offsets = true;
+            } else {
+                json.skip();
+            }
+        });
+        if (!has_dtype || !has_shape || !has_offsets)
+            json.fail("incomplete entry " + name);
+        entries.emplace_back(name, std::move(e));
+    });
+
+    std::map<std::string, Tensor> tensors;
+    for (auto& [name, e] : entries) {
+        if (e.begin > e.end || e.end > data_bytes)
+            throw std::runtime_error("Data of " + name + " out of bounds in " + path);
+        // Other tensors of the file are still of use
+        auto dtype = safetensors_dtypes.find(e.dtype);
+        if (dtype == safetensors_dtypes.end()) {
+            VOUT << "Skipping " << name << " of unsupported dtype " << e.dtype
+                 << " in " << path << std::endl;
+            continue;
+        }
+        // A view into the mapping, the tensor keeps the file mapped.
+        // Writers pad the header so data is aligned, kernels read
+        // whole elements. Files that don't get a copy.
+        Storage data = file->storage(data_start + e.begin, e.end - e.begin);
+        if (reinterpret_cast<uintptr_t>(data.data()) % dtypes_map[dtype->second].bytes) {
+            VOUT << name << " is misaligned in " << path << ", copied" << std::endl;
+            data = Storage(data.data(), data.size());
+        }
+        bool added = tensors.emplace(std::piecewise_construct,
+                std::forward_as_tuple(name),
+                std::forward_as_tuple(std::move(data), e.shape,
+                                      dtype->second)).second;
+        if (!added)
+            throw std::runtime_error("Tensor " + name + " twice in " + path);
+    }
+    VOUT << "Loaded " << tensors.size() << " tensors from " << path << std::endl;
+    return tensors;
+}
+
+} // namespace tensorlib
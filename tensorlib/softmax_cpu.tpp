@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <thread_pool.hpp>
+
+namespace tensorlib::cpu {
+
+/* ----------------------
+ *       Softmax
+ * ---------------------- */
+//
+// Rows of n, normalized in two passes. The first keeps a running max
+// and a sum of exponentials scaled to it per vector lane, rescaling
+// the sum whenever the max grows (the online softmax trick), the
+// second writes exp(x - max) / sum. Lanes are merged in between. The
+// row is read twice and written once, it usually stays in cache.
+
+// e^x, Cephes' expf: x = n ln2 + r, e^r by a polynomial on
+// |r| <= ln2 / 2, 2^n built in the exponent bits. Within 2 ulp.
+// Large arguments are clamped, those below e^x's range (masked -inf
+// scores among them) and NaN give 0: only ever called on differences
+// to a running max, where NaN is -inf - -inf.
+template <typename V, typename I>
+TL_INLINE void exp_vec(V& r, const V& in) {
+    V x = in >= -87.3f ? in : V{} - 87.3f;
+    x = x > 88.3f ? V{} + 88.3f : x;
+    V fx = x * 1.44269504088896341f + 0.5f;
+    V fl = __builtin_convertvector(__builtin_convertvector(fx, I), V);
+    fl = fl > fx ? fl - 1.0f : fl;
+    x = x - fl * 0.693359375f + fl * 2.12194440e-4f;
+    V y = 1.9875691500e-4f * x + 1.3981999507e-3f;
+    y = y * x + 8.3334519073e-3f;
+    y = y * x + 4.1665795894e-2f;
+    y = y * x + 1.6666665459e-1f;
+    y = y * x + 5.0000001201e-1f;
+    y = y * x * x + x + 1.0f;
+    I e = (__builtin_convertvector(fl, I) + 127) << 23;
+    V scale;
+    std::memcpy(&scale, &e, sizeof(scale));
+    r = in >= -87.3f ? y * scale : V{};
+}
+
+// Softmax (or log-softmax with log) of a row of n > 0 floats. F and I
+// are float and int32_t, vector types of dependent ones only.
+template <typename F, typename I, size_t width>
+TL_INLINE void softmax_loop(const F* x, F* out, size_t n, bool log) {
+    typedef F vec __attribute__((vector_size(width)));
+    typedef I ivec __attribute__((vector_size(width)));
+    constexpr size_t lanes = width / sizeof(F);
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    vec m = vec{} - inf, s = vec{};
+    size_t i = 0;
+    // Four vectors share a rescale of the sum
+    for (; i + 4 * lanes <= n; i += 4 * lanes) {
+        vec v[4], grown, e;
+        std::memcpy(v, x + i, sizeof(v));
+        grown = v[0] > v[1] ? v[0] : v[1];
+        grown = v[2] > grown ? v[2] : grown;
+        grown = v[3] > grown ? v[3] : grown;
+        grown = m > grown ? m : grown;
+        exp_vec<vec, ivec>(e, m - grown);
+        s = s * e;
+        for (int k = 0; k < 4; ++k) {
+            exp_vec<vec, ivec>(e, v[k] - grown);
+            s = s + e;
+        }
+        m = grown;
+    }
+    for (; i + lanes <= n; i += lanes) {
+        vec v, grown, e;
+        std::memcpy(&v, x + i, width);
+        grown = v > m ? v : m;
+        exp_vec<vec, ivec>(e, m - grown);
+        s = s * e;
+        exp_vec<vec, ivec>(e, v - grown);
+        s = s + e;
+        m = grown;
+    }
+    // Lanes merged, then the tail one element at a time
+    float max = -inf, sum = 0;
+    for (size_t l = 0; l < lanes; ++l) max = std::max(max, float(m[l]));
+    for (size_t j = i; j < n; ++j) max = std::max(max, x[j]);
+    if (max != -inf) {
+        for (size_t l = 0; l < lanes; ++l)
+            if (s[l] != 0) sum += s[l] * std::exp(m[l] - max);
+        for (size_t j = i; j < n; ++j) sum += std::exp(x[j] - max);
+    }
+    if (log) {
+        float shift = max + std::log(sum);
+        for (i = 0; i + lanes <= n; i += lanes) {
+            vec v;
+            std::memcpy(&v, x + i, width);
+            v = v - shift;
+            std::memcpy(out + i, &v, width);
+        }
+        for (; i < n; ++i) out[i] = x[i] - shift;
+        return;
+    }
+    float inv = 1 / sum;
+    for (i = 0; i + lanes <= n; i += lanes) {
+        vec v, e;
+        std::memcpy(&v, x + i, width);
+        exp_vec<vec, ivec>(e, v - max);
+        e = e * inv;
+        std::memcpy(out + i, &e, width);
+    }
+    for (; i < n; ++i) out[i] = std::exp(x[i] - max) * inv;
+}
+
+using softmax_fn = void (*)(const float*, float*, size_t, bool);
+
+inline void softmax_generic(const float* x, float* out, size_t n, bool log) {
+    softmax_loop<float, int32_t, 16>(x, out, n, log);
+}
+
+#ifdef TENSORLIB_X86
+TL_TARGET_AVX2 inline void softmax_avx2(const float* x, float* out, size_t n, bool log) {
+    softmax_loop<float, int32_t, 32>(x, out, n, log);
+}
+
+TL_TARGET_AVX512 inline void softmax_avx512(const float* x, float* out, size_t n, bool log) {
+    softmax_loop<float, int32_t, 64>(x, out, n, log);
+}
+#endif
+
+inline softmax_fn softmax_for(ISA isa) {
+#ifdef TENSORLIB_X86
+    if (isa == ISA::AVX512) return softmax_avx512;
+    if (isa == ISA::AVX2) return softmax_avx2;
+#endif
+    return softmax_generic;
+}
+
+// Softmax and log-softmax over the rows of a dense input, the
+// "softmax_r_" and "log_softmax_r_" kernels. Halves are widened a row
+// at a time.
+// params - {rows, n}
+template <typename S = float>
+kernel_fn softmax_r(ISA isa, bool log) {
+    softmax_fn loop = softmax_for(isa);
+    convert_fn<S, float> widen = nullptr;
+    convert_fn<float, S> narrow = nullptr;
+    if constexpr (!std::is_same_v<S, float>) {
+        widen = convert_for<S, float>(isa);
+        narrow = convert_for<float, S>(isa);
+    }
+    return [loop, widen, narrow, log](const std::vector<const uint8_t*>& inputs,
+                                      uint8_t* result,
+                                      size_t,
+                                      const std::vector<int>& params) {
+        size_t rows = params.at(0), n = params.at(1);
+        if (rows == 0 || n == 0) return;
+        const S* x = reinterpret_cast<const S*>(inputs[0]);
+        S* r = reinterpret_cast<S*>(result);
+        ThreadPool::global().parallel_for(rows, std::max<size_t>(1, (1 << 14) / n),
+                [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                if constexpr (std::is_same_v<S, float>) {
+                    loop(x + row * n, r + row * n, n, log);
+                } else {
+                    thread_local std::vector<float> wide;
+                    wide.resize(n);
+                    widen(x + row * n, wide.data(), n);
+                    loop(wide.data(), wide.data(), n, log);
+                    narrow(wide.data(), r + row * n, n);
+                }
+            }
+        });
+    };
+}
+
+} // namespace tensorlib::cpu
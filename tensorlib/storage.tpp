@@ -0,0 +1,76 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace tensorlib {
+
+inline Storage::Storage(size_t bytes, std::pmr::memory_resource* allocator)
+    :   size_(bytes),
+        allocator_(allocator) {
+    if (bytes)
+        bytes_ = static_cast<uint8_t*>(allocator->allocate(bytes, alignment));
+}
+
+inline Storage::Storage(const void* data, size_t bytes,
+                        std::pmr::memory_resource* allocator)
+    :   Storage(bytes, allocator) {
+    if (bytes) std::memcpy(bytes_, data, bytes);
+}
+
+inline Storage::Storage(Storage&& other) noexcept
+    :   bytes_(std::exchange(other.bytes_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        allocator_(std::exchange(other.allocator_, nullptr)),
+        owner_(std::move(other.owner_)) {}
+
+inline Storage& Storage::operator=(Storage&& other) noexcept {
+    if (this != &other) {
+        reset();
+        bytes_ = std::exchange(other.bytes_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        allocator_ = std::exchange(other.allocator_, nullptr);
+        owner_ = std::move(other.owner_);
+    }
+    return *this;
+}
+
+inline Storage::~Storage() {
+    reset();
+}
+
+inline void Storage::reset() {
+    if (bytes_ && allocator_)
+        allocator_->deallocate(bytes_, size_, alignment);
+    bytes_ = nullptr;
+    size_ = 0;
+    allocator_ = nullptr;
+    owner_.reset();
+}
+
+inline Storage Storage::external(void* data, size_t bytes,
+                                 std::shared_ptr<void> owner) {
+    Storage storage;
+    storage.bytes_ = static_cast<uint8_t*>(data);
+    storage.size_ = bytes;
+    storage.owner_ = std::move(owner);
+    return storage;
+}
+
+inline Storage Storage::view(size_t offset, size_t bytes) {
+    if (offset + bytes > size_)
+        throw std::runtime_error("View of " + std::to_string(bytes) + " bytes at "
+                + std::to_string(offset) + " past storage of " + std::to_string(size_));
+    if (allocator_) {
+        auto shared = std::make_shared<Storage>(std::move(*this));
+        *this = external(shared->data(), shared->size(), shared);
+    }
+    return external(bytes_ + offset, bytes, owner_);
+}
+
+inline bool operator==(const Storage& a, const Storage& b) {
+    return a.size() == b.size()
+        && (a.empty() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+} // namespace tensorlib
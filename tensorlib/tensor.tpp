@@ -1,8 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cstdlib>
 #include <cassert>
 #include <numeric>
 #include <type_traits>
-#include <thread>
 #include <queue>
 #include <mutex>
 #include <map>
@@ -10,12 +13,8 @@
 namespace tensorlib {
 
 static TensorPassingContext init_context(
-    const void* data,
-    std::vector<int>const& shape,
-    const std::string& dtype,
-    size_t dtype_size_in_bytes,
-    size_t num_elements,
-    const std::string& device_name) {
+    Storage data,
+    std::vector<int>const& shape) {
 
     // TODO: Dtype handling should be here
     TensorPassingContext context;
@@ -26,18 +25,57 @@ static TensorPassingContext init_context(
     global_tensor_count++;
 
     context.shape = shape;
-    // Default strides
+    // Row major
     context.strides = std::vector<int>(shape.size(), 1);
+    for (int d = (int)shape.size() - 2; d >= 0; --d)
+        context.strides[d] = context.strides[d + 1] * shape[d + 1];
 
-    size_t bytes = dtype_size_in_bytes * num_elements;
-    context.data = std::vector<uint8_t>(bytes);
-    std::memcpy(context.data.data(), data, bytes);
+    context.data = std::move(data);
 
     context.parents = std::vector<std::string>();
 
     return context;
 }
 
+size_t tensorlib::Tensor::numel(const std::vector<int>& shape) {
+    size_t n = 1;
+    for (int d : shape) n *= d;
+    return n;
+}
+
+std::vector<int> tensorlib::Tensor::dense_strides(const std::vector<int>& shape) {
+    std::vector<int> strides(shape.size(), 1);
+    for (int d = (int)shape.size() - 2; d >= 0; --d)
+        strides[d] = strides[d + 1] * shape[d + 1];
+    return strides;
+}
+
+std::vector<int> tensorlib::Tensor::broadcast_shapes(const std::vector<int>& a,
+                                                     const std::vector<int>& b) {
+    const std::vector<int>& longer = a.size() >= b.size() ? a : b;
+    const std::vector<int>& shorter = a.size() >= b.size() ? b : a;
+    std::vector<int> shape = longer;
+    size_t lead = longer.size() - shorter.size();
+    for (size_t d = 0; d < shorter.size(); ++d) {
+        int x = longer[lead + d], y = shorter[d];
+        if (x != y && x != 1 && y != 1)
+            throw std::runtime_error("Can't broadcast dims of size "
+                    + std::to_string(x) + " and " + std::to_string(y));
+        shape[lead + d] = x == 1 ? y : x;
+    }
+    return shape;
+}
+
+// Elements from the first one of a strided view to its last one
+static size_t strided_span(std::span<const int> shape, std::span<const int> strides) {
+    size_t span = 1;
+    for (size_t d = 0; d < shape.size(); ++d) {
+        if (shape[d] == 0) return 0;
+        span += size_t(shape[d] - 1) * strides[d];
+    }
+    return span;
+}
+
 template <typename T>
 DType Tensor::infer_dtype(const std::string& dtype) {
     if (dtypes_map.find(dtype) != dtypes_map.end()) {
@@ -51,8 +89,11 @@ DType Tensor::infer_dtype(const std::string& dtype) {
         std::is_same<T, long long>::value) {
         type = Primitive::Int;
     } else if (std::is_same<T, float>::value ||
-             std::is_same<T, double>::value) {
+             std::is_same<T, double>::value ||
+             std::is_same<T, float16>::value) {
         type = Primitive::Float;
+    } else if (std::is_same<T, bfloat16>::value) {
+        type = Primitive::BFloat;
     } else {
         throw std::runtime_error("Unsupported dtype");
     }
@@ -67,12 +108,124 @@ tensorlib::Tensor::Tensor(
     const std::string& dtype,
     const std::string& device_name)
     :   context(tensorlib::init_context(
-                static_cast<const void*>(data.data()), // get raw data out
-                shape, dtype, sizeof(T), data.size(),
-                device_name)) {
+                Storage(data.data(), data.size() * sizeof(T)),
+                shape)) {
+    init(infer_dtype<T>(dtype), device_name);
+}
 
+template <typename T>
+tensorlib::Tensor::Tensor(
+    std::vector<T>&& data,
+    std::vector<int>const& shape,
+    bool requires_grad,
+    const std::string& dtype,
+    const std::string& device_name) {
+    // Empty for results, their memory comes on realization
+    DType type = infer_dtype<T>(dtype);
+    size_t bytes = type.nbytes(numel(shape));
+    if (!data.empty() && data.size() * sizeof(T) != bytes)
+        throw std::runtime_error("Tensor of " + std::to_string(bytes)
+                + " bytes over a vector of " + std::to_string(data.size() * sizeof(T)));
+    // The vector lives on next to the tensor, its buffer unmoved
+    Storage storage;
+    if (!data.empty()) {
+        auto owner = std::make_shared<std::vector<T>>(std::move(data));
+        storage = Storage::external(owner->data(),
+                owner->size() * sizeof(T), owner);
+    }
+    context = tensorlib::init_context(std::move(storage), shape);
+    init(type, device_name);
+}
+
+template <typename T>
+tensorlib::Tensor::Tensor(
+    T* data,
+    std::vector<int>const& shape,
+    std::type_identity_t<std::function<void(T*)>> deleter,
+    bool requires_grad,
+    const std::string& dtype,
+    const std::string& device_name) {
+    if (!deleter)
+        throw std::runtime_error("Tensor needs a deleter for memory it owns, "
+                                 "borrow a std::span otherwise");
+    if (!data && numel(shape) > 0)
+        throw std::runtime_error("Tensor of " + std::to_string(numel(shape))
+                + " elements over a null pointer");
+    // Runs the deleter along with the storage
+    std::shared_ptr<T> owner(data, std::move(deleter));
+    context = tensorlib::init_context(
+            Storage::external(data, numel(shape) * sizeof(T), owner),
+            shape);
+    init(infer_dtype<T>(dtype), device_name);
+}
+
+template <typename T>
+tensorlib::Tensor::Tensor(
+    std::span<T> data,
+    std::vector<int>const& shape,
+    bool requires_grad,
+    const std::string& dtype,
+    const std::string& device_name) {
+    if (data.size() != numel(shape))
+        throw std::runtime_error("Tensor of " + std::to_string(numel(shape))
+                + " elements over a span of " + std::to_string(data.size()));
+    context = tensorlib::init_context(
+            Storage::external(const_cast<std::remove_cv_t<T>*>(data.data()),
+                              data.size_bytes()),
+            shape);
+    init(infer_dtype<std::remove_cv_t<T>>(dtype), device_name);
+}
+
+tensorlib::Tensor::Tensor(
+    Storage data,
+    std::vector<int>const& shape,
+    const std::string& dtype,
+    bool requires_grad,
+    const std::string& device_name) {
+    auto found = dtypes_map.find(dtype);
+    if (found == dtypes_map.end())
+        throw std::runtime_error("Unknown dtype " + dtype);
+    const DType& type = found->second;
+    // Packed rows are whole blocks
+    if (shape.empty() ? type.block != 1 : shape.back() % type.block)
+        throw std::runtime_error("Rows of " + type.repr + " come in blocks of "
+                + std::to_string(type.block) + " elements");
+    size_t bytes = type.nbytes(numel(shape));
+    if (data.size() != bytes)
+        throw std::runtime_error("Tensor of " + std::to_string(bytes)
+                + " bytes over storage of " + std::to_string(data.size()));
+    context = tensorlib::init_context(std::move(data), shape);
+    init(type, device_name);
+}
+
+bool operator==(const Tensor& a, const Tensor& b) {
+    if (a.shape() != b.shape()) return false;
+    if (a.is_contiguous() && b.is_contiguous())
+        return a.context.data == b.context.data;
+    // Element by element, following the strides of each
+    size_t bytes = a.dtype().bytes;
+    if (bytes != b.dtype().bytes) return false;
+    const std::vector<int>& shape = a.shape();
+    std::vector<int> index(shape.size(), 0);
+    for (size_t n = Tensor::numel(shape); n > 0; --n) {
+        size_t ia = 0, ib = 0;
+        for (size_t d = 0; d < shape.size(); ++d) {
+            ia += size_t(index[d]) * a.strides()[d];
+            ib += size_t(index[d]) * b.strides()[d];
+        }
+        if (std::memcmp(a.context.data.data() + ia * bytes,
+                        b.context.data.data() + ib * bytes, bytes))
+            return false;
+        for (int d = (int)shape.size() - 1; d >= 0 && ++index[d] == shape[d]; --d)
+            index[d] = 0;
+    }
+    return true;
+}
+
+void tensorlib::Tensor::init(const DType& dtype,
+                             const std::string& device_name) {
     // Dtype initialized separately from context
-    context.dtype = infer_dtype<T>(dtype);
+    context.dtype = dtype;
 
     // Offer ownership to global tensor map
     global_tensor_map[context.tuid].reset(std::move(this));
@@ -87,79 +240,668 @@ tensorlib::Tensor::Tensor(Tensor& other) {
     //  Should the connections be backpropagated? Should the new tensor be a leaf?
 }
 
-// Release from unique_ptr if being destroyed explicitly
+tensorlib::Tensor::Tensor(Tensor&& other) noexcept {
+    take_over(other);
+}
+
+tensorlib::Tensor& tensorlib::Tensor::operator=(Tensor&& other) {
+    if (this != &other) {
+        detach();
+        take_over(other);
+    }
+    return *this;
+}
+
+void tensorlib::Tensor::take_over(Tensor& other) {
+    // Memory moves along, devices keep pointing at the same bytes
+    context = std::move(other.context);
+    requires_grad = other.requires_grad;
+    realized = other.realized;
+    queued_realization = other.queued_realization;
+    other.context.tuid.clear();
+    auto entry = global_tensor_map.find(tuid());
+    if (entry != global_tensor_map.end() && entry->second.get() == &other) {
+        entry->second.release();
+        entry->second.reset(this);
+    }
+}
+
+// A handle going away with unrealized tensors still depending on it
+// hands its state over to the registry. Otherwise the tensor is dead
+// and dropped, along with whatever only it needed.
 tensorlib::Tensor::~Tensor() {
-    global_tensor_map[tuid()].release();
+    detach();
+}
+
+void tensorlib::Tensor::detach() {
+    auto entry = global_tensor_map.find(tuid());
+    // Moved from, or already dropped by the registry
+    if (entry == global_tensor_map.end() || entry->second.get() != this)
+        return;
+    if (context.consumers > 0) {
+        // Moving re-points the entry at the kept tensor
+        Tensor* kept = new Tensor(std::move(*this));
+        kept->orphan = true;
+        return;
+    }
+    drop(this);
+}
+
+// Forget tensors nobody can read anymore: device memory, registry
+// entry, and their claim on parents still to be computed, which may
+// free those in turn.
+void tensorlib::Tensor::drop(Tensor* tensor) {
+    std::vector<Tensor*> dead = {tensor};
+    while (!dead.empty()) {
+        Tensor* t = dead.back();
+        dead.pop_back();
+        std::vector<std::string> parents;
+        if (t->realized == false)
+            parents = std::move(t->context.parents);
+        std::string tuid = t->tuid();
+        for (auto& [name, device] : device_interfaces)
+            if (device->get())
+                device->get()->release(tuid);
+        auto entry = global_tensor_map.find(tuid);
+        std::unique_ptr<Tensor> owned = std::move(entry->second);
+        global_tensor_map.erase(entry);
+        // Handles are being destroyed by their owner already
+        if (t->orphan == false)
+            owned.release();
+        owned.reset();
+        for (auto& parent : parents) {
+            auto pt = global_tensor_map.find(parent);
+            if (pt == global_tensor_map.end() || !pt->second) continue;
+            if (--pt->second->context.consumers == 0 && pt->second->orphan)
+                dead.push_back(pt->second.get());
+        }
+    }
+}
+
+void tensorlib::Tensor::release_consumer(const std::string& tuid) {
+    auto entry = global_tensor_map.find(tuid);
+    if (entry == global_tensor_map.end() || !entry->second) return;
+    Tensor* t = entry->second.get();
+    if (--t->context.consumers == 0 && t->orphan)
+        drop(t);
 }
 
 /* ----------------------
  *     Tensor Ops
  * ---------------------- */
 
-// Code common to all binary operations.
-// Shape conformity, new shape calculation, etc. handled here.
-inline Tensor tensorlib::Tensor::binop_boilerplate(
+// Code common to all operations producing a new tensor from two
+// parents. Allocates the result and records how to compute it, the
+// kernel is picked and run on realization.
+inline Tensor tensorlib::Tensor::kernel_boilerplate(
         Tensor& a,
         Tensor& b,
-        const std::string& op_name) {
-
-    // Create a tensor for storing results
-    int num_elements = std::accumulate(a.shape().begin(),
-            a.shape().end(), 1, std::multiplies<int>());
+        const std::vector<int>& shape,
+        Op op,
+        const std::vector<int>& params) {
 
-    int bytes_required = num_elements * a.dtype().bytes;
-
-    // TODO: Infer shape, memory layout, etc.
-    /* std::cout << "Creating tensor of size " << bytes_required << std::endl; */
+    // Memory comes on realization, when it is known whether the
+    // result outlives it.
     Tensor result = Tensor(
-        std::vector<uint8_t>(bytes_required),
-        std::vector<int>(a.shape()),
+        std::vector<uint8_t>(),
+        shape,
         a.requires_grad, a.dtype().repr, "cpu");
 
     result.context.parents = {a.tuid(), b.tuid()};
-    result.realized = true;
+    a.context.consumers++;
+    b.context.consumers++;
+    result.context.op = op;
+    result.context.params = params;
     // If either tensor is on GPU, run the calculation on GPU
     if (a.context.device->name() == "gpu"
             || b.context.device->name() == "gpu") {
         a.to("gpu");
         b.to("gpu");
         // Allocate memory on gpu
+        result.allocate();
         result.to("gpu");
-        // Internal gpu tensors are NOT realized instantly.
-        result.realized = false;
-        try {
-#ifdef RUN_METAL
-            context.device->get()->enqueue_kernel({a.tuid(), b.tuid()},
-                    // Trying to follow a naming convention
-                    // with the kernel names. The "_v_" is meant
-                    // to indicate vector
-                    result.tuid(), op_name + "_v_" + dtype().repr);
-#else
-            throw std::runtime_error("device not enabled");
-#endif
-            return result;
-        } catch (std::runtime_error& e) {
-            // On kernel failure, fall back to CPU
+        // Moving falls back to CPU when the device is missing,
+        // keep all three on one device.
+        if (a.context.device->name() != "gpu"
+                || b.context.device->name() != "gpu"
+                || result.context.device->name() != "gpu") {
             a.to("cpu");
             b.to("cpu");
             result.to("cpu");
         }
     }
+    // Results are lazy on every device
+    result.realized = false;
     return result;
 }
 
+// Code common to all binary operations.
+// Shapes broadcast as in NumPy: aligned on their last dims, each pair
+// equal or one of them 1. Nothing is expanded, a broadcast dim is read
+// with stride 0, and views are read through their strides.
+inline Tensor tensorlib::Tensor::binop_boilerplate(
+        Tensor& a,
+        Tensor& b,
+        Op op) {
+    if (a.dtype() != b.dtype())
+        throw std::runtime_error("Elementwise dtype mismatch, "
+                + a.dtype().repr + " and " + b.dtype().repr);
+    if (a.dtype().block != 1)
+        throw std::runtime_error("Elementwise ops on packed "
+                + a.dtype().repr + " tensors aren't supported");
+    std::vector<int> shape = broadcast_shapes(a.shape(), b.shape());
+    if (a.shape() == shape && b.shape() == shape
+            && a.is_contiguous() && b.is_contiguous())
+        return kernel_boilerplate(a, b, shape, op);
+    // Strided kernels only run on CPU
+    for (Tensor* t : {&a, &b})
+        if (t->context.device->name() != "cpu") t->to("cpu");
+    std::vector<int> params = shape;
+    for (Tensor* t : {&a, &b}) {
+        size_t lead = shape.size() - t->shape().size();
+        for (size_t d = 0; d < shape.size(); ++d) {
+            bool broadcast = d < lead || t->shape()[d - lead] != shape[d];
+            params.push_back(broadcast ? 0 : t->strides()[d - lead]);
+        }
+    }
+    return kernel_boilerplate(a, b, shape, op, params);
+}
+
 Tensor tensorlib::Tensor::operator+(Tensor& other) {
-    Tensor result = binop_boilerplate(*this, other, "add");
+    Tensor result = binop_boilerplate(*this, other, Op::Add);
     return result;
 }
 
 Tensor tensorlib::Tensor::operator-(Tensor& other) {
-    Tensor result = binop_boilerplate(*this, other, "sub");
+    Tensor result = binop_boilerplate(*this, other, Op::Sub);
     return result;
 }
 
 Tensor tensorlib::Tensor::operator*(Tensor& other) {
-    Tensor result = binop_boilerplate(*this, other, "mul");
+    Tensor result = binop_boilerplate(*this, other, Op::Mul);
+    return result;
+}
+
+Tensor tensorlib::Tensor::operator/(Tensor& other) {
+    Tensor result = binop_boilerplate(*this, other, Op::Div);
+    return result;
+}
+
+// (M, K) x (K, N) -> (M, N)
+Tensor tensorlib::Tensor::matmul(Tensor& other) {
+    if (shape().size() != 2 || other.shape().size() != 2)
+        throw std::runtime_error("matmul expects 2D tensors");
+    // Read densely
+    if (!is_contiguous())
+        return contiguous().matmul(other);
+    if (!other.is_contiguous()) {
+        Tensor dense = other.contiguous();
+        return matmul(dense);
+    }
+    if (other.dtype().block != 1) {
+        // Only the types with a "mul_m_" kernel
+        const std::string& repr = other.dtype().repr;
+        if (repr != "q8_0" && repr != "q4_0" && repr != "q4_1")
+            throw std::runtime_error("quantized matmul of " + repr + " not supported");
+        int M = shape()[0], K = shape()[1], N = other.shape()[0];
+        if (other.shape()[1] != K)
+            throw std::runtime_error("matmul shape mismatch, "
+                    + std::to_string(K) + " != " + std::to_string(other.shape()[1]));
+        if (dtype().repr != "f32")
+            throw std::runtime_error("Quantized matmul expects f32 activations");
+        return kernel_boilerplate(*this, other, {M, N}, Op::MatMul, {M, K, N});
+    }
+    int M = shape()[0], K = shape()[1], N = other.shape()[1];
+    if (other.shape()[0] != K)
+        throw std::runtime_error("matmul shape mismatch, "
+                + std::to_string(K) + " != " + std::to_string(other.shape()[0]));
+    if (dtype() != other.dtype())
+        throw std::runtime_error("matmul dtype mismatch");
+    Tensor result = kernel_boilerplate(*this, other, {M, N},
+            Op::MatMul, {M, K, N});
+    return result;
+}
+
+Tensor tensorlib::Tensor::quantize(const std::string& dtype) {
+    quantize_row_fn quantize_row = quantize_row_for(dtype);
+    if (!quantize_row)
+        throw std::runtime_error("Can't quantize to " + dtype);
+    if (this->dtype().repr != "f32")
+        throw std::runtime_error("Only f32 tensors are quantized");
+    const DType& type = dtypes_map[dtype];
+    if (!is_contiguous())
+        return contiguous().quantize(dtype);
+    if (shape().empty() || shape().back() % type.block)
+        throw std::runtime_error("Rows of " + dtype + " come in blocks of "
+                + std::to_string(type.block) + " elements");
+    to("cpu");
+    size_t K = shape().back(), rows = numel(shape()) / K;
+    size_t row_bytes = type.nbytes(K);
+    Storage packed(type.nbytes(numel(shape())));
+    const float* x = reinterpret_cast<const float*>(get_raw_data_ptr());
+    ThreadPool::global().parallel_for(rows, 16, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r)
+            quantize_row(x + r * K, packed.data() + r * row_bytes, K);
+    });
+    return Tensor(std::move(packed), shape(), dtype, requires_grad);
+}
+
+Tensor tensorlib::Tensor::astype(const std::string& dtype) {
+    auto found = dtypes_map.find(dtype);
+    auto convertible = [](const DType& type) {
+        return type.repr == "f32" || type.repr == "f16" || type.repr == "bf16";
+    };
+    if (found == dtypes_map.end() || !convertible(found->second)
+            || !convertible(this->dtype()))
+        throw std::runtime_error("No conversion from " + this->dtype().repr
+                + " to " + dtype);
+    if (!is_contiguous())
+        return contiguous().astype(dtype);
+    // Conversions only run on CPU
+    if (context.device->name() != "cpu") to("cpu");
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        shape(),
+        requires_grad, found->second.repr, "cpu");
+    result.context.parents = {tuid()};
+    context.consumers++;
+    result.context.op = found->second == this->dtype() ? Op::Copy : Op::Cast;
+    result.realized = false;
+    return result;
+}
+
+/* ----------------------
+ *      Reductions
+ * ---------------------- */
+
+Tensor tensorlib::Tensor::reduce(Op op, std::vector<int> axes, bool keepdims) {
+    if (dtype().block != 1)
+        throw std::runtime_error("Can't reduce packed " + dtype().repr + " tensors");
+    if (op == Op::Mean && dtype().type != Primitive::Float && dtype().type != Primitive::BFloat)
+        throw std::runtime_error("mean of a " + dtype().repr + " tensor");
+    int ndim = shape().size();
+    if (axes.empty())
+        for (int d = 0; d < ndim; ++d) axes.push_back(d);
+    for (int& a : axes) a = axis(a);
+    std::sort(axes.begin(), axes.end());
+    if (std::adjacent_find(axes.begin(), axes.end()) != axes.end())
+        throw std::runtime_error("Axis repeated in " + op_repr[op]);
+    std::vector<int> kept, dropped;
+    size_t n = 1;
+    for (int d = 0, k = 0; d < ndim; ++d) {
+        if (k < (int)axes.size() && axes[k] == d) {
+            n *= shape()[d];
+            kept.push_back(1);
+            ++k;
+            continue;
+        }
+        kept.push_back(shape()[d]);
+        dropped.push_back(shape()[d]);
+    }
+    if (n == 0 && op != Op::Sum && op != Op::Mean)
+        throw std::runtime_error("Can't take the " + op_repr[op] + " of nothing");
+    // Kernels reduce one run of dims, others are moved last to make one
+    if (!axes.empty() && axes.back() - axes.front() + 1 != (int)axes.size()) {
+        std::vector<int> order, last;
+        for (int d = 0; d < ndim; ++d)
+            if (!std::binary_search(axes.begin(), axes.end(), d)) order.push_back(d);
+        for (int a : axes) {
+            last.push_back(order.size());
+            order.push_back(a);
+        }
+        Tensor moved = permute(order);
+        Tensor reduced = moved.reduce(op, last, false);
+        return keepdims ? reduced.reshape(kept) : std::move(reduced);
+    }
+    if (!is_contiguous())
+        return contiguous().reduce(op, axes, keepdims);
+    // Reductions only run on CPU
+    if (context.device->name() != "cpu") to("cpu");
+    int front = axes.empty() ? ndim : axes.front();
+    int back = axes.empty() ? ndim - 1 : axes.back();
+    int outer = 1, inner = 1;
+    for (int d = 0; d < front; ++d) outer *= shape()[d];
+    for (int d = back + 1; d < ndim; ++d) inner *= shape()[d];
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        keepdims ? kept : dropped,
+        requires_grad, op == Op::ArgMax ? "i64" : dtype().repr, "cpu");
+    result.context.parents = {tuid()};
+    context.consumers++;
+    result.context.op = op;
+    result.context.params = {outer, (int)n, inner};
+    result.realized = false;
+    return result;
+}
+
+Tensor tensorlib::Tensor::sum(const std::vector<int>& axes, bool keepdims) {
+    return reduce(Op::Sum, axes, keepdims);
+}
+
+Tensor tensorlib::Tensor::sum(int axis, bool keepdims) {
+    return reduce(Op::Sum, {axis}, keepdims);
+}
+
+Tensor tensorlib::Tensor::mean(const std::vector<int>& axes, bool keepdims) {
+    return reduce(Op::Mean, axes, keepdims);
+}
+
+Tensor tensorlib::Tensor::mean(int axis, bool keepdims) {
+    return reduce(Op::Mean, {axis}, keepdims);
+}
+
+Tensor tensorlib::Tensor::max(const std::vector<int>& axes, bool keepdims) {
+    return reduce(Op::Max, axes, keepdims);
+}
+
+Tensor tensorlib::Tensor::max(int axis, bool keepdims) {
+    return reduce(Op::Max, {axis}, keepdims);
+}
+
+Tensor tensorlib::Tensor::min(const std::vector<int>& axes, bool keepdims) {
+    return reduce(Op::Min, axes, keepdims);
+}
+
+Tensor tensorlib::Tensor::min(int axis, bool keepdims) {
+    return reduce(Op::Min, {axis}, keepdims);
+}
+
+Tensor tensorlib::Tensor::argmax(int axis, bool keepdims) {
+    return reduce(Op::ArgMax, {axis}, keepdims);
+}
+
+Tensor tensorlib::Tensor::argmax() {
+    Tensor flat = reshape({-1});
+    return flat.reduce(Op::ArgMax, {0}, false);
+}
+
+/* ----------------------
+ *     Normalization
+ * ---------------------- */
+
+Tensor tensorlib::Tensor::softmax_boilerplate(Op op, int dim) {
+    if (dtype().type != Primitive::Float && dtype().type != Primitive::BFloat)
+        throw std::runtime_error(op_repr[op] + " of a " + dtype().repr + " tensor");
+    int last = shape().size() - 1;
+    int a = axis(dim);
+    // Kernels normalize rows, other dims are swapped in and back
+    if (a != last) {
+        Tensor moved = transpose(a, last);
+        Tensor normalized = moved.softmax_boilerplate(op, last);
+        return normalized.transpose(a, last);
+    }
+    if (!is_contiguous())
+        return contiguous().softmax_boilerplate(op, dim);
+    // Only runs on CPU
+    if (context.device->name() != "cpu") to("cpu");
+    int n = shape()[a];
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        shape(),
+        requires_grad, dtype().repr, "cpu");
+    result.context.parents = {tuid()};
+    context.consumers++;
+    result.context.op = op;
+    result.context.params = {n ? int(numel(shape()) / n) : 0, n};
+    result.realized = false;
+    return result;
+}
+
+Tensor tensorlib::Tensor::softmax(int axis) {
+    return softmax_boilerplate(Op::Softmax, axis);
+}
+
+Tensor tensorlib::Tensor::log_softmax(int axis) {
+    return softmax_boilerplate(Op::LogSoftmax, axis);
+}
+
+Tensor tensorlib::Tensor::norm_boilerplate(Op op, const std::vector<Tensor*>& affine, float eps) {
+    if (dtype().type != Primitive::Float && dtype().type != Primitive::BFloat)
+        throw std::runtime_error(op_repr[op] + " of a " + dtype().repr + " tensor");
+    if (shape().empty())
+        throw std::runtime_error(op_repr[op] + " of a scalar");
+    int n = shape().back();
+    for (Tensor* t : affine) {
+        if (t->shape() != std::vector<int>{n})
+            throw std::runtime_error(op_repr[op] + " weights must have shape (" + std::to_string(n) + ")");
+        if (t->dtype().repr != dtype().repr)
+            throw std::runtime_error(op_repr[op] + " of " + dtype().repr + " by " + t->dtype().repr + " weights");
+    }
+    if (!is_contiguous())
+        return contiguous().norm_boilerplate(op, affine, eps);
+    // Strided weights are copied, and kept alive by the graph
+    std::vector<Tensor> dense;
+    dense.reserve(affine.size());
+    std::vector<Tensor*> inputs = {this};
+    for (Tensor* t : affine) {
+        if (!t->is_contiguous()) {
+            dense.push_back(t->contiguous());
+            t = &dense.back();
+        }
+        inputs.push_back(t);
+    }
+    // Only runs on CPU
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        shape(),
+        requires_grad, dtype().repr, "cpu");
+    for (Tensor* t : inputs) {
+        if (t->context.device->name() != "cpu") t->to("cpu");
+        result.context.parents.push_back(t->tuid());
+        t->context.consumers++;
+    }
+    result.context.op = op;
+    result.context.params = {n ? int(numel(shape()) / n) : 0, n, std::bit_cast<int>(eps)};
+    result.realized = false;
+    return result;
+}
+
+Tensor tensorlib::Tensor::rms_norm(Tensor& weight, float eps) {
+    return norm_boilerplate(Op::RMSNorm, {&weight}, eps);
+}
+
+Tensor tensorlib::Tensor::layer_norm(Tensor& weight, Tensor& bias, float eps) {
+    return norm_boilerplate(Op::LayerNorm, {&weight, &bias}, eps);
+}
+
+/* ----------------------
+ *        Views
+ * ---------------------- */
+
+int tensorlib::Tensor::axis(int dim) const {
+    int ndim = shape().size();
+    if (dim < -ndim || dim >= ndim)
+        throw std::runtime_error("Dim " + std::to_string(dim) + " out of range for "
+                + std::to_string(ndim) + " dims");
+    return dim < 0 ? dim + ndim : dim;
+}
+
+bool tensorlib::Tensor::is_contiguous() const {
+    // Strides of size 1 dims never matter
+    size_t expected = 1;
+    for (int d = (int)shape().size() - 1; d >= 0; --d) {
+        if (shape()[d] != 1 && size_t(strides()[d]) != expected) return false;
+        expected *= shape()[d];
+    }
+    return true;
+}
+
+Tensor tensorlib::Tensor::view(
+        const std::vector<int>& shape,
+        const std::vector<int>& strides,
+        size_t offset) {
+    if (dtype().block != 1)
+        throw std::runtime_error("No views of " + dtype().repr
+                + ", its elements are packed");
+    // Views only alias host memory
+    if (context.device->name() != "cpu") to("cpu");
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        shape,
+        requires_grad, dtype().repr, "cpu");
+    result.context.strides = strides;
+    size_t bytes = dtype().bytes;
+    if (realized) {
+        result.context.data = context.data.view(offset * bytes,
+                strided_span(shape, strides) * bytes);
+        result.switch_device_to("cpu");
+        return result;
+    }
+    // Aliased once this tensor has memory, see realize
+    result.context.parents = {tuid()};
+    context.consumers++;
+    result.context.op = Op::View;
+    result.context.params = {static_cast<int>(offset)};
+    result.context.params.insert(result.context.params.end(),
+            strides.begin(), strides.end());
+    result.realized = false;
+    return result;
+}
+
+Tensor tensorlib::Tensor::operator[](int index) {
+    return (*this)[std::vector<int>{index}];
+}
+
+Tensor tensorlib::Tensor::operator[](std::vector<int> index) {
+    if (index.size() > shape().size())
+        throw std::runtime_error(std::to_string(index.size()) + " indices into "
+                + std::to_string(shape().size()) + " dims");
+    size_t offset = 0;
+    for (size_t d = 0; d < index.size(); ++d) {
+        int i = index[d] < 0 ? index[d] + shape()[d] : index[d];
+        if (i < 0 || i >= shape()[d])
+            throw std::runtime_error("Index " + std::to_string(index[d])
+                    + " out of range for dim of " + std::to_string(shape()[d]));
+        offset += size_t(i) * strides()[d];
+    }
+    return view(std::vector<int>(shape().begin() + index.size(), shape().end()),
+                std::vector<int>(strides().begin() + index.size(), strides().end()),
+                offset);
+}
+
+Tensor tensorlib::Tensor::slice(int dim, int start, int end, int step) {
+    dim = axis(dim);
+    if (step <= 0)
+        throw std::runtime_error("Slices step forward, step " + std::to_string(step));
+    // Python's rules, negative from the end, clamped to the dim
+    int n = shape()[dim];
+    auto clamp = [n](int i) { return std::clamp(i < 0 ? i + n : i, 0, n); };
+    start = clamp(start);
+    end = clamp(end);
+    std::vector<int> shape = this->shape(), strides = this->strides();
+    shape[dim] = end > start ? (end - start + step - 1) / step : 0;
+    strides[dim] *= step;
+    return view(shape, strides, size_t(start) * this->strides()[dim]);
+}
+
+Tensor tensorlib::Tensor::transpose(int dim0, int dim1) {
+    std::vector<int> dims(shape().size());
+    std::iota(dims.begin(), dims.end(), 0);
+    std::swap(dims[axis(dim0)], dims[axis(dim1)]);
+    return permute(dims);
+}
+
+Tensor tensorlib::Tensor::permute(const std::vector<int>& dims) {
+    if (dims.size() != shape().size())
+        throw std::runtime_error("permute needs " + std::to_string(shape().size())
+                + " dims, got " + std::to_string(dims.size()));
+    std::vector<int> shape, strides;
+    std::vector<bool> seen(dims.size(), false);
+    for (int dim : dims) {
+        int d = axis(dim);
+        if (seen[d])
+            throw std::runtime_error("permute repeats dim " + std::to_string(dim));
+        seen[d] = true;
+        shape.push_back(this->shape()[d]);
+        strides.push_back(this->strides()[d]);
+    }
+    return view(shape, strides, 0);
+}
+
+Tensor tensorlib::Tensor::reshape(const std::vector<int>& new_shape) {
+    std::vector<int> shape = new_shape;
+    size_t known = 1;
+    int inferred = -1;
+    for (size_t d = 0; d < shape.size(); ++d) {
+        if (shape[d] == -1 && inferred < 0) inferred = d;
+        else if (shape[d] < 0)
+            throw std::runtime_error("reshape takes sizes and one -1");
+        else known *= shape[d];
+    }
+    size_t n = numel(this->shape());
+    if (inferred >= 0 && known) shape[inferred] = n / known;
+    if (numel(shape) != n)
+        throw std::runtime_error("Can't reshape " + std::to_string(n)
+                + " elements to " + std::to_string(numel(shape)));
+    if (n == 0)
+        return view(shape, dense_strides(shape), 0);
+    // Walk both shapes in groups of dims holding the same elements.
+    // A group of this tensor has to be one stride run to be split
+    // into the new dims, the new strides continue that run.
+    std::vector<int> strides(shape.size());
+    const std::vector<int>& old = this->shape();
+    size_t i = 0, j = 0;
+    while (i < old.size() || j < shape.size()) {
+        size_t i1 = i, j1 = j;
+        size_t a = i1 < old.size() ? old[i1++] : 1;
+        size_t b = j1 < shape.size() ? shape[j1++] : 1;
+        while (a != b) {
+            if (a < b) a *= old[i1++];
+            else b *= shape[j1++];
+        }
+        // Trailing size 1 dims
+        while (i1 < old.size() && old[i1] == 1 && j1 == shape.size()) ++i1;
+        while (j1 < shape.size() && shape[j1] == 1 && i1 == old.size()) ++j1;
+        int inner = -1;
+        for (size_t k = i; k < i1; ++k) {
+            if (old[k] == 1) continue;
+            // Not a run, only a copy lays it out
+            if (inner >= 0 && this->strides()[inner] != this->strides()[k] * old[k])
+                return contiguous().reshape(shape);
+            inner = k;
+        }
+        int stride = inner >= 0 ? this->strides()[inner] : 1;
+        for (size_t k = j1; k-- > j;) {
+            strides[k] = stride;
+            stride *= shape[k];
+        }
+        i = i1;
+        j = j1;
+    }
+    return view(shape, strides, 0);
+}
+
+Tensor tensorlib::Tensor::expand(const std::vector<int>& new_shape) {
+    if (new_shape.size() < shape().size())
+        throw std::runtime_error("expand can't drop dims");
+    size_t lead = new_shape.size() - shape().size();
+    std::vector<int> shape = new_shape, strides(new_shape.size(), 0);
+    for (size_t d = lead; d < shape.size(); ++d) {
+        int size = this->shape()[d - lead];
+        if (shape[d] == -1) shape[d] = size;
+        if (shape[d] == size)
+            strides[d] = this->strides()[d - lead];
+        else if (size != 1)
+            throw std::runtime_error("Can't expand a dim of " + std::to_string(size)
+                    + " to " + std::to_string(shape[d]));
+    }
+    return view(shape, strides, 0);
+}
+
+Tensor tensorlib::Tensor::contiguous() {
+    if (is_contiguous())
+        return view(shape(), strides(), 0);
+    Tensor result = Tensor(
+        std::vector<uint8_t>(),
+        shape(),
+        requires_grad, dtype().repr, "cpu");
+    result.context.parents = {tuid()};
+    context.consumers++;
+    result.context.op = Op::Contiguous;
+    result.context.params = shape();
+    result.context.params.insert(result.context.params.end(),
+            strides().begin(), strides().end());
+    result.realized = false;
     return result;
 }
 
@@ -171,6 +913,19 @@ long long int tensorlib::Tensor::get_mem_size() {
     return context.data.size();
 }
 
+size_t tensorlib::Tensor::nbytes() const {
+    return dtype().nbytes(numel(shape()));
+}
+
+void tensorlib::Tensor::allocate() {
+    if (context.data.size() == nbytes()) return;
+    // Uninitialized, the kernel writes all of it
+    context.data = Storage(nbytes());
+    // Host memory doubles as device memory on CPU
+    if (context.device->name() == "cpu")
+        context.device->get()->assign(tuid(), get_raw_data_ptr(), get_mem_size());
+}
+
 void* tensorlib::Tensor::get_raw_data_ptr() {
     return static_cast<void*>(context.data.data());
 }
@@ -178,12 +933,15 @@ void* tensorlib::Tensor::get_raw_data_ptr() {
 void tensorlib::Tensor::switch_device_to(const std::string& device_name) {
     // Initialize once (TODO: can i remove this?)
     if (device_interfaces.empty()) {
-        device_interfaces["cpu"] = new tensorlib::Device("cpu");
-        device_interfaces["gpu"] = new tensorlib::Device("gpu");
+        device_interfaces["cpu"] = std::make_unique<tensorlib::Device>("cpu");
+        device_interfaces["gpu"] = std::make_unique<tensorlib::Device>("gpu");
     }
     if (device_interfaces.find(device_name) == device_interfaces.end())
         throw std::runtime_error("device not implemented");
-    context.device = device_interfaces[device_name];
+    context.device = device_interfaces[device_name].get();
+    // Host memory doubles as device memory on CPU
+    if (device_name == "cpu")
+        context.device->get()->assign(tuid(), get_raw_data_ptr(), get_mem_size());
 }
 
 void tensorlib::Tensor::to(const std::string& device_name) {
@@ -192,7 +950,7 @@ void tensorlib::Tensor::to(const std::string& device_name) {
     if (device_name == "gpu") {
         try {
 #ifdef RUN_METAL
-            auto new_device = device_interfaces[device_name];
+            auto& new_device = device_interfaces[device_name];
             new_device->get()->assign(this->tuid(), get_raw_data_ptr(), get_mem_size());
 #else
             throw std::runtime_error("device not enabled");
@@ -208,128 +966,70 @@ void tensorlib::Tensor::to(const std::string& device_name) {
     } else {
         //On movement to CPU, tensors must be fully realized.
         if (realized == false) {
-            // force realization
-            realize(true);
+            realize();
         }
-#ifdef RUN_METAL
         // Copy memory into data vector
         context.device->get()->copy_to_host(this->tuid(), get_raw_data_ptr(), get_mem_size());
-#endif
     }
     switch_device_to(device_name);
 }
 
-void tensorlib::Tensor::realize(bool force) {
+void tensorlib::Tensor::realize() {
     if (realized == true) return;
-    if (context.device->name() == "cpu") {
-        // TODO: can implement CPU parallelization
-        // and buffer the calculations.
-        // NOTE: Currently if not realized on CPU, it is an error
-        throw std::runtime_error(
-            "Tensor " + tuid() + " not realized, \
-            graph construction error."
-        );
-    }
-    // Explicitly move tensor to device to force memory assignment
-    to(context.device->name());
-    // Check if parents are realized.
-    bool parents_realized = true;
-    for (auto& parent : context.parents) {
-        // Parents are tuids, get tensor ptr from global map
-        auto& pt = global_tensor_map[parent];
-        if (pt->realized == false) {
-            parents_realized = false;
-            break;
-        }
-    }
-    // Parallel Realization //
-    // Make the threads continually make tree passes
-    // until they find a tensor that has realized parents.
-    //
-    // TODO: Bit of a clusterfuck, refactor
-    if (parents_realized == false) {
-        std::mutex lock;
-        auto tree_search = [&lock] (const std::string& tuid) {
-            auto& cur = global_tensor_map[tuid];
-            // Keep performing parallel BFS search on the graph.
-
-            // Reference wrapper lets you store references in containers.
-            std::map<
-                const std::string,
-                std::reference_wrapper<
-                    std::unique_ptr<Tensor>
-                >
-            > to_process;
-            while(cur->realized == false) {
-                to_process.clear();
-                to_process.insert({tuid, cur});
-                // Standard BFS just done with a map
-                while(!to_process.empty()) {
-                    auto front = *to_process.begin();
-                    to_process.erase(to_process.begin());
-                    auto& tensor_ptr = front.second.get();
-                    if (tensor_ptr->realized == true) continue;
-                    if (tensor_ptr->queued_realization == true) {
-                        // Check if realization complete,
-                        // if so, set to realized.
-                        tensor_ptr->realize();
-                    }
-                    // Check if parents are realized.
-                    bool parents_realized = true;
-                    for (auto& parent : tensor_ptr->context.parents) {
-                        auto& parent_pt = global_tensor_map[parent];
-                        if (parent_pt->realized == false) {
-                            parents_realized = false;
-                            to_process.insert({parent, parent_pt});
-                        }
-                    }
-                    // Realize tensor if:
-                    // 1. It is not already queued
-                    // 2. Parents are realized
-                    // 3. No other thread is realizing it
-                    if (tensor_ptr->queued_realization == false &&
-                            parents_realized == true &&
-                            lock.try_lock()) {
-                        tensor_ptr->realize();
-                        lock.unlock();
-                    }
-                }
+    // Only the unrealized part of the graph is built, what is
+    // realized already becomes an input.
+    Graph graph = build_graph(*this);
+    std::vector<Tensor*> subgraph;
+    for (uint32_t i = 0; i < graph.size(); ++i)
+        if (graph.nodes[i].op != Op::Load)
+            subgraph.push_back(graph.tensors[i]);
+    eliminate_common_subexpressions(graph);
+    fuse_elementwise(graph);
+
+    // Intermediates share one slab, the rest get memory of their own
+    MemoryPlan plan = plan_memory(graph, subgraph);
+    Storage slab(plan.slab_bytes);
+    std::vector<std::string> in_slab;
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        if (graph.nodes[i].op == Op::Load) continue;
+        Tensor& t = *graph.tensors[i];
+        if (graph.nodes[i].op == Op::View) {
+            // Aliases its input's memory, which comes first
+            uint32_t in = graph.inputs_of(i)[0];
+            auto params = graph.params_of(i);
+            size_t bytes = t.dtype().bytes;
+            size_t offset = params[0] * bytes;
+            size_t span = strided_span(graph.shape_of(i), params.subspan(1)) * bytes;
+            if (plan.offsets[in] != MemoryPlan::unplanned) {
+                t.context.data = Storage::external(
+                        slab.data() + plan.offsets[in] + offset, span);
+                in_slab.push_back(t.tuid());
+            } else {
+                t.context.data = graph.tensors[in]->context.data.view(offset, span);
             }
-        };
-        std::vector<std::thread> threads(NTHREADS);
-        for (int t = 0; t < NTHREADS; ++t)
-            threads.push_back(std::thread(tree_search, this->tuid()));
-
-        for (auto& thread : threads)
-            if (thread.joinable())
-                thread.join();
-    } else {
-        // Realize self -
-        // schedule realize on gpu as soon as you find a candidate,
-        // but don't block the thread on it.
-#ifdef RUN_METAL
-        switch (context.device->get()->get_cmdbuf_status(this->tuid())) {
-            case 1:
-                context.device->get()->schedule_realize(this->tuid());
-                this->queued_realization = true;
-                // Wait the thread for realization if forced
-                if (force == true) {
-                    context.device->get()->wait_for(this->tuid());
-                    this->realized = true;
-                }
-                break;
-            case 2:
-                break;
-            case 0:
-                this->realized = true;
-                break;
-            default:
-                throw std::runtime_error("Device " + context.device->name() + " processing error.");
+            t.context.device->get()->assign(t.tuid(), t.get_raw_data_ptr(), t.get_mem_size());
+            continue;
         }
-#else
-        throw std::runtime_error("device not enabled");
-#endif
+        if (plan.offsets[i] == MemoryPlan::unplanned) {
+            t.allocate();
+            continue;
+        }
+        t.context.device->get()->assign(t.tuid(),
+                slab.data() + plan.offsets[i], t.nbytes());
+        in_slab.push_back(t.tuid());
+    }
+    last_memory_plan = plan;
+    execute(graph);
+    // Computed tensors no longer need their parents. Parents come
+    // first, so nothing is dropped before the walk is past it.
+    for (uint32_t i = 0; i < graph.size(); ++i) {
+        if (graph.nodes[i].op == Op::Load) continue;
+        for (auto& parent : graph.tensors[i]->context.parents)
+            release_consumer(parent);
     }
+    // Everything placed in the slab was dropped above
+    for (auto& tuid : in_slab)
+        assert(global_tensor_map.count(tuid) == 0);
 }
 
 } // namespace tensorlib
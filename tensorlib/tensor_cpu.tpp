@@ -1,3 +1,185 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
 TensorCPUWrapper::TensorCPUWrapper() {
+    DBOUT << "Initializing TensorCPUWrapper" << std::endl;
+    tensorlib::cpu::register_kernels(compute_functions);
+    tensorlib::cpu::register_binders(kernel_binders);
+}
+
+TensorCPUWrapper::~TensorCPUWrapper() {
+    // Don't leave kernels running on memory that is about to go away
+    for (auto& it : tensor_cmdbuf_map)
+        if (it.second.done.valid())
+            it.second.done.wait();
+}
+
+void TensorCPUWrapper::assign(const std::string& tuid,
+                              void* raw_data,
+                              size_t mem_size) {
+    std::lock_guard<std::mutex> guard(lock);
+    // No copy, the tensor's own memory is used by the kernels.
+    tensor_membuf_map[tuid] = membuf{static_cast<uint8_t*>(raw_data), mem_size};
+}
+
+void TensorCPUWrapper::copy_to_host(const std::string& tuid,
+                                    void* raw_data,
+                                    size_t mem_size) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto buf = tensor_membuf_map.find(tuid);
+    if (buf == tensor_membuf_map.end() || buf->second.data == raw_data)
+        return;
+    std::memcpy(raw_data, buf->second.data, std::min(mem_size, buf->second.mem_size));
+}
+
+void TensorCPUWrapper::enqueue_kernel(
+        const std::vector<std::string>& tuids,
+        const std::string& rtuid,
+        const std::string& fn_name,
+        const std::vector<int>& params) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (compute_functions.find(fn_name) == compute_functions.end())
+        throw std::runtime_error("No cpu kernel named " + fn_name);
+    for (auto& tuid : tuids)
+        if (tensor_membuf_map.find(tuid) == tensor_membuf_map.end())
+            throw std::runtime_error("Tensor " + tuid + " has no memory on cpu.");
+    // Nothing runs yet, realization is deferred to schedule_realize.
+    tensor_cmdbuf_map.insert_or_assign(rtuid, kernel_info{
+        tuids,
+        rtuid,
+        fn_name,
+        params,
+        std::shared_future<void>()
+    });
+}
+
+std::function<void()> TensorCPUWrapper::bind_kernel(
+        const std::vector<std::string>& tuids,
+        const std::string& rtuid,
+        const std::string& fn_name,
+        const std::vector<int>& params) {
+    tensorlib::cpu::kernel_fn fn;
+    tensorlib::cpu::kernel_binder binder;
+    std::vector<const uint8_t*> inputs;
+    membuf result;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto bound = kernel_binders.find(fn_name);
+        if (bound != kernel_binders.end()) {
+            binder = bound->second;
+        } else {
+            auto found = compute_functions.find(fn_name);
+            if (found == compute_functions.end())
+                throw std::runtime_error("No cpu kernel named " + fn_name);
+            fn = found->second;
+        }
+        for (auto& tuid : tuids) {
+            auto buf = tensor_membuf_map.find(tuid);
+            if (buf == tensor_membuf_map.end())
+                throw std::runtime_error("Tensor " + tuid + " has no memory on cpu.");
+            inputs.push_back(buf->second.data);
+        }
+        auto found = tensor_membuf_map.find(rtuid);
+        if (found == tensor_membuf_map.end())
+            throw std::runtime_error("Tensor " + rtuid + " has no memory on cpu.");
+        result = found->second;
+    }
+    // Outside the lock, binding may compile
+    if (binder)
+        fn = binder(inputs.size(), params);
+    return [fn = std::move(fn), inputs = std::move(inputs), result, params] {
+        fn(inputs, result.data, result.mem_size, params);
+    };
+}
+
+void TensorCPUWrapper::run_kernel(const kernel_info& kinfo) {
+    std::vector<const uint8_t*> inputs;
+    membuf result;
+    tensorlib::cpu::kernel_fn fn;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& tuid : kinfo.parent_tuids)
+            inputs.push_back(tensor_membuf_map.at(tuid).data);
+        result = tensor_membuf_map.at(kinfo.rtuid);
+        fn = compute_functions.at(kinfo.fn_name);
+    }
+    // NOTE: Length of the result tensor handled by the TensorLibrary,
+    // Not the wrappers.
+    fn(inputs, result.data, result.mem_size, kinfo.params);
+}
+
+void TensorCPUWrapper::schedule_realize(const std::string& tuid) {
+    auto promise = std::make_shared<std::promise<void>>();
+    kernel_info info;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto kinfo = tensor_cmdbuf_map.find(tuid);
+        if (kinfo == tensor_cmdbuf_map.end()) {
+            VOUT << "Stray tensor being realized? tuid - " << tuid << std::endl;
+            return;
+        }
+        // Already committed
+        if (kinfo->second.done.valid()) return;
+        kinfo->second.done = promise->get_future().share();
+        info = kinfo->second;
+    }
+    // Outside the lock, without workers the pool runs it right here
+    tensorlib::ThreadPool::global().submit([this, promise, info] {
+        try {
+            run_kernel(info);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+void TensorCPUWrapper::wait_for(const std::string& tuid) {
+    std::shared_future<void> done;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto kinfo = tensor_cmdbuf_map.find(tuid);
+        // Ignore on miss
+        if (kinfo == tensor_cmdbuf_map.end()) return;
+        done = kinfo->second.done;
+    }
+    if (!done.valid()) return;
+    // Lend a hand to the pool rather than blocking,
+    // the kernel might be queued behind other work.
+    tensorlib::ThreadPool::global().wait_until([&done] {
+        return done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+}
+
+int TensorCPUWrapper::get_cmdbuf_status(const std::string& tuid) {
+    std::shared_future<void> done;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = tensor_cmdbuf_map.at(tuid).done;
+    }
+    // 0 - Completed
+    // 1 - Idle
+    // 2 - Busy
+    // -1 - Error
+    if (!done.valid())
+        return 1;
+    if (done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return 2;
+    try {
+        done.get();
+    } catch (std::exception& e) {
+        VOUT << "Kernel for " << tuid << " failed: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
 
+void TensorCPUWrapper::release(const std::string& tuid) {
+    // A kernel still running reads and writes this memory, so it has
+    // to finish before the tensor is forgotten.
+    wait_for(tuid);
+    std::lock_guard<std::mutex> guard(lock);
+    tensor_cmdbuf_map.erase(tuid);
+    tensor_membuf_map.erase(tuid);
 }
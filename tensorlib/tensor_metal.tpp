@@ -16,7 +16,7 @@ TensorMetalWrapper::TensorMetalWrapper(MTL::Device* device) {
     }
     // Initialize shader functions into pipelines
     // TODO: write more kernels
-    std::vector<const std::string> shader_functions = {
+    std::vector<std::string> shader_functions = {
         "mul_v_f32",
         "mul_v_i32",
         "mul_v_i64",
@@ -26,6 +26,12 @@ TensorMetalWrapper::TensorMetalWrapper(MTL::Device* device) {
         "sub_v_f32",
         "sub_v_i32",
         "sub_v_i64",
+        "div_v_f32",
+        "div_v_i32",
+        "div_v_i64",
+        "copy_v_f32",
+        "copy_v_i32",
+        "copy_v_i64",
         "mul_m_f32",
         "mul_m_i32",
         "mul_m_i64",
@@ -80,9 +86,10 @@ void TensorMetalWrapper::copy_to_host(const std::string& tuid,
 }
 
 void TensorMetalWrapper::enqueue_kernel(
-        const std::vector<const std::string>& tuids,
+        const std::vector<std::string>& tuids,
         const std::string& rtuid,
-        const std::string& fn_name) {
+        const std::string& fn_name,
+        const std::vector<int>& params) {
     MTL::CommandBuffer* cmd_buf = command_queue->commandBuffer();
     if (!cmd_buf) throw std::runtime_error("Failed to create command buffer on gpu.");
 
@@ -95,18 +102,32 @@ void TensorMetalWrapper::enqueue_kernel(
     for (unsigned long int i = 0; i < tuids.size(); ++i)
         encoder->setBuffer(tensor_membuf_map.at(tuids[i]), 0, i);
     encoder->setBuffer(tensor_membuf_map[rtuid], 0, tuids.size());
+    // Kernel params follow the result buffer
+    if (!params.empty())
+        encoder->setBytes(params.data(), params.size() * sizeof(int), tuids.size() + 1);
 
     // NOTE: Length of the result tensor handled by the TensorLibrary,
     // Not the wrappers.
     int tensorR_size = tensor_membuf_map[rtuid]->length();
 
-    MTL::Size grid_size = MTL::Size(tensorR_size, 1, 1);
-    // Calculate a threadgroup size.
     NS::UInteger maxthreads = fn->maxTotalThreadsPerThreadgroup();
-    MTL::Size thread_group_size = MTL::Size(
-                maxthreads > tensorR_size ? tensorR_size : maxthreads,
-                1, 1);
-    encoder->dispatchThreads(grid_size, thread_group_size);
+    if (fn_name.find("_m_") != std::string::npos) {
+        // Matrix kernels run one thread per output, params are {M, K, N}
+        NS::UInteger rows = params.at(0), cols = params.at(2);
+        NS::UInteger tg_cols = cols < 32 ? cols : 32;
+        NS::UInteger tg_rows = maxthreads / tg_cols;
+        MTL::Size grid_size = MTL::Size(cols, rows, 1);
+        MTL::Size thread_group_size = MTL::Size(
+                    tg_cols, tg_rows > rows ? rows : tg_rows, 1);
+        encoder->dispatchThreads(grid_size, thread_group_size);
+    } else {
+        MTL::Size grid_size = MTL::Size(tensorR_size, 1, 1);
+        // Calculate a threadgroup size.
+        MTL::Size thread_group_size = MTL::Size(
+                    maxthreads > tensorR_size ? tensorR_size : maxthreads,
+                    1, 1);
+        encoder->dispatchThreads(grid_size, thread_group_size);
+    }
     encoder->endEncoding();
 
     tensor_cmdbuf_map.insert(std::make_pair(rtuid, (kernel_info){
@@ -115,21 +136,15 @@ void TensorMetalWrapper::enqueue_kernel(
         tuids,
         rtuid,
         fn_name,
+        params,
         cmd_buf
     }));
 }
 
-void TensorMetalWrapper::requeue() {
-    for (auto it : to_requeue) {
-        enqueue_kernel(it.parent_tuids, it.rtuid, it.fn_name);
-    }
-}
-
 void TensorMetalWrapper::schedule_realize(const std::string& tuid) {
     try {
         auto kinfo = tensor_cmdbuf_map.at(tuid);
         kinfo.cmd_buf->commit();
-        to_requeue.push_back(kinfo);
     } catch (std::out_of_range& e) {
         VOUT << "Stray tensor being realized? tuid - " << tuid << std::endl;
     }
@@ -167,3 +182,18 @@ int TensorMetalWrapper::get_cmdbuf_status(const std::string& tuid) {
             return -1;
     }
 }
+
+void TensorMetalWrapper::release(const std::string& tuid) {
+    auto kinfo = tensor_cmdbuf_map.find(tuid);
+    if (kinfo != tensor_cmdbuf_map.end()) {
+        // Committed work still writes the buffer
+        if (get_cmdbuf_status(tuid) == 2)
+            kinfo->second.cmd_buf->waitUntilCompleted();
+        tensor_cmdbuf_map.erase(kinfo);
+    }
+    auto buf = tensor_membuf_map.find(tuid);
+    if (buf != tensor_membuf_map.end()) {
+        buf->second->release();
+        tensor_membuf_map.erase(buf);
+    }
+}
@@ -0,0 +1,185 @@
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include <utils.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define TL_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+    #define TL_CPU_RELAX() asm volatile("yield")
+#else
+    #define TL_CPU_RELAX() ((void)0)
+#endif
+
+namespace tensorlib {
+
+// Index of the worker running on this thread, -1 outside the pool
+inline thread_local int current_worker = -1;
+
+inline ThreadPool::ThreadPool(size_t nthreads) {
+    for (size_t i = 0; i < nthreads; ++i)
+        queues.emplace_back(new worker_queue());
+    for (size_t i = 0; i < nthreads; ++i)
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    DBOUT << "Started " << nthreads << " worker threads" << std::endl;
+}
+
+inline ThreadPool::~ThreadPool() {
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        wake.notify_all();
+    }
+    for (auto& worker : workers)
+        worker.join();
+}
+
+inline ThreadPool& ThreadPool::global() {
+    static ThreadPool pool([] {
+        size_t n = std::thread::hardware_concurrency();
+        if (const char* requested = std::getenv("TENSORLIB_NTHREADS"))
+            n = std::strtoul(requested, nullptr, 10);
+        // The thread waiting on the pool helps out, so one less worker
+        return n > 1 ? n - 1 : 0;
+    }());
+    return pool;
+}
+
+inline void ThreadPool::submit(task t) {
+    if (workers.empty()) {
+        // Nobody to hand it to
+        t();
+        return;
+    }
+    size_t index = current_worker >= 0
+        ? current_worker
+        : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(std::move(t));
+    }
+    pending.fetch_add(1);
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        wake.notify_one();
+    }
+}
+
+// Newest task of the own deque first, then steal the oldest
+// task of the others
+inline bool ThreadPool::pop(size_t start, task& t) {
+    if (pending.load(std::memory_order_relaxed) == 0)
+        return false;
+    for (size_t i = 0; i < queues.size(); ++i) {
+        auto& queue = *queues[(start + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            continue;
+        bool own = i == 0 && current_worker == (int)start;
+        if (own) {
+            t = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            t = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        pending.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+inline bool ThreadPool::run_pending() {
+    if (queues.empty()) return false;
+    task t;
+    size_t start = current_worker >= 0 ? current_worker : 0;
+    if (!pop(start, t)) return false;
+    t();
+    return true;
+}
+
+inline void ThreadPool::wait_until(const std::function<bool()>& done) {
+    int idle = 0;
+    while (!done()) {
+        if (run_pending()) {
+            idle = 0;
+        } else if (++idle < 64) {
+            TL_CPU_RELAX();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+inline void ThreadPool::worker_loop(size_t index) {
+    current_worker = index;
+    // Spin, then yield, then sleep. Graphs tend to hand out work in
+    // quick bursts, so a short spin saves most of the wakeups.
+    const int spin_limit = 256, yield_limit = 512;
+    int idle = 0;
+    task t;
+    while (!stopping) {
+        if (pop(index, t)) {
+            t();
+            t = nullptr;
+            idle = 0;
+            continue;
+        }
+        ++idle;
+        if (idle < spin_limit) {
+            for (int i = 0; i < 16; ++i) TL_CPU_RELAX();
+        } else if (idle < yield_limit) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            sleeping++;
+            // Timed, in case a wakeup slips in between the check and the wait
+            wake.wait_for(guard, std::chrono::milliseconds(10), [this] {
+                return stopping || pending.load() > 0;
+            });
+            sleeping--;
+            idle = 0;
+        }
+    }
+}
+
+inline void ThreadPool::parallel_for(size_t n, size_t grain,
+        const std::function<void(size_t, size_t)>& fn) {
+    if (n == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t nchunks = (n + grain - 1) / grain;
+    // Don't cut finer than there are threads to run the pieces
+    nchunks = std::min(nchunks, 4 * (workers.size() + 1));
+    if (nchunks <= 1 || workers.empty()) {
+        fn(0, n);
+        return;
+    }
+    size_t chunk = (n + nchunks - 1) / nchunks;
+    nchunks = (n + chunk - 1) / chunk;
+
+    // Shared with the helpers, which may only get to run after
+    // every chunk is already taken.
+    struct state {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+    };
+    auto shared = std::make_shared<state>();
+    auto run_chunks = [shared, n, chunk, nchunks, &fn] {
+        size_t c;
+        while ((c = shared->next.fetch_add(1)) < nchunks) {
+            fn(c * chunk, std::min(n, (c + 1) * chunk));
+            shared->finished.fetch_add(1);
+        }
+    };
+    size_t helpers = std::min(nchunks - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i)
+        // fn is only touched while a chunk is unfinished,
+        // and this function doesn't return before that.
+        submit(run_chunks);
+    run_chunks();
+    wait_until([&] { return shared->finished.load() == nchunks; });
+}
+
+} // namespace tensorlib
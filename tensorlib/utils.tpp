@@ -1,38 +1,64 @@
 #include <iostream>
 
+// One element, as the dtype stores it
+static void __print_element(std::ostream& os,
+        const tensorlib::DType& dtype,
+        const uint8_t* data,
+        size_t index) {
+    const std::string& repr = dtype.repr;
+    auto read = [&](auto value) {
+        std::memcpy(&value, data + index * sizeof(value), sizeof(value));
+        return value;
+    };
+    if (repr == "f32")
+        os << read(float());
+    else if (repr == "f16")
+        os << tensorlib::fp16_to_fp32(read(uint16_t()));
+    else if (repr == "bf16")
+        os << tensorlib::bf16_to_fp32(read(uint16_t()));
+    else if (repr == "i32")
+        os << read(int32_t());
+    else if (repr == "i64")
+        os << read(int64_t());
+    else
+        os << "?";
+}
+
 void __print_util(std::ostream& os,
         const tensorlib::Tensor& tensor,
         int shape_idx,
-        int offset,
-        int par_size) {
-    int dim_i = tensor.shape[shape_idx];
-    int elems_per_vec = par_size/dim_i;
+        size_t offset) {
+    const std::vector<int>& shape = tensor.shape();
+    const uint8_t* data = tensor.context.data.data();
+    if (shape.empty()) {
+        __print_element(os, tensor.dtype(), data, offset);
+        return;
+    }
+    int dim_i = shape[shape_idx];
+    size_t stride = tensor.strides()[shape_idx];
     os << "[";
-    if (shape_idx == tensor.shape.size() - 1) {
-        for (int i = 0; i < dim_i; ++i) {
-            os << tensor.data[offset + i];
-            if (i != dim_i - 1) {
-                os << ",";
-            }
-        }
-    } else {
-        for  (int i = 0; i < dim_i; ++i) {
-            __print_util(os, tensor, shape_idx+1, offset+elems_per_vec*i, elems_per_vec);
-            if (i != dim_i - 1) {
-                os << ",";
-            }
+    for (int i = 0; i < dim_i; ++i) {
+        if (shape_idx + 1 == (int)shape.size())
+            __print_element(os, tensor.dtype(), data, offset + i * stride);
+        else
+            __print_util(os, tensor, shape_idx+1, offset + i * stride);
+        if (i != dim_i - 1) {
+            os << ",";
         }
     }
     os << "]";
 }
 
 std::ostream& operator<<(std::ostream& os, tensorlib::Tensor& tensor) {
-    // Only print if on CPU
+    // Only print if on CPU, packed blocks aren't elements
     os << "Tensor(";
-    if (tensor.device->name() == "cpu")
-        __print_util(os, tensor, 0, 0, tensor.data.size());
-    else
+    if (tensor.context.device->name() != "cpu" || !tensor.realized)
         os << "<unrealized>";
-    os << ", dtype=" << tensor.dtype << ", device=" << tensor.device->name() << ")";
+    else if (tensor.dtype().block != 1)
+        os << "<packed>";
+    else
+        __print_util(os, tensor, 0, 0);
+    os << ", dtype=" << tensor.dtype().repr << ", device="
+       << tensor.context.device->name() << ")";
     return os;
 }
@@ -18,8 +18,20 @@ using namespace tensorlib;
 
 /* include TEST files */
 #include "test_arith.hpp"
+#include "test_matmul.hpp"
+#include "test_graph.hpp"
+#include "test_storage.hpp"
+#include "test_views.hpp"
+#include "test_reduce.hpp"
+#include "test_norm.hpp"
 
 int main() {
     RUN_ARITH_TESTS();
+    RUN_MATMUL_TESTS();
+    RUN_GRAPH_TESTS();
+    RUN_STORAGE_TESTS();
+    RUN_VIEW_TESTS();
+    RUN_REDUCE_TESTS();
+    RUN_NORM_TESTS();
     return 0;
 }
@@ -1,9 +1,12 @@
+#include <sstream>
+#include <jit_cpu.hpp>
+
 bool test_add() {
-    DISABLE_TEST();
     Tensor t0(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
     Tensor t1(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
     Tensor t2 = t0 + t1;
     Tensor t3(vector<int>{2, 4, 6, 8, 10, 12}, {2, 3});
+    t2.to("cpu");
     return t2 == t3;
 }
 
@@ -29,14 +32,25 @@ bool test_add_gpu_cpu() {
 }
 
 bool test_add_float() {
-    DISABLE_TEST();
     Tensor t0(vector<float>{1.2, 2, 3, 4, 5, 6}, {2, 3});
     Tensor t1(vector<float>{1, 2.3, 3, 4, 5, 6}, {2, 3});
     Tensor t2 = t0 + t1;
     Tensor t3(vector<float>{2.2, 4.3, 6, 8, 10, 12}, {2, 3});
+    t2.to("cpu");
     return t2 == t3;
 }
 
+bool test_lazy_chain() {
+    Tensor t0(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor t1(vector<int>{1, 1, 1, 1, 1, 1}, {2, 3});
+    Tensor t2 = t0 + t1;
+    Tensor t3 = t2 * t0;
+    Tensor t4 = t3 - t1;
+    Tensor t5(vector<int>{1, 5, 11, 19, 29, 41}, {2, 3});
+    t4.to("cpu");
+    return t4 == t5;
+}
+
 bool test_add_float_gpu() {
     Tensor t0(vector<float>{1.2, 2, 3, 4, 5, 6}, {2, 3});
     Tensor t1(vector<float>{1, 2.3, 3, 4, 5, 6}, {2, 3});
@@ -59,12 +73,270 @@ bool test_sub_gpu() {
     return t2 == t3;
 }
 
+bool test_wide_graph() {
+    // Two independent branches joined at the root
+    Tensor t0(vector<int>{1, 2, 3, 4}, {2, 2});
+    Tensor t1(vector<int>{5, 6, 7, 8}, {2, 2});
+    Tensor l0 = t0 * t1;
+    Tensor l1 = l0 + t0;
+    Tensor r0 = t1 - t0;
+    Tensor r1 = r0 * r0;
+    Tensor root = l1 + r1;
+    Tensor expected(vector<int>{22, 30, 40, 52}, {2, 2});
+    root.to("cpu");
+    return root == expected;
+}
+
+bool test_div() {
+    Tensor t0(vector<int>{2, 4, 6, 8, 10, 12}, {2, 3});
+    Tensor t1(vector<int>{1, 2, 3, 4, 5, 5}, {2, 3});
+    Tensor t2 = t0 / t1;
+    Tensor t3(vector<int>{2, 2, 2, 2, 2, 2}, {2, 3});
+    t2.to("cpu");
+    return t2 == t3;
+}
+
+bool test_div_int_edges() {
+    // Division by zero gives 0 and the minimum over -1 wraps to itself,
+    // rather than a SIGFPE. Dense, broadcast, and fused with and
+    // without the JIT.
+    constexpr int32_t min32 = INT32_MIN;
+    constexpr int64_t min64 = INT64_MIN;
+    Tensor a(vector<int>{7, -7, min32, min32, 5, 0}, {2, 3});
+    Tensor b(vector<int>{0, 0, -1, 1, -1, 0}, {2, 3});
+    Tensor q = a / b;
+    q.to("cpu");
+    Tensor wide(vector<int64_t>{min64, 9, -4, min64}, {2, 2});
+    Tensor zero(vector<int64_t>{0}, {1});
+    Tensor minus(vector<int64_t>{-1}, {1});
+    Tensor by_zero = wide / zero;
+    Tensor by_minus = wide / minus;
+    by_zero.to("cpu");
+    by_minus.to("cpu");
+    bool fused = true;
+    for (bool jit : {false, true}) {
+        cpu::jit::set_enabled(jit);
+        Tensor c(vector<int>{1, 1, 1, 1, 1, 1}, {2, 3});
+        Tensor f = (a / b) + c;
+        f.to("cpu");
+        fused = fused && f == Tensor(vector<int>{1, 1, min32 + 1, min32 + 1, -4, 1}, {2, 3});
+    }
+    cpu::jit::set_enabled(true);
+    return q == Tensor(vector<int>{0, 0, min32, min32, -5, 0}, {2, 3})
+        && by_zero == Tensor(vector<int64_t>{0, 0, 0, 0}, {2, 2})
+        && by_minus == Tensor(vector<int64_t>{min64, -9, 4, min64}, {2, 2})
+        && fused;
+}
+
+bool test_mul_div_float_large() {
+    // Long enough to cover the vector body and the scalar tail
+    int n = 1000;
+    vector<float> a(n), b(n), expected(n);
+    for (int i = 0; i < n; ++i) {
+        a[i] = i * 0.5f;
+        b[i] = (i % 7) + 1.0f;
+        expected[i] = (a[i] * b[i]) / b[i];
+    }
+    Tensor t0(a, {n});
+    Tensor t1(b, {n});
+    Tensor t2 = t0 * t1;
+    Tensor t3 = t2 / t1;
+    Tensor t4(expected, {n});
+    t3.to("cpu");
+    return t3 == t4;
+}
+
+template <typename H>
+bool half_arith() {
+    // Vector bodies with a tail, and a chain fused into one pass
+    int n = 3000 + 5;
+    vector<H> a(n), b(n), c(n), sum(n), chain(n);
+    for (int i = 0; i < n; ++i) {
+        a[i] = H((i % 97) * 0.25f - 7.f);
+        b[i] = H((i % 13) + 1.5f);
+        c[i] = H(0.5f + i % 3);
+        float fa = float(a[i]), fb = float(b[i]), fc = float(c[i]);
+        sum[i] = H(fa + fb);
+        // Computed in f32, rounded once at the end
+        chain[i] = H((fa * fb - fc) / fb);
+    }
+    Tensor ta(a, {n}), tb(b, {n}), tc(c, {n});
+    Tensor t0 = ta + tb;
+    Tensor t1 = ((ta * tb) - tc) / tb;
+    t0.to("cpu");
+    t1.to("cpu");
+    Tensor e0(sum, {n}), e1(chain, {n});
+    return t0 == e0 && t1 == e1 && t1.dtype() == ta.dtype();
+}
+
+bool test_half_arith() {
+    Tensor f(vector<float16>{float16(1.f)}, {1});
+    Tensor bf(vector<bfloat16>{bfloat16(1.f)}, {1});
+    return f.dtype().repr == "f16" && bf.dtype().repr == "bf16"
+        && half_arith<float16>() && half_arith<bfloat16>();
+}
+
+bool test_half_cast() {
+    int n = 4096 + 11;
+    vector<float> x(n);
+    vector<float16> h(n);
+    vector<bfloat16> bh(n);
+    for (int i = 0; i < n; ++i) {
+        // Ties, values between halves, negatives, and past f16's range
+        x[i] = (i % 2 ? -1.f : 1.f) * (1.f + (i % 2048) / 2048.f)
+            * std::ldexp(1.f, i % 40 - 20);
+        // f32 subnormals, bf16 keeps them on every ISA
+        if (i % 53 == 7) x[i] = std::ldexp(x[i], -128 - i % 20);
+        h[i] = float16(x[i]);
+        bh[i] = bfloat16(x[i]);
+    }
+    x[0] = INFINITY;
+    h[0] = float16(x[0]);
+    bh[0] = bfloat16(x[0]);
+    Tensor tx(x, {n});
+    Tensor th = tx.astype("f16");
+    Tensor tb = tx.astype("bf16");
+    Tensor back = th.astype("f32");
+    Tensor across = tb.astype("f16");
+    th.to("cpu");
+    tb.to("cpu");
+    back.to("cpu");
+    across.to("cpu");
+    vector<float> wide(n);
+    vector<float16> narrowed(n);
+    for (int i = 0; i < n; ++i) {
+        wide[i] = float(h[i]);
+        narrowed[i] = float16(float(bh[i]));
+    }
+    Tensor eh(h, {n}), eb(bh, {n}), ew(wide, {n}), ea(narrowed, {n});
+    bool threw = false;
+    try {
+        Tensor ints(vector<int>{1, 2}, {2});
+        ints.astype("f16");
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    return th == eh && tb == eb && back == ew && across == ea && threw;
+}
+
+bool test_print_half() {
+    Tensor t(vector<float16>{float16(1.5f), float16(-2.f),
+                             float16(0.25f), float16(4.f)}, {2, 2});
+    Tensor b(vector<bfloat16>{bfloat16(3.f)}, {1});
+    std::ostringstream os;
+    os << t << " " << b;
+    return os.str() == "Tensor([[1.5,-2],[0.25,4]], dtype=f16, device=cpu) "
+                       "Tensor([3], dtype=bf16, device=cpu)";
+}
+
+bool test_broadcast_bias() {
+    // Bias over the rows of activations, read once per row, never expanded
+    int M = 37, N = 300;
+    vector<float> x(M * N), bias(N), expected(M * N);
+    for (int j = 0; j < N; ++j) bias[j] = j * 0.25f - 30;
+    for (int i = 0; i < M * N; ++i) {
+        x[i] = (i % 101) * 0.5f;
+        expected[i] = x[i] + bias[i % N];
+    }
+    Tensor tx(x, {M, N});
+    Tensor tb(bias, {N});
+    Tensor r = tx + tb;
+    uint64_t before = kernel_dispatch_count;
+    r.to("cpu");
+    // Scale by rows, a column of one per row
+    vector<int> rows{1, 2, 3}, m(12), scaled(12);
+    for (int i = 0; i < 12; ++i) {
+        m[i] = i;
+        scaled[i] = i * rows[i / 4];
+    }
+    Tensor tm(m, {3, 4});
+    Tensor tr(rows, {3, 1});
+    Tensor s = tr * tm;
+    s.to("cpu");
+    return r.shape() == vector<int>{M, N} && kernel_dispatch_count == before + 2
+        && r == Tensor(expected, {M, N}) && s == Tensor(scaled, {3, 4});
+}
+
+bool test_broadcast_scalar() {
+    // One long run, spread over threads with the scalar repeated
+    int n = (1 << 17) + 6;
+    vector<float> x(n), expected(n);
+    for (int i = 0; i < n; ++i) {
+        x[i] = i % 1000;
+        expected[i] = x[i] / 4;
+    }
+    Tensor tx(x, {2, n / 2, 1});
+    Tensor four(vector<float>{4}, {});
+    Tensor r = tx / four;
+    Tensor one(vector<float>{1}, {1});
+    Tensor l = one - four;
+    r.to("cpu");
+    l.to("cpu");
+    return r == Tensor(expected, {2, n / 2, 1}) && l == Tensor(vector<float>{-3}, {1});
+}
+
+bool test_broadcast_shapes() {
+    // (2, 1, 3) and (4, 1) meet at (2, 4, 3)
+    vector<int64_t> a(6), b{10, 20, 30, 40}, expected(24);
+    for (int i = 0; i < 6; ++i) a[i] = i;
+    for (int i = 0; i < 24; ++i)
+        expected[i] = a[i / 12 * 3 + i % 3] - b[i / 3 % 4];
+    Tensor ta(a, {2, 1, 3});
+    Tensor tb(b, {4, 1});
+    Tensor r = ta - tb;
+    r.to("cpu");
+    // Strided views are read in place, no copy first
+    Tensor c(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor d(vector<int>{1, 1, 1, 2, 2, 2}, {3, 2});
+    Tensor ct = c.transpose(0, 1);
+    Tensor sum = ct + d;
+    uint64_t before = kernel_dispatch_count;
+    sum.to("cpu");
+    bool in_place = kernel_dispatch_count == before + 1;
+    // Halves broadcast too
+    Tensor h(vector<float>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor hh = h.astype("bf16");
+    Tensor g(vector<float>{0.5, 1, 2}, {3});
+    Tensor gh = g.astype("bf16");
+    Tensor prod = hh * gh;
+    Tensor back = prod.astype("f32");
+    back.to("cpu");
+    bool threw = false, mismatched = false;
+    Tensor e(vector<int>{1, 2, 3, 4}, {4});
+    Tensor f(vector<float>{1, 2, 3}, {3});
+    try {
+        Tensor bad = c + e;
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    try {
+        Tensor bad = f + ct;
+    } catch (std::runtime_error&) {
+        mismatched = true;
+    }
+    return r.shape() == vector<int>{2, 4, 3} && r == Tensor(expected, {2, 4, 3})
+        && in_place && sum == Tensor(vector<int>{2, 5, 3, 7, 5, 8}, {3, 2})
+        && back == Tensor(vector<float>{0.5, 2, 6, 2, 5, 12}, {2, 3})
+        && threw && mismatched;
+}
+
 // ADD TESTS TO THIS MACRO
 #define RUN_ARITH_TESTS() \
     IS_TRUE(test_add(), "test_add"); \
     IS_TRUE(test_add_gpu(), "test_add_gpu"); \
     IS_TRUE(test_add_gpu_cpu(), "test_add_gpu_cpu"); \
     IS_TRUE(test_add_float(), "test_add_float"); \
+    IS_TRUE(test_lazy_chain(), "test_lazy_chain"); \
     IS_TRUE(test_add_float_gpu(), "test_add_float_gpu"); \
     IS_TRUE(test_sub_gpu(), "test_sub_gpu"); \
+    IS_TRUE(test_wide_graph(), "test_wide_graph"); \
+    IS_TRUE(test_div(), "test_div"); \
+    IS_TRUE(test_div_int_edges(), "test_div_int_edges"); \
+    IS_TRUE(test_mul_div_float_large(), "test_mul_div_float_large"); \
+    IS_TRUE(test_half_arith(), "test_half_arith"); \
+    IS_TRUE(test_half_cast(), "test_half_cast"); \
+    IS_TRUE(test_print_half(), "test_print_half"); \
+    IS_TRUE(test_broadcast_bias(), "test_broadcast_bias"); \
+    IS_TRUE(test_broadcast_scalar(), "test_broadcast_scalar"); \
+    IS_TRUE(test_broadcast_shapes(), "test_broadcast_shapes"); \
     std::cout << "arith tests finished ✓" << std::endl;
@@ -0,0 +1,248 @@
+#include <memory>
+#include <jit_cpu.hpp>
+
+bool test_graph_ir() {
+    Tensor t0(vector<int>{1, 2, 3, 4}, {2, 2});
+    Tensor t1(vector<int>{5, 6, 7, 8}, {2, 2});
+    Tensor t2 = t0 + t1;
+    Tensor t3 = t0 * t1;
+    Tensor t4 = t2 - t3;
+    Graph graph = build_graph(t4);
+    // t0 and t1 are loads, shared by both branches
+    if (graph.size() != 5 || graph.root != 4) return false;
+    if (graph.tensors[graph.root] != &t4) return false;
+    for (uint32_t i = 0; i < graph.size(); ++i)
+        for (uint32_t in : graph.inputs_of(i))
+            if (in >= i) return false;
+    auto in = graph.inputs_of(graph.root);
+    if (graph.tensors[in[0]] != &t2 || graph.tensors[in[1]] != &t3)
+        return false;
+    GraphUsers users = graph_users(graph);
+    if (users.of(in[0]).size() != 1 || users.of(in[0])[0] != graph.root)
+        return false;
+    t4.to("cpu");
+    Tensor t5(vector<int>{1, -4, -11, -20}, {2, 2});
+    // Realized tensors are loads from now on
+    return t4 == t5 && build_graph(t4).size() == 1
+        && graph.nodes[graph.root].op == Op::Sub
+        && graph.shape_of(graph.root).size() == 2;
+}
+
+bool test_graph_long_chain() {
+    // Deep enough to overflow a recursive walk
+    int n = 20000;
+    Tensor one(vector<int>{1, 1, 1}, {3});
+    std::vector<std::unique_ptr<Tensor>> chain;
+    chain.emplace_back(new Tensor(vector<int>{0, 1, 2}, {3}));
+    for (int i = 0; i < n; ++i)
+        chain.emplace_back(new Tensor(*chain.back() + one));
+    Tensor expected(vector<int>{n, n + 1, n + 2}, {3});
+    chain.back()->to("cpu");
+    bool ok = *chain.back() == expected;
+    // Users go first
+    while (!chain.empty()) chain.pop_back();
+    return ok;
+}
+
+bool test_cse_dispatches() {
+    Tensor a(vector<int>{1, 2, 3, 4}, {2, 2});
+    Tensor b(vector<int>{5, 6, 7, 8}, {2, 2});
+    Tensor c(vector<int>{1, 0, 0, 1}, {2, 2});
+    Tensor x0 = a.matmul(b);
+    Tensor x1 = a.matmul(b);
+    Tensor y0 = x0.matmul(c);
+    Tensor y1 = x1.matmul(c);
+    Tensor r = y0 + y1;
+    uint64_t before = kernel_dispatch_count;
+    r.to("cpu");
+    // Two matmuls and the root instead of five kernels
+    bool merged = kernel_dispatch_count - before == 3;
+    Tensor expected(vector<int>{38, 44, 86, 100}, {2, 2});
+    // Duplicates still read back, as a copy
+    before = kernel_dispatch_count;
+    y1.to("cpu");
+    Tensor expected_y(vector<int>{19, 22, 43, 50}, {2, 2});
+    return merged && r == expected && y1 == expected_y
+        && kernel_dispatch_count - before == 1;
+}
+
+bool test_fusion() {
+    Tensor a(vector<float>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor b(vector<float>{6, 5, 4, 3, 2, 1}, {2, 3});
+    Tensor c(vector<float>{2, 2, 2, 2, 2, 2}, {2, 3});
+    Tensor d(vector<float>{1, 1, 1, 1, 1, 1}, {2, 3});
+    Tensor sum = a + b;
+    Tensor den = a - d + c;
+    Tensor r = (sum * c - d) / den;
+    uint64_t before = kernel_dispatch_count;
+    r.to("cpu");
+    // One pass for the whole expression
+    bool fused = kernel_dispatch_count - before == 1;
+    Tensor expected(vector<float>{13.f / 2, 13.f / 3, 13.f / 4,
+                                  13.f / 5, 13.f / 6, 13.f / 7}, {2, 3});
+    // Folded away, computed once it is asked for
+    before = kernel_dispatch_count;
+    sum.to("cpu");
+    Tensor expected_sum(vector<float>{7, 7, 7, 7, 7, 7}, {2, 3});
+    return fused && r == expected && sum == expected_sum
+        && kernel_dispatch_count - before == 1;
+}
+
+bool test_fusion_large() {
+    // Spans many tiles and threads, with a tail
+    int n = (1 << 18) + 77;
+    vector<int64_t> a(n), b(n), expected(n);
+    for (int i = 0; i < n; ++i) {
+        a[i] = i % 1000 - 500;
+        b[i] = i % 7 + 1;
+        expected[i] = (a[i] * b[i] - b[i]) / b[i] + a[i] * a[i];
+    }
+    Tensor ta(a, {n});
+    Tensor tb(b, {n});
+    Tensor sq = ta * ta;
+    Tensor r = ((ta * tb - tb) / tb) + sq;
+    Tensor te(expected, {n});
+    r.to("cpu");
+    return r == te;
+}
+
+bool test_dce_temporaries() {
+    size_t registered = global_tensor_map.size();
+    bool ok;
+    {
+        Tensor a(vector<int>{1, 2, 3, 4}, {2, 2});
+        Tensor b(vector<int>{5, 6, 7, 8}, {2, 2});
+        Tensor c(vector<int>{2, 2, 2, 2}, {2, 2});
+        // Both temporaries outlive their handles until r is realized
+        Tensor r = ((a + b) * c) - a;
+        bool kept = global_tensor_map.size() == registered + 6;
+        r.to("cpu");
+        Tensor expected(vector<int>{11, 14, 17, 20}, {2, 2});
+        ok = kept && r == expected
+            && global_tensor_map.size() == registered + 5;
+        // Never realized, goes away with everything only it needed
+        Tensor unread = ((a * b) + c) * a;
+    }
+    return ok && global_tensor_map.size() == registered;
+}
+
+bool test_fusion_jit() {
+    // Nothing to check without a compiler, every kernel is interpreted
+    if (!cpu::jit::available())
+        DISABLE_TEST();
+    int n = 100003;
+    vector<float> a(n), b(n);
+    for (int i = 0; i < n; ++i) {
+        a[i] = (i % 113) * 0.37f - 9.f;
+        b[i] = (i % 17) * 0.5f + 1.f;
+    }
+    Tensor ta(a, {n});
+    Tensor tb(b, {n});
+    // Interpreted, then compiled (or loaded from the disk cache)
+    cpu::jit::set_enabled(false);
+    Tensor r0 = ((ta - tb) * tb + ta) / tb;
+    r0.to("cpu");
+    cpu::jit::set_enabled(true);
+    cpu::jit::Stats before = cpu::jit::stats();
+    Tensor r1 = ((ta - tb) * tb + ta) / tb;
+    r1.to("cpu");
+    cpu::jit::Stats after = cpu::jit::stats();
+    // Built for real, r1 isn't the interpreter's again
+    bool built = after.compiled + after.loaded == before.compiled + before.loaded + 1
+        && after.failed == before.failed;
+    // Same program, no second build
+    Tensor r2 = ((ta - tb) * tb + ta) / tb;
+    r2.to("cpu");
+    before = cpu::jit::stats();
+    return built && r0 == r1 && r1 == r2
+        && before.compiled == after.compiled && before.loaded == after.loaded;
+}
+
+bool test_memory_plan_chain() {
+    int n = 16;
+    vector<float> x(n * n), w(n * n, 0), expected(n * n);
+    for (int i = 0; i < n * n; ++i) {
+        x[i] = i % 7;
+        expected[i] = 32 * x[i];
+    }
+    for (int i = 0; i < n; ++i) w[i * n + i] = 2;
+    Tensor tx(x, {n, n});
+    Tensor tw(w, {n, n});
+    // Four intermediates, never more than two alive at once
+    Tensor r = tx.matmul(tw).matmul(tw).matmul(tw).matmul(tw).matmul(tw);
+    r.to("cpu");
+    size_t bytes = n * n * sizeof(float);
+    Tensor te(expected, {n, n});
+    return r == te
+        && last_memory_plan.intermediate_bytes == 4 * bytes
+        && last_memory_plan.slab_bytes == 2 * bytes
+        && last_memory_plan.output_bytes == bytes
+        && last_memory_plan.peak_bytes() == 3 * bytes;
+}
+
+bool test_memory_plan_branches() {
+    // Independent branches reusing each other's memory, the planner
+    // has to keep them from running over one another.
+    int n = 48;
+    vector<int> x(n * n), w(n * n, 0);
+    for (int i = 0; i < n * n; ++i) x[i] = i % 11 - 5;
+    for (int i = 0; i < n; ++i) w[i * n + i] = 1;
+    Tensor tx(x, {n, n});
+    // Distinct weights, CSE would merge the branches otherwise
+    Tensor w0(w, {n, n});
+    Tensor w1(w, {n, n});
+    Tensor w2(w, {n, n});
+    Tensor l = tx.matmul(w0).matmul(w0).matmul(w0);
+    Tensor m = tx.matmul(w1).matmul(w1).matmul(w1);
+    Tensor r = tx.matmul(w2).matmul(w2) - m;
+    Tensor sum = l + r;
+    sum.to("cpu");
+    Tensor te(x, {n, n});
+    return sum == te && last_memory_plan.slab_bytes > 0;
+}
+
+bool test_tensor_move() {
+    size_t registered = global_tensor_map.size();
+    bool ok;
+    {
+        Tensor a(vector<int>{1, 2, 3, 4}, {2, 2});
+        const uint8_t* bytes = a.context.data.data();
+        std::string name = a.tuid();
+        Tensor b = std::move(a);
+        // Same memory, registry follows the move
+        ok = b.context.data.data() == bytes
+            && global_tensor_map.at(name).get() == &b
+            && global_tensor_map.size() == registered + 1;
+        // Reallocations move every element
+        std::vector<Tensor> all;
+        for (int i = 0; i < 10; ++i)
+            all.push_back(Tensor(vector<int>{i, i, i, i}, {2, 2}));
+        Tensor sum = all[0] + all[1];
+        for (int i = 2; i < 10; ++i) sum = sum + all[i];
+        sum.to("cpu");
+        Tensor expected(vector<int>{45, 45, 45, 45}, {2, 2});
+        ok = ok && sum == expected;
+        // The old value of c is still needed by d, and kept until then
+        Tensor c = b + b;
+        Tensor d = c * b;
+        c = std::move(b);
+        d.to("cpu");
+        Tensor expected_d(vector<int>{2, 8, 18, 32}, {2, 2});
+        ok = ok && d == expected_d && c.tuid() == name;
+    }
+    return ok && global_tensor_map.size() == registered;
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_GRAPH_TESTS() \
+    IS_TRUE(test_graph_ir(), "test_graph_ir"); \
+    IS_TRUE(test_graph_long_chain(), "test_graph_long_chain"); \
+    IS_TRUE(test_cse_dispatches(), "test_cse_dispatches"); \
+    IS_TRUE(test_dce_temporaries(), "test_dce_temporaries"); \
+    IS_TRUE(test_tensor_move(), "test_tensor_move"); \
+    IS_TRUE(test_fusion(), "test_fusion"); \
+    IS_TRUE(test_fusion_large(), "test_fusion_large"); \
+    IS_TRUE(test_fusion_jit(), "test_fusion_jit"); \
+    IS_TRUE(test_memory_plan_chain(), "test_memory_plan_chain"); \
+    IS_TRUE(test_memory_plan_branches(), "test_memory_plan_branches"); \
+    std::cout << "graph tests finished ✓" << std::endl;
@@ -0,0 +1,199 @@
+// Reference result, naive triple loop
+template <typename T>
+vector<T> naive_matmul(const vector<T>& a, const vector<T>& b, int M, int K, int N) {
+    vector<T> c(M * N, 0);
+    for (int i = 0; i < M; ++i)
+        for (int k = 0; k < K; ++k)
+            for (int j = 0; j < N; ++j)
+                c[i * N + j] += a[i * K + k] * b[k * N + j];
+    return c;
+}
+
+bool test_matmul_small() {
+    Tensor t0(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor t1(vector<int>{1, 2, 3, 4, 5, 6}, {3, 2});
+    Tensor t2 = t0.matmul(t1);
+    Tensor t3(vector<int>{22, 28, 49, 64}, {2, 2});
+    t2.to("cpu");
+    return t2 == t3;
+}
+
+bool test_matmul_i64_edges() {
+    // Sizes that are not multiples of the register tile
+    int M = 37, K = 300, N = 45;
+    vector<long long> a(M * K), b(K * N);
+    for (int i = 0; i < M * K; ++i) a[i] = (i % 13) - 6;
+    for (int i = 0; i < K * N; ++i) b[i] = (i % 7) - 3;
+    Tensor t0(a, {M, K});
+    Tensor t1(b, {K, N});
+    Tensor t2 = t0.matmul(t1);
+    Tensor t3(naive_matmul(a, b, M, K, N), {M, N});
+    t2.to("cpu");
+    return t2 == t3;
+}
+
+bool test_matmul_float_blocks() {
+    // Spans several KC and MC blocks
+    int M = 200, K = 600, N = 70;
+    vector<float> a(M * K), b(K * N);
+    for (int i = 0; i < M * K; ++i) a[i] = (i % 5) * 0.25f;
+    for (int i = 0; i < K * N; ++i) b[i] = (i % 3) * 0.5f;
+    Tensor t0(a, {M, K});
+    Tensor t1(b, {K, N});
+    Tensor t2 = t0.matmul(t1);
+    // Values are exact in float, so the order of summation doesn't matter
+    Tensor t3(naive_matmul(a, b, M, K, N), {M, N});
+    t2.to("cpu");
+    return t2 == t3;
+}
+
+bool test_matmul_shape_mismatch() {
+    Tensor t0(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor t1(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    try {
+        Tensor t2 = t0.matmul(t1);
+    } catch (std::runtime_error& e) {
+        return true;
+    }
+    return false;
+}
+
+template <typename H>
+bool half_matmul() {
+    // Several KC blocks, edges, and f32 accumulation: a sum of 600
+    // products rounded once
+    int M = 33, K = 600, N = 45;
+    vector<H> a(M * K), b(K * N);
+    vector<float> fa(M * K), fb(K * N);
+    for (int i = 0; i < M * K; ++i) fa[i] = float(a[i] = H((i % 9) * 0.125f - 0.5f));
+    for (int i = 0; i < K * N; ++i) fb[i] = float(b[i] = H((i % 5) * 0.25f));
+    vector<float> c = naive_matmul(fa, fb, M, K, N);
+    vector<H> expected(M * N);
+    for (int i = 0; i < M * N; ++i) expected[i] = H(c[i]);
+    Tensor t0(a, {M, K});
+    Tensor t1(b, {K, N});
+    Tensor t2 = t0.matmul(t1);
+    t2.to("cpu");
+    Tensor t3(expected, {M, N});
+    return t2 == t3;
+}
+
+bool test_matmul_half() {
+    return half_matmul<float16>() && half_matmul<bfloat16>();
+}
+
+bool test_matmul_quantized() {
+    // Tails of weight rows left over by the threads, and a single row
+    // as when generating tokens
+    int K = 256, N = 37;
+    vector<float> w(N * K);
+    for (int i = 0; i < N * K; ++i) w[i] = std::sin(i * 0.37f) * (1 + i % 5);
+    Tensor tw(w, {N, K});
+    for (int M : {1, 9}) {
+        vector<float> a(M * K);
+        for (int i = 0; i < M * K; ++i) a[i] = std::cos(i * 0.11f) - 0.2f;
+        for (std::string dtype : {"q8_0", "q4_0", "q4_1"}) {
+            Tensor q = tw.quantize(dtype);
+            if (q.dtype().repr != dtype || (long long)q.nbytes() != q.get_mem_size())
+                return false;
+            // Against the dequantized weights, up to the rounding of the
+            // activations to int8
+            vector<float> deq(N * K);
+            dequantize_row_for(dtype)(q.context.data.data(), deq.data(), N * K);
+            Tensor ta(a, {M, K});
+            Tensor c = ta.matmul(q);
+            c.to("cpu");
+            const float* out = reinterpret_cast<const float*>(c.context.data.data());
+            for (int m = 0; m < M; ++m)
+                for (int n = 0; n < N; ++n) {
+                    double ref = 0, mag = 0;
+                    for (int k = 0; k < K; ++k) {
+                        ref += a[m * K + k] * deq[n * K + k];
+                        mag += std::fabs(a[m * K + k] * deq[n * K + k]);
+                    }
+                    if (std::fabs(out[m * N + n] - ref) > 1e-2 * mag)
+                        return false;
+                }
+        }
+    }
+    // Rows have to be whole blocks, activations floats
+    try {
+        Tensor odd(vector<float>(40, 1.f), {2, 20});
+        odd.quantize("q8_0");
+        return false;
+    } catch (std::runtime_error& e) {}
+    try {
+        Tensor q = tw.quantize("q8_0");
+        Tensor ints(vector<int>(K, 1), {1, K});
+        ints.matmul(q);
+        return false;
+    } catch (std::runtime_error& e) {}
+    // Block types without a kernel, e.g. as loaded from a GGUF file
+    try {
+        Tensor qk(Storage(N * 144), {N, K}, "q4_k");
+        Tensor ta(vector<float>(K, 1.f), {1, K});
+        ta.matmul(qk);
+        return false;
+    } catch (std::runtime_error& e) {
+        if (std::string(e.what()).find("q4_k") == std::string::npos)
+            return false;
+    }
+    return true;
+}
+
+bool test_matmul_quantized_graph() {
+    // Independent quantized matmuls realized in one graph run side by
+    // side, each waiting thread free to pick up another one, against
+    // each of them realized alone
+    int K = 1024, N = 256, count = 6;
+    vector<float> w(N * K);
+    for (int i = 0; i < N * K; ++i) w[i] = std::sin(i * 0.37f);
+    Tensor q = Tensor(w, {N, K}).quantize("q8_0");
+    vector<Tensor> xs;
+    vector<vector<float>> alone;
+    for (int i = 0; i < count; ++i) {
+        int M = 8 * (i + 1);
+        vector<float> a(M * K);
+        for (int k = 0; k < M * K; ++k) a[k] = std::cos(k * 0.11f + i) * (i + 1);
+        xs.emplace_back(a, vector<int>{M, K});
+        Tensor c = xs.back().matmul(q);
+        c.to("cpu");
+        const float* p = reinterpret_cast<const float*>(c.context.data.data());
+        alone.emplace_back(p, p + M * N);
+    }
+    for (int run = 0; run < 10; ++run) {
+        vector<Tensor> cs;
+        for (int i = 0; i < count; ++i) cs.push_back(xs[i].matmul(q));
+        // Summed over the first rows every result has
+        vector<Tensor> firsts;
+        for (int i = 0; i < count; ++i) firsts.push_back(cs[i].slice(0, 0, 8));
+        Tensor sum = firsts[0] + firsts[1];
+        for (int i = 2; i < count; ++i) sum = sum + firsts[i];
+        sum.to("cpu");
+        for (int i = 0; i < count; ++i) cs[i].to("cpu");
+        const float* p = reinterpret_cast<const float*>(sum.context.data.data());
+        for (int j = 0; j < 8 * N; ++j) {
+            float expected = alone[0][j];
+            for (int i = 1; i < count; ++i) expected += alone[i][j];
+            if (p[j] != expected)
+                return false;
+        }
+        for (int i = 0; i < count; ++i) {
+            const float* c = reinterpret_cast<const float*>(cs[i].context.data.data());
+            if (!std::equal(alone[i].begin(), alone[i].end(), c))
+                return false;
+        }
+    }
+    return true;
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_MATMUL_TESTS() \
+    IS_TRUE(test_matmul_small(), "test_matmul_small"); \
+    IS_TRUE(test_matmul_i64_edges(), "test_matmul_i64_edges"); \
+    IS_TRUE(test_matmul_float_blocks(), "test_matmul_float_blocks"); \
+    IS_TRUE(test_matmul_shape_mismatch(), "test_matmul_shape_mismatch"); \
+    IS_TRUE(test_matmul_half(), "test_matmul_half"); \
+    IS_TRUE(test_matmul_quantized(), "test_matmul_quantized"); \
+    IS_TRUE(test_matmul_quantized_graph(), "test_matmul_quantized_graph"); \
+    std::cout << "matmul tests finished ✓" << std::endl;
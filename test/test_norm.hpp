@@ -0,0 +1,166 @@
+#include <cmath>
+#include <limits>
+
+// Softmax of every row of x, in double
+vector<double> softmax_reference(const vector<float>& x, int n, bool log) {
+    vector<double> out(x.size());
+    for (size_t r = 0; r < x.size() / n; ++r) {
+        double max = -INFINITY, sum = 0;
+        for (int j = 0; j < n; ++j) max = std::max(max, (double)x[r * n + j]);
+        for (int j = 0; j < n; ++j) sum += std::exp(x[r * n + j] - max);
+        for (int j = 0; j < n; ++j) {
+            double shifted = x[r * n + j] - max;
+            out[r * n + j] = log ? shifted - std::log(sum) : std::exp(shifted) / sum;
+        }
+    }
+    return out;
+}
+
+// RMSNorm, or LayerNorm with bias, of every row of x, in double
+vector<double> norm_reference(const vector<float>& x, int n, const vector<float>& w,
+                              const vector<float>* bias, double eps) {
+    vector<double> out(x.size());
+    for (size_t r = 0; r < x.size() / n; ++r) {
+        const float* row = x.data() + r * n;
+        double mean = 0, var = 0;
+        if (bias) {
+            for (int j = 0; j < n; ++j) mean += row[j];
+            mean /= n;
+        }
+        for (int j = 0; j < n; ++j) var += (row[j] - mean) * (row[j] - mean);
+        double scale = 1 / std::sqrt(var / n + eps);
+        for (int j = 0; j < n; ++j)
+            out[r * n + j] = (row[j] - mean) * scale * w[j] + (bias ? (*bias)[j] : 0);
+    }
+    return out;
+}
+
+bool close_to(Tensor& t, const vector<double>& expected, double rel, double abs) {
+    Tensor wide = t.dtype().repr == "f32" ? t.contiguous() : t.astype("f32");
+    wide.to("cpu");
+    const float* p = reinterpret_cast<const float*>(wide.context.data.data());
+    for (size_t i = 0; i < expected.size(); ++i)
+        if (!(std::fabs(p[i] - expected[i]) <= abs + rel * std::fabs(expected[i])))
+            return false;
+    return true;
+}
+
+bool test_softmax_rows() {
+    // Attention scores: a row far off zero, a causally masked one, a
+    // tail past the vector width
+    int rows = 6, n = 1027;
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    vector<float> x(rows * n);
+    for (int i = 0; i < rows * n; ++i) x[i] = ((i * 7919) % 4001) / 100.f - 20;
+    for (int j = 0; j < n; ++j) x[n + j] += 1000;
+    for (int j = 5; j < n; ++j) x[2 * n + j] = -inf;
+    Tensor t(x, {2, 3, n});
+    Tensor s = t.softmax();
+    Tensor l = t.log_softmax(-1);
+    uint64_t before = kernel_dispatch_count;
+    s.to("cpu");
+    bool one_pass = kernel_dispatch_count == before + 1;
+    l.to("cpu");
+    // Masked entries are exactly 0 and -inf
+    vector<double> ls = softmax_reference(x, n, true);
+    const float* lp = reinterpret_cast<const float*>(l.context.data.data());
+    const float* sp = reinterpret_cast<const float*>(s.context.data.data());
+    bool close = true;
+    for (int i = 0; i < rows * n; ++i)
+        close = close && (std::isinf(ls[i]) ? lp[i] == -inf && sp[i] == 0
+                                            : std::fabs(lp[i] - ls[i]) <= 1e-5 + 1e-5 * std::fabs(ls[i]));
+    return one_pass && close && close_to(s, softmax_reference(x, n, false), 1e-5, 1e-9);
+}
+
+bool test_softmax_axis() {
+    // Over the first dim of (4, 3), and in bf16
+    vector<float> x{1, -2, 0.5, 3, 0, 0.25, -1, 2, 4, 0, 1, -0.5};
+    Tensor t(x, {4, 3});
+    Tensor s = t.softmax(0);
+    vector<float> columns(12);
+    for (int i = 0; i < 12; ++i) columns[i % 3 * 4 + i / 3] = x[i];
+    vector<double> by_column = softmax_reference(columns, 4, false), expected(12);
+    for (int i = 0; i < 12; ++i) expected[i] = by_column[i % 3 * 4 + i / 3];
+    Tensor h = t.astype("bf16");
+    Tensor hs = h.softmax(1);
+    Tensor hl = h.log_softmax(1);
+    bool threw = false;
+    try {
+        Tensor i(vector<int>{1, 2}, {2});
+        i.softmax();
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    return s.shape() == vector<int>{4, 3} && close_to(s, expected, 1e-5, 1e-9)
+        && close_to(hs, softmax_reference(x, 3, false), 1e-2, 1e-3)
+        && close_to(hl, softmax_reference(x, 3, true), 1e-2, 1e-2) && threw;
+}
+
+bool test_norm_rows() {
+    // Rows past the vector width with a tail, one of them far off zero
+    // with little spread, as a LayerNorm sees after a residual add
+    int rows = 5, n = 1029;
+    vector<float> x(rows * n), w(n), b(n);
+    for (int i = 0; i < rows * n; ++i) x[i] = ((i * 7919) % 4001) / 1000.f - 2;
+    for (int j = 0; j < n; ++j) {
+        x[3 * n + j] = 1000 + (j % 7) * 0.01f;
+        w[j] = 0.5f + (j % 5) * 0.25f;
+        b[j] = (j % 3) - 1.f;
+    }
+    Tensor t(x, {rows, n});
+    Tensor tw(w, {n});
+    Tensor tb(b, {n});
+    Tensor r = t.rms_norm(tw);
+    Tensor l = t.layer_norm(tw, tb);
+    uint64_t before = kernel_dispatch_count;
+    r.to("cpu");
+    bool one_pass = kernel_dispatch_count == before + 1;
+    return one_pass && r.shape() == vector<int>{rows, n}
+        && close_to(r, norm_reference(x, n, w, nullptr, 1e-6), 1e-5, 1e-5)
+        && close_to(l, norm_reference(x, n, w, &b, 1e-5), 1e-5, 1e-5);
+}
+
+bool test_norm_layouts() {
+    // Batched (2, 3, 4), a transposed input, strided weights, bf16
+    vector<float> x(24), w{1, 2, 0.5, -1}, b{0, 1, -1, 0.5}, wide(8);
+    for (int i = 0; i < 24; ++i) x[i] = (i * 5 % 11) - 4.f;
+    for (int j = 0; j < 8; ++j) wide[j] = j % 2 ? 0 : w[j / 2];
+    Tensor t(x, {2, 3, 4});
+    Tensor tw(w, {4});
+    Tensor tb(b, {4});
+    Tensor every_other = Tensor(wide, {4, 2}).slice(1, 0, 1).reshape({4});
+    Tensor r = t.rms_norm(every_other, 1e-5f);
+    Tensor l = t.layer_norm(tw, tb);
+    Tensor tt = Tensor(x, {4, 6}).transpose(0, 1);
+    Tensor lt = tt.layer_norm(tw, tb);
+    vector<float> xt(24);
+    for (int i = 0; i < 24; ++i) xt[i] = x[i % 4 * 6 + i / 4];
+    Tensor h = t.astype("bf16");
+    Tensor hw = tw.astype("bf16");
+    Tensor hb = tb.astype("bf16");
+    Tensor hl = h.layer_norm(hw, hb);
+    Tensor hr = h.rms_norm(hw);
+    int threw = 0;
+    Tensor square = tb.reshape({2, 2});
+    try { t.rms_norm(square); } catch (std::runtime_error&) { ++threw; }
+    try { h.rms_norm(tw); } catch (std::runtime_error&) { ++threw; }
+    try {
+        Tensor i(vector<int>{1, 2}, {2});
+        Tensor iw(vector<int>{1, 1}, {2});
+        i.rms_norm(iw);
+    } catch (std::runtime_error&) { ++threw; }
+    return close_to(r, norm_reference(x, 4, w, nullptr, 1e-5), 1e-5, 1e-5)
+        && close_to(l, norm_reference(x, 4, w, &b, 1e-5), 1e-5, 1e-5)
+        && close_to(lt, norm_reference(xt, 4, w, &b, 1e-5), 1e-5, 1e-5)
+        && close_to(hl, norm_reference(x, 4, w, &b, 1e-5), 1e-2, 2e-2)
+        && close_to(hr, norm_reference(x, 4, w, nullptr, 1e-6), 1e-2, 2e-2)
+        && hr.dtype().repr == "bf16" && threw == 3;
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_NORM_TESTS() \
+    IS_TRUE(test_softmax_rows(), "test_softmax_rows"); \
+    IS_TRUE(test_softmax_axis(), "test_softmax_axis"); \
+    IS_TRUE(test_norm_rows(), "test_norm_rows"); \
+    IS_TRUE(test_norm_layouts(), "test_norm_layouts"); \
+    std::cout << "norm tests finished ✓" << std::endl;
@@ -0,0 +1,202 @@
+#include <cmath>
+
+// Values of a realized f32 tensor
+vector<float> floats_of(Tensor& t) {
+    t.to("cpu");
+    const float* p = reinterpret_cast<const float*>(t.context.data.data());
+    return vector<float>(p, p + t.nbytes() / sizeof(float));
+}
+
+bool test_reduce_axes() {
+    // (2, 3, 4), x[a][b][c] = a * 100 + (b * 7 + c * 3) % 10
+    vector<int> x(24);
+    for (int i = 0; i < 24; ++i)
+        x[i] = i / 12 * 100 + (i / 4 % 3 * 7 + i % 4 * 3) % 10;
+    Tensor t(x, {2, 3, 4});
+    vector<int> last(6), middle(8), first(12), ends(3), all{0};
+    vector<int> max_mid(8, INT32_MIN), min_mid(8, INT32_MAX);
+    vector<int64_t> arg_mid(8);
+    for (int a = 0; a < 2; ++a)
+        for (int b = 0; b < 3; ++b)
+            for (int c = 0; c < 4; ++c) {
+                int v = x[(a * 3 + b) * 4 + c];
+                last[a * 3 + b] += v;
+                middle[a * 4 + c] += v;
+                first[b * 4 + c] += v;
+                ends[b] += v;
+                all[0] += v;
+                if (v > max_mid[a * 4 + c]) {
+                    max_mid[a * 4 + c] = v;
+                    arg_mid[a * 4 + c] = b;
+                }
+                min_mid[a * 4 + c] = std::min(min_mid[a * 4 + c], v);
+            }
+    Tensor s2 = t.sum(-1);
+    Tensor s1 = t.sum(1, true);
+    Tensor s0 = t.sum(0);
+    // Dims apart, moved next to each other first
+    Tensor s02 = t.sum({0, 2});
+    Tensor s = t.sum();
+    Tensor mx = t.max(1);
+    Tensor mn = t.min(1, true);
+    Tensor am = t.argmax(1);
+    Tensor flat = t.argmax();
+    s2.to("cpu");
+    s1.to("cpu");
+    s0.to("cpu");
+    s02.to("cpu");
+    s.to("cpu");
+    mx.to("cpu");
+    mn.to("cpu");
+    am.to("cpu");
+    flat.to("cpu");
+    int64_t first_max = std::max_element(x.begin(), x.end()) - x.begin();
+    return s2 == Tensor(last, {2, 3}) && s1 == Tensor(middle, {2, 1, 4})
+        && s0 == Tensor(first, {3, 4}) && s02 == Tensor(ends, {3})
+        && s.shape().empty() && s == Tensor(all, {})
+        && mx == Tensor(max_mid, {2, 4}) && mn == Tensor(min_mid, {2, 1, 4})
+        && am.dtype().repr == "i64" && am == Tensor(arg_mid, {2, 4})
+        && flat == Tensor(vector<int64_t>{first_max}, {});
+}
+
+bool test_reduce_accuracy() {
+    // Far more elements than f32 can add up one by one without losing
+    // the small ones, split over threads
+    int n = (1 << 22) + 5;
+    vector<float> x(n);
+    double exact = 0;
+    for (int i = 0; i < n; ++i) {
+        x[i] = 1 + (i % 13) * 0.01f;
+        exact += x[i];
+    }
+    Tensor t(x, {n});
+    Tensor s = t.sum();
+    Tensor m = t.mean();
+    float sum = floats_of(s)[0], mean = floats_of(m)[0];
+    // Columns of few outputs, reduced over many rows with Kahan sums
+    int rows = 1 << 17, cols = 3;
+    vector<float> y((size_t)rows * cols);
+    vector<double> col_exact(cols, 0);
+    for (int i = 0; i < rows * cols; ++i) {
+        y[i] = 0.1f + (i % 11) * 0.001f;
+        col_exact[i % cols] += y[i];
+    }
+    Tensor ty(y, {rows, cols});
+    Tensor cs = ty.sum(0);
+    vector<float> col_sums = floats_of(cs);
+    bool columns = true;
+    for (int j = 0; j < cols; ++j)
+        columns = columns && std::fabs(col_sums[j] - col_exact[j]) < 1e-6 * col_exact[j];
+    return std::fabs(sum - exact) < 1e-6 * exact
+        && std::fabs(mean - exact / n) < 1e-6 * exact / n && columns;
+}
+
+bool test_reduce_layouts() {
+    // Every path: long and short runs, wide and narrow column tiles,
+    // views, halves
+    int A = 3, B = 700, C = 300;
+    // Small integers, exact in bf16
+    vector<float> x(A * B * C);
+    for (size_t i = 0; i < x.size(); ++i) x[i] = float((i * 7919) % 251) - 125;
+    Tensor t(x, {A, B, C});
+    vector<float> max_b(A * C, -1e9), min_c(A * B, 1e9);
+    vector<int64_t> arg_c(A * B), arg_b(A * C);
+    for (int a = 0; a < A; ++a)
+        for (int b = 0; b < B; ++b)
+            for (int c = 0; c < C; ++c) {
+                float v = x[((size_t)a * B + b) * C + c];
+                if (v > max_b[a * C + c]) {
+                    max_b[a * C + c] = v;
+                    arg_b[a * C + c] = b;
+                }
+                if (v > x[((size_t)a * B + b) * C + arg_c[a * B + b]])
+                    arg_c[a * B + b] = c;
+                min_c[a * B + b] = std::min(min_c[a * B + b], v);
+            }
+    Tensor mb = t.max(1);
+    Tensor ab = t.argmax(1);
+    Tensor mc = t.min(2);
+    Tensor ac = t.argmax(-1);
+    // Same through a transposed view, reduced over its first dim
+    Tensor tt = t.transpose(1, 2);
+    Tensor mt = tt.min(1);
+    mb.to("cpu");
+    ab.to("cpu");
+    mc.to("cpu");
+    ac.to("cpu");
+    mt.to("cpu");
+    Tensor half = t.astype("bf16");
+    Tensor hb = half.argmax(1);
+    Tensor hm = half.max(1);
+    Tensor hmf = hm.astype("f32");
+    Tensor hs = half.sum(2);
+    Tensor hsf = hs.astype("f32");
+    hb.to("cpu");
+    vector<float> sums = floats_of(hsf);
+    bool summed = true;
+    for (int r = 0; r < A * B; ++r) {
+        float expected = 0;
+        for (int c = 0; c < C; ++c) expected += x[(size_t)r * C + c];
+        // Rounded once to bf16 at the end
+        summed = summed && std::fabs(sums[r] - expected) <= std::fabs(expected) / 128;
+    }
+    return mb == Tensor(max_b, {A, C}) && ab == Tensor(arg_b, {A, C})
+        && mc == Tensor(min_c, {A, B}) && ac == Tensor(arg_c, {A, B})
+        && mt == Tensor(min_c, {A, B}) && hb == Tensor(arg_b, {A, C})
+        && floats_of(hmf) == max_b && summed;
+}
+
+bool test_reduce_nan() {
+    // A NaN wins max and min wherever it sits: first, in a vector
+    // lane, in the tail, in any part of a split run or column. argmax
+    // gives the first one. The last row has none.
+    int R = 4, n = 1 << 17;
+    vector<float> x((size_t)R * n);
+    for (size_t i = 0; i < x.size(); ++i) x[i] = std::sin(i * 0.01f) * 100;
+    vector<vector<int>> at = {{0}, {5, 70001, 90000}, {n - 1}, {}};
+    for (int r = 0; r < R; ++r)
+        for (int k : at[r]) x[(size_t)r * n + k] = NAN;
+    // Rows as runs, and the same as columns of the transpose
+    vector<float> xt(x.size());
+    for (int r = 0; r < R; ++r)
+        for (int k = 0; k < n; ++k) xt[(size_t)k * R + r] = x[(size_t)r * n + k];
+    Tensor rows(x, {R, n});
+    Tensor cols(xt, {n, R});
+    Tensor outs[] = {rows.max(1), rows.min(1), cols.max(0), cols.min(0),
+                     rows.argmax(1), cols.argmax(0)};
+    bool ok = true;
+    for (int o = 0; o < 4; ++o) {
+        vector<float> v = floats_of(outs[o]);
+        for (int r = 0; r < R; ++r)
+            ok = ok && std::isnan(v[r]) == !at[r].empty();
+    }
+    for (int o = 4; o < 6; ++o) {
+        outs[o].to("cpu");
+        const int64_t* index = reinterpret_cast<const int64_t*>(outs[o].context.data.data());
+        for (int r = 0; r < R - 1; ++r)
+            ok = ok && index[r] == at[r][0];
+    }
+    return ok;
+}
+
+bool test_reduce_errors() {
+    Tensor t(vector<int>{1, 2, 3, 4}, {2, 2});
+    Tensor empty(vector<float>{}, {2, 0});
+    Tensor zeros = empty.sum(1);
+    zeros.to("cpu");
+    int threw = 0;
+    try { t.mean(); } catch (std::runtime_error&) { ++threw; }
+    try { t.sum({1, -1}); } catch (std::runtime_error&) { ++threw; }
+    try { t.max(2); } catch (std::runtime_error&) { ++threw; }
+    try { empty.argmax(1); } catch (std::runtime_error&) { ++threw; }
+    return threw == 4 && zeros == Tensor(vector<float>{0, 0}, {2});
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_REDUCE_TESTS() \
+    IS_TRUE(test_reduce_axes(), "test_reduce_axes"); \
+    IS_TRUE(test_reduce_accuracy(), "test_reduce_accuracy"); \
+    IS_TRUE(test_reduce_layouts(), "test_reduce_layouts"); \
+    IS_TRUE(test_reduce_nan(), "test_reduce_nan"); \
+    IS_TRUE(test_reduce_errors(), "test_reduce_errors"); \
+    std::cout << "reduce tests finished ✓" << std::endl;
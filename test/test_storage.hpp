@@ -0,0 +1,437 @@
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+bool test_size_classes() {
+    for (size_t bytes = 1; bytes < (size_t(1) << 22); bytes = bytes * 9 / 8 + 1) {
+        size_t c = CachingAllocator::size_class(bytes);
+        size_t size = CachingAllocator::class_bytes(c);
+        // Fits, wastes at most a fifth, and the class below doesn't fit
+        if (size < bytes || size % CachingAllocator::alignment) return false;
+        if (bytes > 256 && (size - bytes) * 5 > size) return false;
+        if (c > 0 && CachingAllocator::class_bytes(c - 1) >= bytes) return false;
+    }
+    return CachingAllocator::size_class(CachingAllocator::max_cached)
+        == CachingAllocator::nclasses - 1;
+}
+
+bool test_allocator_reuse() {
+    CachingAllocator allocator(size_t(64) << 20);
+    set_storage_allocator(&allocator);
+    bool ok = true;
+    // Copied in, temporaries would be adopted
+    vector<float> ones(1000, 1.f), twos(1000, 2.f);
+    {
+        Tensor a(ones, {1000});
+        Tensor b(twos, {1000});
+        Tensor c = a + b;
+        c.to("cpu");
+        ok = ok && allocator.stats().misses == 3 && allocator.stats().hits == 0;
+        ok = ok && reinterpret_cast<uintptr_t>(c.context.data.data())
+            % CachingAllocator::alignment == 0;
+    }
+    AllocatorStats freed = allocator.stats();
+    ok = ok && freed.bytes_in_use == 0 && freed.bytes_held >= 3 * 4000;
+    {
+        // Same sizes again, nothing new asked from the system
+        Tensor a(twos, {1000});
+        Tensor b(twos, {1000});
+        Tensor c = a * b;
+        c.to("cpu");
+        Tensor expected(vector<float>(1000, 4.f), {1000});
+        ok = ok && c == expected;
+    }
+    AllocatorStats again = allocator.stats();
+    ok = ok && again.misses == freed.misses && again.hits == 3;
+    set_storage_allocator(nullptr);
+    allocator.trim();
+    return ok && allocator.stats().bytes_held == 0;
+}
+
+bool test_allocator_limit() {
+    // Nothing cached, every block goes back to the system
+    CachingAllocator allocator(0);
+    void* p = allocator.allocate(4096, 64);
+    allocator.deallocate(p, 4096, 64);
+    p = allocator.allocate(4096, 64);
+    allocator.deallocate(p, 4096, 64);
+    AllocatorStats s = allocator.stats();
+    return s.misses == 2 && s.hits == 0 && s.bytes_held == 0;
+}
+
+bool test_storage_buffer() {
+    CachingAllocator allocator(size_t(1) << 20);
+    bool ok;
+    {
+        int values[5] = {1, 2, 3, 4, 5};
+        Storage a(values, sizeof(values), &allocator);
+        Storage b(sizeof(values), &allocator);
+        std::memcpy(b.data(), values, sizeof(values));
+        ok = a == b && a.size() == sizeof(values)
+            && reinterpret_cast<uintptr_t>(a.data()) % Storage::alignment == 0
+            && reinterpret_cast<uintptr_t>(b.data()) % Storage::alignment == 0;
+        // Moves hand the memory over
+        const uint8_t* bytes = a.data();
+        Storage c = std::move(a);
+        ok = ok && c.data() == bytes && a.empty() && a.data() == nullptr;
+        b = std::move(c);
+        ok = ok && b.data() == bytes && allocator.stats().bytes_held > 0;
+    }
+    return ok && allocator.stats().bytes_in_use == 0;
+}
+
+bool test_tensor_adopt_vector() {
+    vector<float> data(1 << 16);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = i % 13;
+    const float* bytes = data.data();
+    Tensor a(std::move(data), {1 << 8, 1 << 8});
+    // Same buffer, the vector handed it over
+    bool ok = a.context.data.data() == reinterpret_cast<const uint8_t*>(bytes)
+        && a.context.data.is_external() && data.empty();
+    Tensor b = a + a;
+    b.to("cpu");
+    return ok && reinterpret_cast<const float*>(b.context.data.data())[14] == 2;
+}
+
+bool test_tensor_adopt_pointer() {
+    int freed = 0;
+    {
+        int* data = new int[6]{1, 2, 3, 4, 5, 6};
+        Tensor a(data, {2, 3}, [&freed](int* p) { delete[] p; freed++; });
+        Tensor b(vector<int>{1, 1, 1, 1, 1, 1}, {2, 3});
+        Tensor c = a + b;
+        c.to("cpu");
+        Tensor expected(vector<int>{2, 3, 4, 5, 6, 7}, {2, 3});
+        if (!(c == expected) || freed != 0) return false;
+    }
+    // Refused without taking the memory, it stays the caller's
+    int threw = 0;
+    std::unique_ptr<int[]> kept(new int[1]);
+    try {
+        Tensor d(kept.get(), {1}, nullptr);
+    } catch (std::runtime_error&) {
+        threw++;
+    }
+    try {
+        Tensor e(static_cast<int*>(nullptr), {2}, [](int* p) { delete[] p; });
+    } catch (std::runtime_error&) {
+        threw++;
+    }
+    try {
+        Tensor f(vector<int>{1, 2, 3}, {2, 2});
+    } catch (std::runtime_error&) {
+        threw++;
+    }
+    return freed == 1 && threw == 3;
+}
+
+bool test_tensor_borrow_span() {
+    std::vector<float> owned{1, 2, 3, 4};
+    bool ok;
+    {
+        Tensor a(std::span<const float>(owned), {2, 2});
+        ok = a.context.data.data() == reinterpret_cast<uint8_t*>(owned.data());
+        Tensor b = a * a;
+        b.to("cpu");
+        Tensor expected(vector<float>{1, 4, 9, 16}, {2, 2});
+        ok = ok && b == expected;
+    }
+    // Untouched, and still ours
+    ok = ok && owned == std::vector<float>{1, 2, 3, 4};
+    bool threw = false;
+    try {
+        Tensor c(std::span<float>(owned), {3});
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    return ok && threw;
+}
+
+// Scratch file holding floats [0, n) after a 16 byte header
+std::string write_float_file(const std::string& name, int n) {
+    std::string path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream out(path, std::ios::binary);
+    char header[16] = "tensorlib test";
+    out.write(header, sizeof(header));
+    for (int i = 0; i < n; ++i) {
+        float f = i;
+        out.write(reinterpret_cast<const char*>(&f), sizeof(f));
+    }
+    return path;
+}
+
+bool test_mapped_tensor() {
+    int n = 4096;
+    std::string path = write_float_file("tensorlib_mapped.bin", n);
+    bool ok;
+    {
+        auto file = MappedFile::open(path);
+        file->advise(MappedFile::Advice::Sequential);
+        Tensor w(file->storage(16, n * sizeof(float)), {n / 64, 64}, "f32");
+        // Reads the page cache in place
+        ok = w.context.data.data() == file->data() + 16
+            && w.context.data.is_external();
+        Tensor r = w + w;
+        r.to("cpu");
+        ok = ok && reinterpret_cast<const float*>(r.context.data.data())[77] == 154;
+        // Storage past the end is refused, so is a size off the shape
+        bool threw = false;
+        try {
+            file->storage(16, n * sizeof(float) + 1);
+        } catch (std::runtime_error&) {
+            threw = true;
+        }
+        try {
+            Tensor bad(file->storage(16, 8), {3}, "f32");
+            threw = false;
+        } catch (std::runtime_error&) {}
+        ok = ok && threw;
+    }
+    std::filesystem::remove(path);
+    return ok;
+}
+
+bool test_mapped_copy_on_write() {
+    std::string path = write_float_file("tensorlib_cow.bin", 16);
+    bool ok;
+    {
+        auto file = MappedFile::open(path, MappedFile::Mode::CopyOnWrite);
+        Storage view = file->storage(16, 16 * sizeof(float));
+        reinterpret_cast<float*>(view.data())[3] = -1;
+        // Changed for us, not in the file
+        auto again = MappedFile::open(path);
+        ok = reinterpret_cast<const float*>(again->data() + 16)[3] == 3
+            && reinterpret_cast<const float*>(file->data() + 16)[3] == -1;
+    }
+    std::filesystem::remove(path);
+    return ok;
+}
+
+// safetensors file with the given header, followed by data
+std::string write_safetensors(const std::string& name, const std::string& header,
+                              const std::vector<uint8_t>& data) {
+    std::string path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream out(path, std::ios::binary);
+    // Padded like writers do, keeping the data aligned
+    std::string padded = header + std::string((8 - header.size() % 8) % 8, ' ');
+    uint64_t n = padded.size();
+    for (int i = 0; i < 8; ++i) out.put(char(n >> (8 * i)));
+    out << padded;
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return path;
+}
+
+bool test_safetensors() {
+    std::vector<uint8_t> data(6 * 4 + 4 * 8 + 5);
+    float w[6] = {1.5f, 2, 3, 4, 5, 6};
+    int64_t ids[4] = {7, -8, 9, 1ll << 40};
+    float odd = 0.25f;
+    std::memcpy(data.data(), w, sizeof(w));
+    std::memcpy(data.data() + sizeof(w), ids, sizeof(ids));
+    std::memcpy(data.data() + 57, &odd, sizeof(odd));
+    std::string header = R"( {"__metadata__": {"format": "pt", "note": "caf\u00e9 \"x\""},
+        "layer.0.weight": {"dtype": "F32", "shape": [2, 3], "data_offsets": [0, 24]},
+        "ids": {"shape": [4], "data_offsets": [24, 56], "dtype": "I64", "extra": [1, {"a": null}]},
+        "odd": {"dtype": "F32", "shape": [], "data_offsets": [57, 61]},
+        "scale": {"dtype": "F64", "shape": [1], "data_offsets": [24, 32]}} )";
+    std::string path = write_safetensors("tensorlib_test.safetensors", header, data);
+    std::map<std::string, std::string> metadata;
+    bool ok;
+    {
+        auto tensors = load_safetensors(path, &metadata);
+        Tensor& weight = tensors.at("layer.0.weight");
+        Tensor& ids_t = tensors.at("ids");
+        // Misaligned data is copied rather than viewed
+        Tensor& odd_t = tensors.at("odd");
+        ok = !odd_t.context.data.is_external()
+            && *reinterpret_cast<const float*>(odd_t.context.data.data()) == 0.25f;
+        ok = ok && tensors.size() == 3 && !tensors.count("scale")
+            && weight.dtype().repr == "f32"
+            && ids_t.dtype().repr == "i64" && ids_t.shape() == std::vector<int>{4}
+            && weight.context.data.is_external()
+            && metadata["format"] == "pt" && metadata["note"] == "caf\xc3\xa9 \"x\"";
+        Tensor b(vector<float>{1, 1, 1, 1, 1, 1}, {2, 3});
+        Tensor r = weight + b;
+        r.to("cpu");
+        Tensor expected(vector<float>{2.5f, 3, 4, 5, 6, 7}, {2, 3});
+        Tensor expected_ids(vector<int64_t>{7, -8, 9, 1ll << 40}, {4});
+        ok = ok && r == expected && ids_t == expected_ids;
+    }
+    std::filesystem::remove(path);
+    // Ranges past the data are refused, even of dtypes left out
+    int refused = 0;
+    for (std::string bad : {
+            R"({"x": {"dtype": "F32", "shape": [2], "data_offsets": [0, 80]}})",
+            R"({"x": {"dtype": "Q9", "shape": [2], "data_offsets": [0, 80]}})",
+            R"({"x": {"dtype": "F32", "shape": [2], "data_offsets": [0, 8]})"}) {
+        path = write_safetensors("tensorlib_bad.safetensors", bad, data);
+        try {
+            load_safetensors(path);
+        } catch (std::runtime_error&) {
+            refused++;
+        }
+        std::filesystem::remove(path);
+    }
+    return ok && refused == 3;
+}
+
+// Little endian GGUF writer, just what the tests need
+struct GGUFWriter {
+    std::string bytes;
+    template <typename T>
+    void put(T v) { bytes.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void str(const std::string& s) { put<uint64_t>(s.size()); bytes += s; }
+    void key(const std::string& k, uint32_t type) { str(k); put(type); }
+    void info(const std::string& name, std::vector<uint64_t> dims,
+              uint32_t type, uint64_t offset) {
+        str(name);
+        put<uint32_t>(dims.size());
+        for (uint64_t d : dims) put(d);
+        put(type);
+        put(offset);
+    }
+    void align(size_t to) { bytes.resize((bytes.size() + to - 1) / to * to, 0); }
+};
+
+bool test_gguf() {
+    GGUFWriter w;
+    w.put<uint32_t>(0x46554747);
+    w.put<uint32_t>(3);
+    w.put<uint64_t>(4);     // tensors
+    w.put<uint64_t>(5);     // metadata
+    w.key("general.architecture", 8); w.str("llama");
+    w.key("general.alignment", 4); w.put<uint32_t>(64);
+    w.key("llama.rope.freq_base", 6); w.put<float>(10000.f);
+    w.key("tokenizer.ggml.tokens", 9);
+    w.put<uint32_t>(8); w.put<uint64_t>(2); w.str("<s>"); w.str("hi");
+    w.key("test.flag", 7); w.put<uint8_t>(1);
+    // ggml lists dimensions innermost first
+    w.info("tok", {3, 2}, 0, 0);
+    w.info("blk.0.q", {64, 2}, 8, 64);
+    w.info("f16", {4}, 1, 256);
+    w.info("f64", {2}, 28, 320);
+    w.align(64);
+    size_t data = w.bytes.size();
+    for (int i = 0; i < 6; ++i) w.put<float>(i);
+    w.align(64);
+    // Four q8_0 blocks, a scale and 32 quants each
+    for (int b = 0; b < 4; ++b) {
+        w.put<uint16_t>(0x3c00);
+        for (int i = 0; i < 32; ++i) w.put<int8_t>(i - b);
+    }
+    w.bytes.resize(data + 320 + 16, 0);
+
+    std::string path = (std::filesystem::temp_directory_path() / "tensorlib_test.gguf").string();
+    std::ofstream(path, std::ios::binary) << w.bytes;
+    bool ok;
+    {
+        GGUFReader reader(path);
+        auto& meta = reader.metadata();
+        ok = reader.version() == 3 && meta.size() == 5
+            && meta.at("general.architecture").as_string() == "llama"
+            && meta.at("general.alignment").as_uint() == 64
+            && meta.at("llama.rope.freq_base").as_float() == 10000.0
+            && meta.at("tokenizer.ggml.tokens").as_array().size() == 2
+            && meta.at("tokenizer.ggml.tokens").as_array()[1].as_string() == "hi"
+            && meta.at("test.flag").as_bool();
+        auto& infos = reader.tensor_infos();
+        ok = ok && infos.size() == 4 && infos[0].shape == std::vector<int>{2, 3}
+            && infos[1].dtype == "q8_0" && infos[1].nbytes == 4 * 34
+            && infos[1].offset == data + 64 && infos[2].dtype == "f16"
+            && infos[3].dtype.empty();
+        Tensor q = reader.tensor("blk.0.q");
+        // Still packed, straight from the file
+        ok = ok && q.dtype().repr == "q8_0" && q.shape() == std::vector<int>{2, 64}
+            && q.nbytes() == 4 * 34 && q.context.data.is_external()
+            && int8_t(q.context.data.data()[34 + 2 + 5]) == 4;
+        Tensor tok = reader.tensor("tok");
+        Tensor one(vector<float>{1, 1, 1, 1, 1, 1}, {2, 3});
+        Tensor r = tok + one;
+        r.to("cpu");
+        Tensor expected(vector<float>{1, 2, 3, 4, 5, 6}, {2, 3});
+        ok = ok && r == expected;
+        ok = ok && reader.tensor("f16").nbytes() == 8;
+        bool threw = false;
+        try {
+            reader.tensor("f64");
+        } catch (std::runtime_error&) {
+            threw = true;
+        }
+        // Left out of the whole set instead
+        auto all = reader.tensors();
+        ok = ok && threw && all.size() == 3 && !all.count("f64");
+    }
+    // Cut short, the reader refuses rather than reading past the end
+    std::ofstream(path, std::ios::binary) << w.bytes.substr(0, 100);
+    bool refused = false;
+    try {
+        GGUFReader reader(path);
+    } catch (std::runtime_error&) {
+        refused = true;
+    }
+    std::filesystem::remove(path);
+    return ok && refused;
+}
+
+bool test_gguf_malformed() {
+    // Headers that would read out of bounds or mislead if taken as they are
+    auto header = [](GGUFWriter& w, uint64_t ntensors, uint64_t nkv) {
+        w.put<uint32_t>(0x46554747);
+        w.put<uint32_t>(3);
+        w.put<uint64_t>(ntensors);
+        w.put<uint64_t>(nkv);
+    };
+    std::vector<GGUFWriter> files(5);
+    // Element count wrapping around 64 bits, to a tiny size
+    header(files[0], 1, 0);
+    files[0].info("huge", std::vector<uint64_t>(8, INT32_MAX), 0, 0);
+    // q8_0 rows of 48, a block and a half
+    header(files[1], 1, 0);
+    files[1].info("partial", {48, 2}, 8, 0);
+    // The same name twice
+    header(files[2], 2, 0);
+    files[2].info("w", {4}, 0, 0);
+    files[2].info("w", {4}, 0, 0);
+    // Arrays of arrays of arrays...
+    header(files[3], 0, 1);
+    files[3].key("deep", 9);
+    for (int i = 0; i < 1000; ++i) {
+        files[3].put<uint32_t>(9);
+        files[3].put<uint64_t>(1);
+    }
+    files[3].put<uint32_t>(4);
+    files[3].put<uint64_t>(0);
+    // A key given twice, the second would win unnoticed
+    header(files[4], 0, 2);
+    files[4].key("general.alignment", 4); files[4].put<uint32_t>(32);
+    files[4].key("general.alignment", 4); files[4].put<uint32_t>(64);
+    std::string path = (std::filesystem::temp_directory_path() / "tensorlib_malformed.gguf").string();
+    int refused = 0;
+    for (auto& w : files) {
+        w.bytes.resize(w.bytes.size() + 256, 0);
+        std::ofstream(path, std::ios::binary) << w.bytes;
+        try {
+            GGUFReader reader(path);
+        } catch (std::runtime_error&) {
+            refused++;
+        }
+    }
+    std::filesystem::remove(path);
+    return refused == 5;
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_STORAGE_TESTS() \
+    IS_TRUE(test_size_classes(), "test_size_classes"); \
+    IS_TRUE(test_allocator_reuse(), "test_allocator_reuse"); \
+    IS_TRUE(test_allocator_limit(), "test_allocator_limit"); \
+    IS_TRUE(test_storage_buffer(), "test_storage_buffer"); \
+    IS_TRUE(test_tensor_adopt_vector(), "test_tensor_adopt_vector"); \
+    IS_TRUE(test_tensor_adopt_pointer(), "test_tensor_adopt_pointer"); \
+    IS_TRUE(test_tensor_borrow_span(), "test_tensor_borrow_span"); \
+    IS_TRUE(test_mapped_tensor(), "test_mapped_tensor"); \
+    IS_TRUE(test_mapped_copy_on_write(), "test_mapped_copy_on_write"); \
+    IS_TRUE(test_safetensors(), "test_safetensors"); \
+    IS_TRUE(test_gguf(), "test_gguf"); \
+    IS_TRUE(test_gguf_malformed(), "test_gguf_malformed"); \
+    std::cout << "storage tests finished ✓" << std::endl;
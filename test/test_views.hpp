@@ -0,0 +1,162 @@
+#include <memory>
+
+bool test_view_transpose() {
+    Tensor t(vector<int>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor v = t.transpose(0, 1);
+    Tensor expected(vector<int>{1, 4, 2, 5, 3, 6}, {3, 2});
+    // Same memory, realized right away
+    bool shared = v.realized && v.context.data.data() == t.context.data.data()
+        && v.strides() == vector<int>{1, 3} && !v.is_contiguous();
+    Tensor d = v.contiguous();
+    d.to("cpu");
+    return shared && v == expected && d == expected && d.is_contiguous()
+        && d.context.data.data() != t.context.data.data();
+}
+
+bool test_view_slicing() {
+    vector<int> x(20);
+    for (int i = 0; i < 20; ++i) x[i] = i;
+    Tensor t(x, {4, 5});
+    Tensor row = t[1];
+    Tensor last = t[-1];
+    Tensor one = t[{2, 3}];
+    Tensor cols = t.slice(1, 1, 5, 2);
+    Tensor rows = t.slice(0, -2, 100);
+    Tensor sum = cols + cols;
+    sum.to("cpu");
+    bool threw = false;
+    try {
+        t[4];
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    return row == Tensor(vector<int>{5, 6, 7, 8, 9}, {5})
+        && last == Tensor(vector<int>{15, 16, 17, 18, 19}, {5})
+        && one.shape().empty() && one == Tensor(vector<int>{13}, {})
+        && cols == Tensor(vector<int>{1, 3, 6, 8, 11, 13, 16, 18}, {4, 2})
+        && rows.is_contiguous() && rows.context.data.data() == t.context.data.data() + 40
+        && sum == Tensor(vector<int>{2, 6, 12, 16, 22, 26, 32, 36}, {4, 2})
+        && threw;
+}
+
+bool test_view_lazy() {
+    Tensor a(vector<float>{1, 2, 3, 4, 5, 6}, {2, 3});
+    Tensor b(vector<float>{1, 1, 1, 1, 1, 1}, {2, 3});
+    Tensor c(vector<float>{10, 20, 30, 40, 50, 60}, {3, 2});
+    Tensor v = a.transpose(0, 1);
+    Tensor w = c.transpose(0, 1);
+    bool ok;
+    {
+        // Views of results still to be computed, aliased on realization
+        Tensor x = a + b;
+        Tensor xt = x.transpose(0, 1);
+        Tensor r = xt + c;
+        Tensor kept = x[1];
+        r.to("cpu");
+        kept.to("cpu");
+        ok = r == Tensor(vector<float>{12, 25, 33, 46, 54, 67}, {3, 2})
+            && kept == Tensor(vector<float>{5, 6, 7}, {3});
+        Tensor moved = std::move(kept);
+        // x goes away here, its memory stays with the view
+        Tensor y = x.transpose(0, 1);
+        ok = ok && y == Tensor(vector<float>{2, 5, 3, 6, 4, 7}, {3, 2});
+    }
+    // Both handles gone, the sum and its view live in the slab
+    std::unique_ptr<Tensor> x(new Tensor(a + b));
+    std::unique_ptr<Tensor> xt(new Tensor(x->transpose(0, 1)));
+    x.reset();
+    Tensor r = *xt + c;
+    xt.reset();
+    r.to("cpu");
+    ok = ok && r == Tensor(vector<float>{12, 25, 33, 46, 54, 67}, {3, 2})
+        && last_memory_plan.slab_bytes > 0;
+    Tensor vd = v.contiguous(), wd = w.contiguous().reshape({3, 2});
+    Tensor s = vd + wd;
+    s.to("cpu");
+    return ok && s == Tensor(vector<float>{11, 34, 52, 25, 43, 66}, {3, 2});
+}
+
+bool test_view_reshape() {
+    // Attention heads: (B, T, H * D) split into (B, H, T, D) and merged back
+    int B = 2, T = 3, H = 2, D = 4;
+    vector<float> x(B * T * H * D);
+    for (size_t i = 0; i < x.size(); ++i) x[i] = i;
+    Tensor t(x, {B, T, H * D});
+    uint64_t before = kernel_dispatch_count;
+    Tensor heads = t.reshape({B, T, H, -1}).transpose(1, 2);
+    bool viewed = kernel_dispatch_count == before && heads.shape() == vector<int>{B, H, T, D}
+        && heads.context.data.data() == t.context.data.data();
+    bool values = true;
+    Tensor h = heads[{1, 1, 2}];
+    for (int d = 0; d < D; ++d)
+        values = values && h[d] == Tensor(vector<float>{x[((1 * T + 2) * H + 1) * D + d]}, {});
+    // Splitting a strided dim is still a view, and so is undoing the
+    // transpose
+    Tensor split = heads.reshape({B, H, T, 2, 2});
+    Tensor back = heads.transpose(1, 2).reshape({B, T, H * D});
+    viewed = viewed && kernel_dispatch_count == before && back.is_contiguous();
+    // Heads laid out densely, as attention leaves them, take a copy
+    // to be merged
+    Tensor out = heads.contiguous();
+    Tensor merged = out.transpose(1, 2).reshape({B, T, H * D});
+    merged.to("cpu");
+    bool copied = kernel_dispatch_count == before + 2;
+    return viewed && values && split.context.data.data() == t.context.data.data()
+        && split[{1, 1, 2, 1}] == Tensor(vector<float>{x[((1 * T + 2) * H + 1) * D + 2],
+                                                       x[((1 * T + 2) * H + 1) * D + 3]}, {2})
+        && back == t && copied && merged == t;
+}
+
+bool test_view_expand() {
+    Tensor col(vector<int>{1, 2, 3}, {3, 1});
+    Tensor e = col.expand({2, 3, 4});
+    vector<int> ones(24, 1), expected(24);
+    for (int i = 0; i < 24; ++i) expected[i] = (i / 4) % 3 + 2;
+    Tensor o(ones, {2, 3, 4});
+    Tensor r = e + o;
+    r.to("cpu");
+    bool threw = false;
+    try {
+        col.expand({2, 4});
+    } catch (std::runtime_error&) {
+        threw = true;
+    }
+    return e.strides() == vector<int>{0, 1, 0} && r == Tensor(expected, {2, 3, 4})
+        && threw;
+}
+
+bool test_view_contiguous_large() {
+    // Several tiles with edges, and a permutation of three dims
+    int M = 300, N = 517;
+    vector<float> x(M * N), xt(M * N);
+    for (int i = 0; i < M; ++i)
+        for (int j = 0; j < N; ++j) {
+            x[i * N + j] = i * 1000 + j;
+            xt[j * M + i] = i * 1000 + j;
+        }
+    Tensor t(x, {M, N});
+    Tensor d = t.transpose(0, 1).contiguous();
+    int A = 7, B = 45, C = 33;
+    vector<int> y(A * B * C), yp(A * B * C);
+    for (int a = 0; a < A; ++a)
+        for (int b = 0; b < B; ++b)
+            for (int c = 0; c < C; ++c) {
+                y[(a * B + b) * C + c] = (a * B + b) * C + c;
+                yp[(c * A + a) * B + b] = (a * B + b) * C + c;
+            }
+    Tensor ty(y, {A, B, C});
+    Tensor p = ty.permute({2, 0, 1}).contiguous();
+    d.to("cpu");
+    p.to("cpu");
+    return d == Tensor(xt, {N, M}) && p == Tensor(yp, {C, A, B});
+}
+
+// ADD TESTS TO THIS MACRO
+#define RUN_VIEW_TESTS() \
+    IS_TRUE(test_view_transpose(), "test_view_transpose"); \
+    IS_TRUE(test_view_slicing(), "test_view_slicing"); \
+    IS_TRUE(test_view_lazy(), "test_view_lazy"); \
+    IS_TRUE(test_view_reshape(), "test_view_reshape"); \
+    IS_TRUE(test_view_expand(), "test_view_expand"); \
+    IS_TRUE(test_view_contiguous_large(), "test_view_contiguous_large"); \
+    std::cout << "view tests finished ✓" << std::endl;